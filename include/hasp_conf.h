@@ -19,6 +19,18 @@
 
 #define HASP_USE_BUTTON 1
 
+#if defined(ARDUINO_ARCH_ESP32)
+#define HASP_USE_TASKS 1 // Run wifi and mqtt in a separate task on the other core
+#else
+#define HASP_USE_TASKS 0
+#endif
+
+/* Copy pre-blended glyphs into labels on a single color background, replaces the design function of the
+ * labels. Off by default, turn it on with -D HASP_USE_GLYPH_TILES=1 in platformio_override.ini */
+#ifndef HASP_USE_GLYPH_TILES
+#define HASP_USE_GLYPH_TILES 0
+#endif
+
 #define HASP_USE_QRCODE 1
 #define HASP_USE_PNGDECODE 0
 
@@ -27,6 +27,12 @@
    Graphical settings
  *====================*/
 
+/* The native tests have no tft driver to set the resolution */
+#ifndef TFT_WIDTH
+#define TFT_WIDTH  240
+#define TFT_HEIGHT 320
+#endif
+
 /* Maximal horizontal and vertical resolution to support by the library.*/
 #define LV_HOR_RES_MAX          (TFT_WIDTH)
 #define LV_VER_RES_MAX          (TFT_HEIGHT)
@@ -223,9 +229,13 @@ typedef void * lv_img_decoder_user_data_t;
 
 /* 1: use a custom tick source.
  * It removes the need to manually update the tick with `lv_tick_inc`) */
-#define LV_TICK_CUSTOM     0
+#if defined(ARDUINO)
+#define LV_TICK_CUSTOM     1
+#else
+#define LV_TICK_CUSTOM     0    /*The native tests call lv_tick_inc*/
+#endif
 #if LV_TICK_CUSTOM == 1
-#define LV_TICK_CUSTOM_INCLUDE  "something.h"       /*Header for the sys time function*/
+#define LV_TICK_CUSTOM_INCLUDE  "Arduino.h"         /*Header for the sys time function*/
 #define LV_TICK_CUSTOM_SYS_TIME_EXPR (millis())     /*Expression evaluating to current systime in ms*/
 #endif   /*LV_TICK_CUSTOM*/
 
@@ -343,9 +353,10 @@ typedef void * lv_indev_drv_user_data_t;            /*Type of user data in the i
  */
 //#define LV_FONT_CUSTOM_DECLARE static lv_font_t *defaultFont;
 
-/*Always set a default font from the built-in fonts*/
+/*Always set a default font from the built-in fonts.
+ *unscii_8_icon is declared on both, the zi fonts fall back on it for the icons*/
 #if LV_HIGH_RESOURCE_MCU>0
-#define LV_FONT_CUSTOM_DECLARE LV_FONT_DECLARE(lv_font_roboto_16);
+#define LV_FONT_CUSTOM_DECLARE LV_FONT_DECLARE(lv_font_roboto_16) LV_FONT_DECLARE(unscii_8_icon);
 #define LV_FONT_DEFAULT        &lv_font_roboto_16
 #else
 #define LV_FONT_CUSTOM_DECLARE LV_FONT_DECLARE(unscii_8_icon);
@@ -5,6 +5,8 @@
 
 #ifdef ESP32
 #include "SPIFFS.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
 #endif
 #include <FS.h>
 
@@ -15,8 +17,37 @@
 /*********************
  *      DEFINES
  *********************/
-#define ColorBlack 0x0f
-#define ColorWhite 0x00
+/* Decoded glyph bitmap cache, override the budget per device class with a build flag */
+#ifndef ZIFONT_CACHE_BUDGET
+#if ESP32
+#define ZIFONT_CACHE_BUDGET 16384 // bytes of 4bpp bitmaps
+#else
+#define ZIFONT_CACHE_BUDGET 2048
+#endif
+#endif
+#if ESP32
+#define ZIFONT_READ_AHEAD 512 // bytes read at once from a font file
+#else
+#define ZIFONT_READ_AHEAD 128
+#endif
+#define ZIFONT_MAX_FILES 4 // font files kept open
+#if ESP32
+#define ZIPACK_TABLE_RAM 8192 // largest packed glyph table loaded into ram, larger ones are searched in the file
+#else
+#define ZIPACK_TABLE_RAM 1024
+#endif
+
+/* Optional flash data partition holding a copy of the fonts, mapped into the address space */
+#define ZIFONT_PARTITION_SUBTYPE 0x40
+#define ZIFONT_TOC_MAGIC 0x544E465A // "ZFNT"
+#define ZIFONT_TOC_SIZE 4096        // the table of contents takes the first flash sector
+#ifndef ZIFONT_CACHE_ENTRIES
+#if ESP32
+#define ZIFONT_CACHE_ENTRIES 96
+#else
+#define ZIFONT_CACHE_ENTRIES 24
+#endif
+#endif
 
 /**********************
  *      TYPEDEFS
@@ -56,19 +87,71 @@ enum zifont_codepage_t8_t {
     UTF_8 = 0x18
 };
 
+/* Where a glyph comes from, see resolveGlyph() */
+enum zifont_source_t {
+    ZIFONT_SOURCE_NONE = 0,
+    ZIFONT_SOURCE_FONT,
+    ZIFONT_SOURCE_ICONS,
+    ZIFONT_SOURCE_FALLBACK,
+};
+
+typedef struct
+{
+    const lv_font_t * font;
+    uint32_t unicode;
+    uint32_t last_used; // cache tick of the last hit, the lowest is evicted first
+    uint16_t size;
+    uint8_t * bitmap;
+} zifont_cache_entry_t;
+
+/* Table of contents at the start of the font partition, the font files follow it */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t count;
+} zifont_toc_header_t;
+
+typedef struct
+{
+    char name[48];
+    uint32_t offset; // from the start of the partition
+    uint32_t size;
+} zifont_toc_entry_t;
+
+/* Open font file with a read-ahead buffer, so adjacent charmap and glyph reads are served from memory.
+ * Fonts found in the font partition are read straight from the mapped flash instead. */
+typedef struct
+{
+    File file;
+    const uint8_t * mem; // mapped font data, NULL for files on SPIFFS
+    uint32_t mem_size;
+    char path[64];
+    uint32_t last_used;
+    uint32_t buf_pos; // file position of buf[0]
+    uint16_t buf_len;
+    uint8_t buf[ZIFONT_READ_AHEAD];
+} zifont_reader_t;
+
 /**********************
  *  STATIC PROTOTYPES
  **********************/
 const uint8_t * IRAM_ATTR lv_font_get_bitmap_fmt_zifont(const lv_font_t * font, uint32_t unicode_letter);
 bool IRAM_ATTR lv_font_get_glyph_dsc_fmt_zifont(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out,
                                                 uint32_t unicode_letter, uint32_t unicode_letter_next);
+const uint8_t * lv_font_get_bitmap_fmt_zipack(const lv_font_t * font, uint32_t unicode_letter);
+bool lv_font_get_glyph_dsc_fmt_zipack(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t unicode_letter,
+                                      uint32_t unicode_letter_next);
+static void closeReader(const char * path);
+static void releaseGlyphTable(lv_font_fmt_zifont_dsc_t * dsc);
+static bool zipackFind(const lv_font_t * font, uint32_t unicode, lv_zipack_glyph_t * glyph);
+#if ESP32
+static void mapFontPartition();
+#endif
 
 /**********************
  *  STATIC VARIABLES
  **********************/
-uint32_t charInBuffer = 0; // Last Character ID in the Bitmap Buffer
 // uint8_t filecharBitmap_p[20 * 1024];
-lv_zifont_char_t lastCharInfo; // Holds the last Glyph DSC
 
 #if ESP32
 // static lv_zifont_char_t charCache[256 - 32]; // glyphID DSC cache
@@ -79,6 +162,19 @@ lv_zifont_char_t lastCharInfo; // Holds the last Glyph DSC
 #endif
 static uint8_t * charBitmap_p;
 
+static zifont_cache_entry_t glyphCache[ZIFONT_CACHE_ENTRIES];
+static uint32_t glyphCacheTick = 0;
+static lv_zifont_cache_stats_t glyphCacheStats;
+
+static zifont_reader_t * fontReaders[ZIFONT_MAX_FILES];
+static lv_font_fmt_zifont_dsc_t * loadedFonts = NULL;
+
+#if ESP32
+static const esp_partition_t * fontPartition = NULL;
+static const uint8_t * fontFlash             = NULL;
+static spi_flash_mmap_handle_t fontFlashHandle;
+#endif
+
 /**********************
  *      MACROS
  **********************/
@@ -88,15 +184,212 @@ static uint8_t * charBitmap_p;
  **********************/
 
 void printBuffer(uint8_t * charBitmap_p, uint8_t w, uint8_t h);
-void colorsAdd(uint8_t * charBitmap_p, uint8_t color1, uint16_t pos);
 uint16_t unicode2codepoint(uint32_t unicode, uint8_t codepage);
 
 int lv_zifont_init(void)
 {
     // charBitmap_p = (uint8_t *)lv_mem_alloc(32 * 32);
+    glyphCacheStats.budget = ZIFONT_CACHE_BUDGET;
+#if ESP32
+    mapFontPartition();
+#endif
     return LV_RES_OK; // OK
 }
 
+static void glyphCacheRemove(zifont_cache_entry_t * entry)
+{
+    glyphCacheStats.used -= entry->size;
+    free(entry->bitmap);
+    entry->bitmap = NULL;
+    entry->font   = NULL;
+}
+
+/* Drop the cached glyphs of a font, or all glyphs if font is NULL */
+void lv_zifont_cache_flush(const lv_font_t * font)
+{
+    for(uint8_t i = 0; i < ZIFONT_CACHE_ENTRIES; i++) {
+        if(glyphCache[i].bitmap && (!font || glyphCache[i].font == font)) glyphCacheRemove(&glyphCache[i]);
+    }
+}
+
+static const uint8_t * glyphCacheFind(const lv_font_t * font, uint32_t unicode)
+{
+    for(uint8_t i = 0; i < ZIFONT_CACHE_ENTRIES; i++) {
+        if(glyphCache[i].bitmap && glyphCache[i].font == font && glyphCache[i].unicode == unicode) {
+            glyphCache[i].last_used = ++glyphCacheTick;
+            glyphCacheStats.hits++;
+            return glyphCache[i].bitmap;
+        }
+    }
+    glyphCacheStats.misses++;
+    return NULL;
+}
+
+/* Keep a copy of the decoded bitmap, evicting the least recently used glyphs until it fits the budget */
+static const uint8_t * glyphCacheAdd(const lv_font_t * font, uint32_t unicode, const uint8_t * bitmap, uint16_t size)
+{
+    if(size > ZIFONT_CACHE_BUDGET) return bitmap;
+
+    zifont_cache_entry_t * slot = NULL;
+    while(true) {
+        zifont_cache_entry_t * oldest = NULL;
+        slot                          = NULL;
+        for(uint8_t i = 0; i < ZIFONT_CACHE_ENTRIES; i++) {
+            if(!glyphCache[i].bitmap) {
+                if(!slot) slot = &glyphCache[i];
+            } else if(!oldest || glyphCache[i].last_used < oldest->last_used) {
+                oldest = &glyphCache[i];
+            }
+        }
+        if(slot && glyphCacheStats.used + size <= ZIFONT_CACHE_BUDGET) break;
+        if(!oldest) return bitmap;
+        glyphCacheRemove(oldest);
+        glyphCacheStats.evictions++;
+    }
+
+    slot->bitmap = (uint8_t *)malloc(size);
+    if(!slot->bitmap) return bitmap;
+
+    memcpy(slot->bitmap, bitmap, size);
+    slot->font      = font;
+    slot->unicode   = unicode;
+    slot->size      = size;
+    slot->last_used = ++glyphCacheTick;
+    glyphCacheStats.used += size;
+    return slot->bitmap;
+}
+
+/**
+ * Copy all .zi and .zp files from SPIFFS into the font partition, where they are read without the file system.
+ * @return number of fonts written, or -1 if there is no font partition
+ */
+int lv_zifont_flash_fonts(void)
+{
+#if ESP32
+    if(!fontPartition) {
+        errorPrintln(F("FONT: %sNo font partition found"));
+        return -1;
+    }
+
+    /* Release everything that points into the partition, packed fonts search their glyphs in the file instead */
+    for(uint8_t i = 0; i < ZIFONT_MAX_FILES; i++) {
+        if(fontReaders[i]) closeReader(fontReaders[i]->path);
+    }
+    for(lv_font_fmt_zifont_dsc_t * dsc = loadedFonts; dsc; dsc = dsc->next) {
+        if(dsc->glyphs && !dsc->glyphs_in_ram) dsc->glyphs = NULL;
+    }
+    if(fontFlash) spi_flash_munmap(fontFlashHandle);
+    fontFlash                   = NULL;
+    glyphCacheStats.flash_fonts = 0;
+
+    uint8_t * toc_p = (uint8_t *)malloc(ZIFONT_TOC_SIZE);
+    uint8_t * chunk = (uint8_t *)malloc(1024);
+    if(!toc_p || !chunk) {
+        free(toc_p);
+        free(chunk);
+        return -1;
+    }
+    memset(toc_p, 0xFF, ZIFONT_TOC_SIZE);
+    esp_partition_erase_range(fontPartition, 0, fontPartition->size);
+
+    zifont_toc_header_t * toc  = (zifont_toc_header_t *)toc_p;
+    zifont_toc_entry_t * entry = (zifont_toc_entry_t *)(toc_p + sizeof(zifont_toc_header_t));
+    uint32_t maxCount          = (ZIFONT_TOC_SIZE - sizeof(zifont_toc_header_t)) / sizeof(zifont_toc_entry_t);
+    uint32_t offset            = ZIFONT_TOC_SIZE;
+    uint32_t count             = 0;
+
+    File root = SPIFFS.open("/");
+    File file = root.openNextFile();
+    while(file && count < maxCount) {
+        String name = file.name();
+        if((name.endsWith(F(".zi")) || name.endsWith(F(".zp"))) && name.length() < sizeof(entry->name) &&
+           offset + file.size() <= fontPartition->size) {
+            strcpy(entry->name, name.c_str());
+            entry->offset = offset;
+            entry->size   = file.size();
+
+            size_t len;
+            while((len = file.read(chunk, 1024)) > 0) {
+                esp_partition_write(fontPartition, offset, chunk, len);
+                offset += len;
+            }
+            offset = (offset + 3) & ~3; // keep the fonts word aligned
+            entry++;
+            count++;
+
+            char msg[128];
+            snprintf_P(msg, sizeof(msg), PSTR("FONT: Flashed %s"), name.c_str());
+            debugPrintln(msg);
+        }
+        file = root.openNextFile();
+    }
+
+    /* Write the table of contents last, an interrupted copy leaves an unmapped partition */
+    toc->magic = ZIFONT_TOC_MAGIC;
+    toc->count = count;
+    esp_partition_write(fontPartition, 0, toc_p, ZIFONT_TOC_SIZE);
+
+    free(chunk);
+    free(toc_p);
+
+    mapFontPartition();
+    return count;
+#else
+    errorPrintln(F("FONT: %sFont partitions are only supported on ESP32"));
+    return -1;
+#endif
+}
+
+/**
+ * Release a font loaded with lv_zifont_font_init, including its cached glyphs and the path in user_data.
+ */
+void lv_zifont_font_free(lv_font_t * font)
+{
+    if(!font) return;
+
+    lv_zifont_cache_flush(font);
+    lv_font_fmt_zifont_dsc_t * dsc = (lv_font_fmt_zifont_dsc_t *)font->dsc;
+    if(dsc) {
+        lv_font_fmt_zifont_dsc_t ** link = &loadedFonts;
+        while(*link && *link != dsc) link = &(*link)->next;
+        if(*link) *link = dsc->next;
+
+        releaseGlyphTable(dsc);
+        free(dsc->ranges);
+        free(dsc->ascii_glyph_dsc);
+        free(dsc->icon_path);
+        lv_mem_free(dsc);
+    }
+    if(font->user_data) {
+        closeReader((char *)font->user_data);
+        free(font->user_data);
+    }
+    lv_mem_free(font);
+}
+
+/* Bytes held by a font: its descriptors, charmap cache and index, and its cached glyph bitmaps */
+uint32_t lv_zifont_font_size(const lv_font_t * font)
+{
+    if(!font || !font->dsc) return 0;
+
+    const lv_font_fmt_zifont_dsc_t * dsc = (const lv_font_fmt_zifont_dsc_t *)font->dsc;
+    uint32_t size                        = sizeof(lv_font_t) + sizeof(lv_font_fmt_zifont_dsc_t);
+    if(dsc->ascii_glyph_dsc) size += sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE;
+    size += dsc->range_count * sizeof(lv_zifont_range_t);
+    if(dsc->glyphs_in_ram) size += dsc->glyph_count * sizeof(lv_zipack_glyph_t);
+    if(dsc->icon_path) size += strlen(dsc->icon_path) + 1;
+
+    for(uint8_t i = 0; i < ZIFONT_CACHE_ENTRIES; i++) {
+        if(glyphCache[i].bitmap && glyphCache[i].font == font) size += glyphCache[i].size;
+    }
+    return size;
+}
+
+void lv_zifont_get_cache_stats(lv_zifont_cache_stats_t * stats)
+{
+    *stats = glyphCacheStats;
+}
+
 bool openFont(File & file, const char * filename)
 {
     file = SPIFFS.open(filename, "r");
@@ -109,6 +402,255 @@ bool openFont(File & file, const char * filename)
     return true;
 }
 
+#if ESP32
+/* Map the font partition into the data address space, if it exists and holds fonts */
+static void mapFontPartition()
+{
+    fontPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)ZIFONT_PARTITION_SUBTYPE,
+                                             NULL);
+    if(!fontPartition) return;
+
+    if(esp_partition_mmap(fontPartition, 0, fontPartition->size, SPI_FLASH_MMAP_DATA, (const void **)&fontFlash,
+                          &fontFlashHandle) != ESP_OK) {
+        fontFlash = NULL;
+        return;
+    }
+
+    const zifont_toc_header_t * toc = (const zifont_toc_header_t *)fontFlash;
+    if(toc->magic != ZIFONT_TOC_MAGIC) {
+        spi_flash_munmap(fontFlashHandle);
+        fontFlash = NULL;
+        return;
+    }
+    glyphCacheStats.flash_fonts = toc->count;
+}
+
+static const uint8_t * findFlashFont(const char * path, uint32_t * size)
+{
+    if(!fontFlash) return NULL;
+
+    const zifont_toc_header_t * toc  = (const zifont_toc_header_t *)fontFlash;
+    const zifont_toc_entry_t * entry = (const zifont_toc_entry_t *)(fontFlash + sizeof(zifont_toc_header_t));
+    for(uint32_t i = 0; i < toc->count; i++, entry++) {
+        if(strcmp(entry->name, path) == 0) {
+            *size = entry->size;
+            return fontFlash + entry->offset;
+        }
+    }
+    return NULL;
+}
+#endif
+
+/* Close the open handle of a font file, e.g. after it was replaced */
+static void closeReader(const char * path)
+{
+    for(uint8_t i = 0; i < ZIFONT_MAX_FILES; i++) {
+        if(fontReaders[i] && strcmp(fontReaders[i]->path, path) == 0) {
+            if(!fontReaders[i]->mem) fontReaders[i]->file.close();
+            delete fontReaders[i];
+            fontReaders[i] = NULL;
+        }
+    }
+}
+
+/* Get the open reader of a font file, opening it and closing the least recently used one if needed */
+static zifont_reader_t * getReader(const char * path)
+{
+    for(uint8_t i = 0; i < ZIFONT_MAX_FILES; i++) {
+        if(fontReaders[i] && strcmp(fontReaders[i]->path, path) == 0) {
+            fontReaders[i]->last_used = ++glyphCacheTick;
+            return fontReaders[i];
+        }
+    }
+
+    zifont_reader_t * reader = new zifont_reader_t;
+    if(!reader) return NULL;
+
+    reader->mem = NULL;
+#if ESP32
+    reader->mem = findFlashFont(path, &reader->mem_size);
+#endif
+    if(!reader->mem) {
+        if(!openFont(reader->file, path)) {
+            delete reader;
+            return NULL;
+        }
+        glyphCacheStats.file_opens++;
+    }
+
+    /* Take a free slot, or the least recently used one, only once the file is open */
+    zifont_reader_t ** slot = NULL;
+    for(uint8_t i = 0; i < ZIFONT_MAX_FILES; i++) {
+        if(!fontReaders[i]) {
+            slot = &fontReaders[i];
+            break;
+        }
+        if(!slot || fontReaders[i]->last_used < (*slot)->last_used) slot = &fontReaders[i];
+    }
+    if(*slot) closeReader((*slot)->path);
+
+    strncpy(reader->path, path, sizeof(reader->path) - 1);
+    reader->path[sizeof(reader->path) - 1] = '\0';
+    reader->last_used                      = ++glyphCacheTick;
+    reader->buf_pos                        = 0;
+    reader->buf_len                        = 0;
+    *slot                                  = reader;
+    return reader;
+}
+
+/* Read len bytes at pos, from the read-ahead buffer when possible */
+static size_t readFont(zifont_reader_t * reader, uint32_t pos, void * dst, size_t len)
+{
+    if(reader->mem) {
+        if(pos >= reader->mem_size) return 0;
+        if(len > reader->mem_size - pos) len = reader->mem_size - pos;
+        memcpy(dst, reader->mem + pos, len);
+        return len;
+    }
+
+    if(pos >= reader->buf_pos && pos + len <= reader->buf_pos + reader->buf_len) {
+        memcpy(dst, reader->buf + (pos - reader->buf_pos), len);
+        return len;
+    }
+
+    reader->file.seek(pos, SeekSet);
+    if(len >= ZIFONT_READ_AHEAD) {
+        /* Too large for the buffer, read directly */
+        size_t read = reader->file.read((uint8_t *)dst, len);
+        glyphCacheStats.file_bytes += read;
+        return read;
+    }
+
+    reader->buf_pos = pos;
+    reader->buf_len = reader->file.read(reader->buf, ZIFONT_READ_AHEAD);
+    glyphCacheStats.file_bytes += reader->buf_len;
+
+    if(len > reader->buf_len) len = reader->buf_len;
+    memcpy(dst, reader->buf, len);
+    return len;
+}
+
+/* readFont for the plain codec functions */
+static size_t readFontCb(void * ctx, uint32_t pos, void * dst, size_t len)
+{
+    return readFont((zifont_reader_t *)ctx, pos, dst, len);
+}
+
+/* Collapse the charmap into ranges of consecutive codepoints, so any glyph is found with a binary search */
+static bool buildRanges(zifont_reader_t * reader, lv_font_fmt_zifont_dsc_t * dsc)
+{
+    return lv_zifont_build_ranges(readFontCb, reader, dsc->Startdataaddress, dsc->Maximumnumchars, &dsc->ranges,
+                                  &dsc->range_count);
+}
+
+/* Charmap entry of a codepoint, or -1 if the font does not have it */
+static int32_t glyphIndex(const lv_font_fmt_zifont_dsc_t * fdsc, uint32_t unicode)
+{
+    /* Without an index, assume a Latin-1 charmap starting at the space */
+    if(!fdsc->ranges) return unicode <= 0xFF ? unicode - 0x20 : -1;
+    return lv_zifont_find_range(fdsc->ranges, fdsc->range_count, unicode);
+}
+
+static void releaseGlyphTable(lv_font_fmt_zifont_dsc_t * dsc)
+{
+    if(dsc->glyphs_in_ram) free((void *)dsc->glyphs);
+    dsc->glyphs              = NULL;
+    dsc->glyphs_in_ram       = 0;
+    dsc->glyph_count         = 0;
+    dsc->last_packed.unicode = 0;
+}
+
+static void setFontPath(lv_font_t * font, const char * font_path)
+{
+    if(font->user_data != (char *)font_path) {
+        if(font->user_data) free(font->user_data);
+        font->user_data = (char *)font_path;
+    }
+}
+
+/* Set the fallback chain of a font, the resolved codepoints are forgotten */
+void lv_zifont_set_fallback(lv_font_t * font, const char * icon_path, const lv_font_t * fallback)
+{
+    if(!font || !font->dsc) return;
+
+    lv_font_fmt_zifont_dsc_t * dsc = (lv_font_fmt_zifont_dsc_t *)font->dsc;
+    free(dsc->icon_path);
+    dsc->icon_path    = icon_path ? strdup(icon_path) : NULL;
+    dsc->icon_charmap = 0;
+    dsc->fallback     = fallback != font ? fallback : NULL;
+    memset(dsc->resolved, 0, sizeof(dsc->resolved));
+}
+
+/* Charmap position of an icon font from its header, 0 if it is not a zi font */
+static uint32_t iconCharmap(zifont_reader_t * reader)
+{
+    zi_font_header_t header;
+    if(readFont(reader, 0, &header, sizeof(header)) != sizeof(header)) return 0;
+    if(header.Password != 4 || header.Version != 5) return 0;
+    return header.Startdataaddress + header.Descriptionlength;
+}
+
+/**
+ * Find the font of the fallback chain that has a glyph, once per codepoint.
+ * Later lookups of the same codepoint only cost a compare, without formatting paths or opening files.
+ */
+static uint8_t resolveGlyph(const lv_font_t * font, uint32_t unicode)
+{
+    lv_font_fmt_zifont_dsc_t * fdsc = (lv_font_fmt_zifont_dsc_t *)font->dsc;
+    lv_zifont_resolve_t * slot      = NULL;
+
+    if(unicode <= 0xFFFF) {
+        slot = &fdsc->resolved[unicode % LV_ZIFONT_RESOLVE_SIZE];
+        if(slot->unicode == unicode) return slot->source;
+    }
+
+    uint8_t source = ZIFONT_SOURCE_NONE;
+    if(font->get_glyph_dsc == lv_font_get_glyph_dsc_fmt_zipack) {
+        lv_zipack_glyph_t glyph;
+        if(zipackFind(font, unicode, &glyph)) source = ZIFONT_SOURCE_FONT;
+    } else if(unicode < 0xF000) {
+        if(glyphIndex(fdsc, unicode) >= 0) source = ZIFONT_SOURCE_FONT;
+    } else if(fdsc->icon_path) {
+        zifont_reader_t * reader = getReader(fdsc->icon_path);
+        if(reader && !fdsc->icon_charmap) fdsc->icon_charmap = iconCharmap(reader);
+        if(!reader || !fdsc->icon_charmap) {
+            /* No usable icon font, do not look for it again until the font is reloaded */
+            free(fdsc->icon_path);
+            fdsc->icon_path = NULL;
+            memset(fdsc->resolved, 0, sizeof(fdsc->resolved));
+        } else {
+            /* The icon font has one charmap entry per codepoint from 0xF000, check it is this one */
+            lv_zifont_char_t entry;
+            uint32_t pos = fdsc->icon_charmap + (unicode - 0xF000) * sizeof(lv_zifont_char_t);
+            if(readFont(reader, pos, &entry, sizeof(entry)) == sizeof(entry) && entry.character == unicode)
+                source = ZIFONT_SOURCE_ICONS;
+        }
+    }
+
+    if(source == ZIFONT_SOURCE_NONE && fdsc->fallback) {
+        lv_font_glyph_dsc_t dsc;
+        if(fdsc->fallback->get_glyph_dsc(fdsc->fallback, &dsc, unicode, 0)) source = ZIFONT_SOURCE_FALLBACK;
+    }
+
+    if(slot) {
+        slot->unicode = unicode;
+        slot->source  = source;
+    }
+    return source;
+}
+
+/* Glyph of the fallback font, vertically centered on the line of this font */
+static bool fallbackGlyphDsc(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t unicode_letter,
+                             uint32_t unicode_letter_next)
+{
+    const lv_font_t * fallback = ((lv_font_fmt_zifont_dsc_t *)font->dsc)->fallback;
+    if(!fallback->get_glyph_dsc(fallback, dsc_out, unicode_letter, unicode_letter_next)) return false;
+
+    int16_t diff = font->line_height - fallback->line_height;
+    dsc_out->ofs_y += diff - diff / 2 + fallback->base_line - font->base_line;
+    return true;
+}
+
 void initCharacterFrame(size_t size)
 {
     if(size > lv_mem_get_size(charBitmap_p)) {
@@ -118,47 +660,114 @@ void initCharacterFrame(size_t size)
     memset(charBitmap_p, 0, size); // init the bitmap to white}
 }
 
+/* Load a font made by tools/zipack.cpp, its bitmaps are already in the LVGL glyph layout */
+static int zipackFontInit(lv_font_t * font, lv_font_fmt_zifont_dsc_t * dsc, zifont_reader_t * reader,
+                          const char * font_path, uint32_t startMicros)
+{
+    lv_zipack_header_t header;
+    if(readFont(reader, 0, &header, sizeof(header)) != sizeof(header)) {
+        debugPrintln(PSTR("FONT: Error reading packed font header"));
+        return ZIFONT_ERROR_READING_DATA;
+    }
+    if(header.version != LV_ZIPACK_VERSION || (header.bpp != 1 && header.bpp != 2 && header.bpp != 4)) {
+        debugPrintln(PSTR("FONT: Unknown packed font version"));
+        return ZIFONT_ERROR_UNKNOWN_HEADER;
+    }
+
+    /* Use the glyph table in place when mapped, or load it if it is small enough */
+    releaseGlyphTable(dsc);
+    uint32_t tableSize = header.glyph_count * sizeof(lv_zipack_glyph_t);
+    if(reader->mem) {
+        if(header.glyph_offset + tableSize <= reader->mem_size)
+            dsc->glyphs = (const lv_zipack_glyph_t *)(reader->mem + header.glyph_offset);
+    } else if(tableSize <= ZIPACK_TABLE_RAM) {
+        lv_zipack_glyph_t * glyphs = (lv_zipack_glyph_t *)malloc(tableSize);
+        if(glyphs && readFont(reader, header.glyph_offset, glyphs, tableSize) == tableSize) {
+            dsc->glyphs        = glyphs;
+            dsc->glyphs_in_ram = 1;
+        } else {
+            free(glyphs);
+        }
+    }
+
+    dsc->glyph_count   = header.glyph_count;
+    dsc->glyph_offset  = header.glyph_offset;
+    dsc->bitmap_offset = header.bitmap_offset;
+    dsc->bpp           = header.bpp;
+    dsc->CharHeight    = header.line_height;
+
+    font->get_glyph_dsc    = lv_font_get_glyph_dsc_fmt_zipack;
+    font->get_glyph_bitmap = lv_font_get_bitmap_fmt_zipack;
+    font->line_height      = header.line_height;
+    font->base_line        = header.base_line;
+    font->dsc              = dsc;
+    font->subpx            = 0;
+    setFontPath(font, font_path);
+    lv_zifont_set_fallback(font, NULL, &unscii_8_icon); // icons are packed into the font itself
+
+    char msg[128];
+    snprintf_P(msg, sizeof(msg), PSTR("FONT: Loaded packed font %s containing %u characters in %u us%s"), font_path,
+               header.glyph_count, micros() - startMicros, reader->mem ? " from flash" : "");
+    debugPrintln(msg);
+    return ZIFONT_NO_ERROR;
+}
+
 int lv_zifont_font_init(lv_font_t ** font, const char * font_path, uint16_t size)
 {
-    charInBuffer = 0; // invalidate any previous cache
+    uint32_t startMicros = micros();
 
-    if(!*font) *font = (lv_font_t *)lv_mem_alloc(sizeof(lv_font_t));
-    LV_ASSERT_MEM(*font);
+    if(*font) lv_zifont_cache_flush(*font); // invalidate any previous cache
+    closeReader(font_path);                 // the file may have been replaced
+
+    if(!*font) {
+        *font = (lv_font_t *)lv_mem_alloc(sizeof(lv_font_t));
+        LV_ASSERT_MEM(*font);
+        if(!*font) return ZIFONT_ERROR_OUT_OF_MEMORY;
+        memset(*font, 0, sizeof(lv_font_t));
+    }
 
     lv_font_fmt_zifont_dsc_t * dsc;
     if(!(*font)->dsc) {
         dsc = (lv_font_fmt_zifont_dsc_t *)lv_mem_alloc(sizeof(lv_font_fmt_zifont_dsc_t));
         LV_ASSERT_MEM(dsc);
+        if(dsc) {
+            memset(dsc, 0, sizeof(lv_font_fmt_zifont_dsc_t));
+            dsc->next   = loadedFonts;
+            loadedFonts = dsc;
+        }
+        (*font)->dsc = dsc; // so lv_zifont_font_free can release it, even if loading fails
     } else {
         dsc = (lv_font_fmt_zifont_dsc_t *)(*font)->dsc;
     }
     if(dsc == NULL) return ZIFONT_ERROR_OUT_OF_MEMORY;
 
     /* Initialize Last Glyph DSC */
-    dsc->last_glyph_dsc = (lv_zifont_char_t *)lv_mem_alloc(sizeof(lv_zifont_char_t));
-    if(dsc->last_glyph_dsc == NULL) return ZIFONT_ERROR_OUT_OF_MEMORY;
-    dsc->last_glyph_dsc->width = 0;
-    dsc->last_glyph_id         = 0;
+    dsc->last_glyph_dsc = NULL;
+    dsc->last_glyph_id  = 0;
 
     /* Open the font for reading */
-    File file;
-    if(!openFont(file, font_path)) return ZIFONT_ERROR_OPENING_FILE;
+    zifont_reader_t * reader = getReader(font_path);
+    if(!reader) return ZIFONT_ERROR_OPENING_FILE;
+
+    /* Packed fonts are recognized by their magic */
+    uint32_t magic = 0;
+    readFont(reader, 0, &magic, sizeof(magic));
+    if(magic == LV_ZIPACK_MAGIC) return zipackFontInit(*font, dsc, reader, font_path, startMicros);
+    releaseGlyphTable(dsc);
 
     /* Read file header as dsc */
     zi_font_header_t header;
-    size_t readSize = file.readBytes((char *)&header, sizeof(zi_font_header_t));
+    size_t readSize = readFont(reader, 0, &header, sizeof(zi_font_header_t));
 
     /* Check that we read the correct size */
     if(readSize != sizeof(zi_font_header_t)) {
         debugPrintln(PSTR("FONT: Error reading ziFont Header"));
-        file.close();
         return ZIFONT_ERROR_READING_DATA;
     }
 
     /* Check ziFile Header Format */
     if(header.Password != 4 || header.Version != 5) {
         debugPrintln(PSTR("FONT: Unknown font file format"));
-        file.close();
         return ZIFONT_ERROR_UNKNOWN_HEADER;
     }
 
@@ -171,33 +780,36 @@ int lv_zifont_font_init(lv_font_t ** font, const char * font_path, uint16_t size
     dsc->Fontdataadd8byte = header.Fontdataadd8byte;
 
     if(!dsc->ascii_glyph_dsc) {
-        dsc->ascii_glyph_dsc = (lv_zifont_char_t *)lv_mem_alloc(sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE);
-        LV_ASSERT_MEM(dsc->ascii_glyph_dsc);
+        dsc->ascii_glyph_dsc = (lv_zifont_char_t *)malloc(sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE);
     }
     if(dsc->ascii_glyph_dsc == NULL) {
-        file.close();
         return ZIFONT_ERROR_OUT_OF_MEMORY;
     }
 
     /* read charmap into cache */
-    file.seek(0 * sizeof(zi_font_header_t) + dsc->Startdataaddress, SeekSet);
-    //* read and fill charmap cache
-    readSize = file.readBytes((char *)dsc->ascii_glyph_dsc, sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE);
+    //* read and fill charmap cache, a small font may have less entries than the cache
+    size_t cacheSize = sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE;
+    if(dsc->Maximumnumchars < CHAR_CACHE_SIZE) cacheSize = sizeof(lv_zifont_char_t) * dsc->Maximumnumchars;
+    memset(dsc->ascii_glyph_dsc, 0, sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE);
+    readSize = readFont(reader, 0 * sizeof(zi_font_header_t) + dsc->Startdataaddress, dsc->ascii_glyph_dsc, cacheSize);
 
     //* Check that we read the correct size
-    if(readSize != sizeof(lv_zifont_char_t) * CHAR_CACHE_SIZE) {
+    if(readSize != cacheSize) {
         debugPrintln(PSTR("FONT: Error reading ziFont character map"));
-        file.close();
         return ZIFONT_ERROR_READING_DATA;
     }
 
+    /* Index the codepoints of the charmap */
+    if(!buildRanges(reader, dsc)) {
+        warningPrintln(F("FONT: %sOut of memory for the charmap index, only Latin-1 is available"));
+    }
+
     char msg[128];
-    sprintf_P(msg, PSTR("FONT: Loaded V%d Font File: %s containing %d characters"), header.Version, font_path,
-              header.Maximumnumchars);
+    sprintf_P(msg, PSTR("FONT: Loaded V%d Font File: %s containing %d characters in %u ranges in %u us%s"),
+              header.Version, font_path, header.Maximumnumchars, dsc->range_count, micros() - startMicros,
+              reader->mem ? " from flash" : "");
     debugPrintln(msg);
 
-    file.close();
-
     /*
         sprintf_P(msg, PSTR("password: %u - skipL0: %u - skipLH: %u - state: %u\n"), dsc->Password, dsc->SkipL0,
                   dsc->SkipLH, dsc->State);
@@ -225,10 +837,12 @@ int lv_zifont_font_init(lv_font_t ** font, const char * font_path, uint16_t size
     /* header data struct */ /*The custom font data. Will be accessed by `get_glyph_bitmap/dsc` */
     (*font)->subpx = 0;
 
-    if((*font)->user_data != (char *)font_path) {
-        if((*font)->user_data) free((*font)->user_data);
-        (*font)->user_data = (char *)font_path;
-    }
+    setFontPath(*font, font_path);
+
+    /* Default fallback chain, the icon font of the same height and the built-in font with the icons */
+    char icon_path[32];
+    snprintf_P(icon_path, sizeof(icon_path), PSTR("/fontawesome%u.zi"), dsc->CharHeight);
+    lv_zifont_set_fallback(*font, icon_path, &unscii_8_icon);
     return ZIFONT_NO_ERROR;
 }
 
@@ -244,69 +858,68 @@ int lv_zifont_font_init(lv_font_t ** font, const char * font_path, uint16_t size
  */
 const uint8_t * lv_font_get_bitmap_fmt_zifont(const lv_font_t * font, uint32_t unicode_letter)
 {
-    /* Bitmap still in buffer */
-    if(charInBuffer == unicode_letter && charBitmap_p) {
-        // Serial.printf("CacheLetter %c\n", (char)(uint8_t)unicode_letter);
-        // Serial.printf("#%c", (char)(uint8_t)unicode_letter);
-        return charBitmap_p;
-    }
-
     lv_font_fmt_zifont_dsc_t * fdsc = (lv_font_fmt_zifont_dsc_t *)font->dsc; /* header data struct */
+    uint8_t source                  = resolveGlyph(font, unicode_letter);
+    if(source == ZIFONT_SOURCE_NONE) return NULL;
+    if(source == ZIFONT_SOURCE_FALLBACK) return fdsc->fallback->get_glyph_bitmap(fdsc->fallback, unicode_letter);
+
+    /* Bitmap already decoded */
+    const uint8_t * cached = glyphCacheFind(font, unicode_letter);
+    if(cached) return cached;
+
+    uint32_t startMicros = micros();
     lv_zifont_char_t * charInfo;
 
     /* Space */
     if(unicode_letter == 0x20) {
-        charInfo    = &fdsc->ascii_glyph_dsc[0];
-        size_t size = (charInfo->width * fdsc->CharHeight + 1) / 2; // add 1 for rounding up
+        int32_t index = glyphIndex(fdsc, unicode_letter);
+        charInfo      = &fdsc->ascii_glyph_dsc[index >= 0 && index < CHAR_CACHE_SIZE ? index : 0];
+        size_t size   = (charInfo->width * fdsc->CharHeight + 1) / 2; // add 1 for rounding up
         initCharacterFrame(size);
         return charBitmap_p;
     }
 
-    File file;
-    char filename[128];
     uint32_t glyphID;
-    uint16_t charmap_position;
+    uint32_t charmap_position;
+    zifont_reader_t * reader;
 
-    if(unicode_letter >= 0xF000) {
-        sprintf_P(filename, PSTR("/fontawesome%u.zi"), fdsc->CharHeight);
-        charmap_position = 25 + sizeof(zi_font_header_t);
+    if(source == ZIFONT_SOURCE_ICONS) {
+        reader           = getReader(fdsc->icon_path);
+        charmap_position = fdsc->icon_charmap;
         glyphID          = unicode_letter - 0xf000; // start of fontawesome
     } else {
-        strcpy(filename, (char *)font->user_data);
+        int32_t index = glyphIndex(fdsc, unicode_letter);
+        if(index < 0) return NULL;
+        reader           = getReader((char *)font->user_data);
         charmap_position = fdsc->Startdataaddress;
-        glyphID          = unicode_letter - 0x20; // simple unicode to ascii - space is charNum=0
+        glyphID          = index;
     }
 
-    if(!openFont(file, filename)) return NULL;
+    if(!reader) return NULL;
 
     /* Check Last Glyph in chache is valid and Matches currentGlyphID */
+    lv_zifont_char_t charData;
     if(fdsc->last_glyph_id == glyphID && fdsc->last_glyph_dsc && fdsc->last_glyph_dsc->width > 0) {
         // Serial.print("@");
-        charInfo = fdsc->last_glyph_dsc;
+        charData = *fdsc->last_glyph_dsc;
     } else {
-        Serial.print("%");
         /* Read Character Table */
-        charInfo               = (lv_zifont_char_t *)lv_mem_alloc(sizeof(lv_zifont_char_t));
         uint32_t char_position = glyphID * sizeof(lv_zifont_char_t) + charmap_position;
-        file.seek(char_position, SeekSet);
-        size_t readSize = file.readBytes((char *)charInfo, sizeof(lv_zifont_char_t));
+        size_t readSize        = readFont(reader, char_position, &charData, sizeof(lv_zifont_char_t));
 
         /* Check that we read the correct size */
         if(readSize != sizeof(lv_zifont_char_t)) {
-            file.close();
-            lv_mem_free(charInfo);
             debugPrintln(PSTR("FONT: [ERROR] Wrong number of bytes read from flash"));
             return NULL;
         }
 
         /* Double-check that we got the correct letter */
-        if(charInfo->character != unicode_letter) {
-            file.close();
-            lv_mem_free(charInfo);
+        if(charData.character != unicode_letter) {
             debugPrintln(PSTR("FONT: [ERROR] Incorrect letter read from flash"));
             return NULL;
         }
     }
+    charInfo = &charData;
 
     long datapos = charmap_position + (charInfo->pos[2] << 16) + (charInfo->pos[1] << 8) + charInfo->pos[0];
 
@@ -315,98 +928,38 @@ const uint8_t * lv_font_get_bitmap_fmt_zifont(const lv_font_t * font, uint32_t u
     initCharacterFrame(size);
 
     char data[256];
-    file.seek(datapos + 1, SeekSet); // +1 for skipping bpp byte
-
-    /* Speed optimization, skip BPP check
-    char b[1];
-    file.seek(datapos, SeekSet);
-    file.readBytes(b, 1); // check first byte = bpp
-
-    if((uint8_t)b[0] != 3) {
-        file.close();
-        lv_mem_free(charInfo);
-        snprintf_P(data, sizeof(data), PSTR("FONT: [ERROR] Character %u at %u is not 3bpp encoded but %u"), glyphID,
-                   datapos, b[0]);
-        debugPrintln(data);
-
-        // Serial.printf("  adv_w %u (%u) - bpp %u  -  ", dsc_out->adv_w, charInfo->width, dsc_out->bpp);
-        // Serial.printf("  box_w %u  -  box_h %u   -  ", dsc_out->box_w, dsc_out->box_h);
-        // Serial.printf("  kernL %u  -  kernR %u   \n", charInfo->kerningL, charInfo->kerningR);
-        // Serial.printf("  ofs_x %u - ofs_y %u \n\n", dsc_out->ofs_x, dsc_out->ofs_x);
-
-        return NULL;
-    }
-    */
+    datapos++; // +1 for skipping bpp byte
 
     // uint8_t w          = charInfo->width + charInfo->kerningL + charInfo->kerningR;
-    // char data[256];
+    uint32_t pixels    = charInfo->width * fdsc->CharHeight;
     uint16_t fileindex = 0;
-    uint16_t arrindex  = 0;
+    uint32_t arrindex  = 0;
     int len            = 1;
-    uint8_t i, k, b, repeats, color1, color2;
 
-    // while((fileindex < charInfo->length) && len > 0) { //} && !feof(file)) {
-    while(arrindex < size && len > 0) { // read untill the bitmap is full, no need for datalength
-        if(sizeof(data) < charInfo->length - fileindex) {
-            len = file.readBytes(data, sizeof(data));
+    while(fileindex < charInfo->length && arrindex < pixels && len > 0) { // until the data or the bitmap ends
+        const char * chunk = data;
+        if(reader->mem) {
+            /* Decode straight from the mapped flash */
+            chunk = (const char *)reader->mem + datapos + fileindex;
+            len   = charInfo->length - fileindex;
+            if(datapos + fileindex + len > reader->mem_size) len = reader->mem_size - (datapos + fileindex);
+        } else if(sizeof(data) < charInfo->length - fileindex) {
+            len = readFont(reader, datapos + fileindex, data, sizeof(data));
         } else {
-            len = file.readBytes(data, charInfo->length - fileindex);
+            len = readFont(reader, datapos + fileindex, data, charInfo->length - fileindex);
         }
         fileindex += len;
 
-        for(k = 0; k < len; k++) {
-            b = data[k];
-            // Serial.printf("%d - %d > %x = %x  arrindex:%d\n", fileindex, arrindex, b, ch[0], ftell(file));
-
-            repeats = b & 0b00011111; /* last 5 bits indicate repetition as the same color */
-            switch(b >> 5) {
-                case(0b000):
-                    arrindex += repeats;
-                    break;
-
-                case(0b001):
-                    for(i = 0; i < repeats; i++) {
-                        colorsAdd(charBitmap_p, ColorBlack, arrindex++);
-                    }
-                    break;
-
-                case(0b010):
-                    arrindex += repeats;
-                    colorsAdd(charBitmap_p, ColorBlack, arrindex++);
-                    break;
-
-                case(0b011):
-                    arrindex += repeats;
-                    colorsAdd(charBitmap_p, ColorBlack, arrindex++);
-                    colorsAdd(charBitmap_p, ColorBlack, arrindex++);
-                    break;
-
-                case(0b100):
-                case(0b101):
-                    repeats = (uint8_t)((b & (0b111000)) >> 3); /* 3 bits indicate repetition as the same color */
-                    color1  = (uint8_t)(b & (0b0111));
-                    arrindex += repeats;
-                    colorsAdd(charBitmap_p, color1, arrindex++);
-                    break;
-
-                default:
-                    color1 = (b & 0b111000) >> 3;
-                    color2 = b & 0b000111;
-                    colorsAdd(charBitmap_p, color1, arrindex++);
-                    colorsAdd(charBitmap_p, color2, arrindex++);
-            }
-        }
+        lv_zifont_decode_chunk((const uint8_t *)chunk, len, charBitmap_p, pixels, &arrindex);
     }
 
     // Serial.printf("[OK] Letter %c - %d\n", (char)(uint8_t)unicode_letter, arrindex);
     // printBuffer(charBitmap_p, charInfo->width, fdsc->CharHeight);
 
-    file.close();
+    glyphCacheStats.decode_time += micros() - startMicros;
+    glyphCacheStats.decode_pixels += pixels;
 
-    lv_mem_free(charInfo);
-    charInBuffer = unicode_letter;
-
-    return charBitmap_p;
+    return glyphCacheAdd(font, unicode_letter, charBitmap_p, size);
 }
 
 /**
@@ -420,25 +973,28 @@ const uint8_t * lv_font_get_bitmap_fmt_zifont(const lv_font_t * font, uint32_t u
 bool IRAM_ATTR lv_font_get_glyph_dsc_fmt_zifont(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out,
                                                 uint32_t unicode_letter, uint32_t unicode_letter_next)
 {
-    /* Only ascii characteres supported for now */
+    /* No control characters */
     if(unicode_letter < 0x20) return false;
-    if(unicode_letter > 0xff && unicode_letter < 0xf000) return false;
-    // if(unicode_letter > 0xff) Serial.printf("Char# %u\n", unicode_letter);
+
+    uint8_t source = resolveGlyph(font, unicode_letter);
+    if(source == ZIFONT_SOURCE_NONE) return false;
+    if(source == ZIFONT_SOURCE_FALLBACK) return fallbackGlyphDsc(font, dsc_out, unicode_letter, unicode_letter_next);
 
     // ulong startMillis               = millis();
     lv_font_fmt_zifont_dsc_t * fdsc = (lv_font_fmt_zifont_dsc_t *)font->dsc; /* header data struct */
 
     uint16_t glyphID;
-    File file;
-    uint8_t charmap_position;
+    uint32_t charmap_position;
     uint8_t charwidth;
-    if(unicode_letter >= 0xF000) {
-        charmap_position = 25 + sizeof(zi_font_header_t);
+    if(source == ZIFONT_SOURCE_ICONS) {
+        charmap_position = fdsc->icon_charmap;
         glyphID          = unicode_letter - 0xf000; // start of fontawesome
         charwidth        = 0;
     } else {
+        int32_t index = glyphIndex(fdsc, unicode_letter);
+        if(index < 0) return false;
         charmap_position = fdsc->Startdataaddress; // Descriptionlength + sizeof(lv_font_fmt_zifont_dsc_t);
-        glyphID          = unicode_letter - 0x20;  // simple unicode to ascii - space is charNum=0
+        glyphID          = index;
         // if(glyphID < sizeof(fdsc->ascii_glyph_dsc) / sizeof(lv_zifont_char_t))
         if(glyphID < CHAR_CACHE_SIZE)
             charwidth = fdsc->ascii_glyph_dsc[glyphID].width;
@@ -449,22 +1005,15 @@ bool IRAM_ATTR lv_font_get_glyph_dsc_fmt_zifont(const lv_font_t * font, lv_font_
     // if(charwidth == 0 || glyphID >= sizeof(fdsc->ascii_glyph_dsc) / sizeof(lv_zifont_char_t)) {
     if(charwidth == 0 || glyphID >= CHAR_CACHE_SIZE) {
 
-        /* Open the font for reading */
-        if(unicode_letter >= 0xF000) {
-            char filename[32];
-            sprintf_P(filename, PSTR("/fontawesome%u.zi"), fdsc->CharHeight);
-            if(!openFont(file, filename)) return false;
-        } else {
-            if(!openFont(file, (char *)font->user_data)) return false;
-        }
+        /* Get the open font file */
+        zifont_reader_t * reader = getReader(source == ZIFONT_SOURCE_ICONS ? fdsc->icon_path : (char *)font->user_data);
+        if(!reader) return false;
 
         /* read 10 bytes charmap */
         // lv_zifont_char_t * myCharIndex = (lv_zifont_char_t *)lv_mem_alloc(sizeof(lv_zifont_char_t));
         lv_zifont_char_t myCharIndex;
         uint32_t char_position = glyphID * sizeof(lv_zifont_char_t) + charmap_position;
-        file.seek(char_position, SeekSet);
-        size_t readSize = file.readBytes((char *)&myCharIndex, sizeof(lv_zifont_char_t));
-        file.close();
+        size_t readSize        = readFont(reader, char_position, &myCharIndex, sizeof(lv_zifont_char_t));
 
         /* Check that we read the correct size */
         if(readSize != sizeof(lv_zifont_char_t)) {
@@ -472,23 +1021,18 @@ bool IRAM_ATTR lv_font_get_glyph_dsc_fmt_zifont(const lv_font_t * font, lv_font_
             return false;
         }
 
-        /* Double-check that we got the correct letter */
-        if(fdsc->last_glyph_dsc->character != unicode_letter) {
-            // lv_mem_free(myCharIndex);
-            // return false;
-        }
-
-        if(unicode_letter <= 0xff && glyphID < CHAR_CACHE_SIZE) fdsc->ascii_glyph_dsc[glyphID] = myCharIndex;
-        lastCharInfo = myCharIndex;
+        if(source == ZIFONT_SOURCE_FONT && glyphID < CHAR_CACHE_SIZE) fdsc->ascii_glyph_dsc[glyphID] = myCharIndex;
+        fdsc->last_glyph = myCharIndex;
         // lv_mem_free(myCharIndex);
 
     } else {
-        lastCharInfo = fdsc->ascii_glyph_dsc[glyphID];
+        fdsc->last_glyph = fdsc->ascii_glyph_dsc[glyphID];
     }
 
-    /*cache glyph data*/
-    fdsc->last_glyph_id  = glyphID;
-    fdsc->last_glyph_dsc = &lastCharInfo;
+    /*cache glyph data, per font as the bitmap of another font may be requested in between*/
+    fdsc->last_glyph_id                   = glyphID;
+    fdsc->last_glyph_dsc                  = &fdsc->last_glyph;
+    const lv_zifont_char_t & lastCharInfo = fdsc->last_glyph;
 
     dsc_out->adv_w = lastCharInfo.width; //-myCharIndex->righroverlap)*16; /* 8 bit integer 4 bit fractional*/
     dsc_out->box_w = lastCharInfo.width + lastCharInfo.kerningL + lastCharInfo.kerningR;
@@ -509,28 +1053,100 @@ bool IRAM_ATTR lv_font_get_glyph_dsc_fmt_zifont(const lv_font_t * font, lv_font_
     return true;
 }
 
-void colorsAdd(uint8_t * charBitmap_p, uint8_t color1, uint16_t pos)
+/* Find a glyph of a packed font, in its glyph table in memory or in the file */
+static bool zipackFind(const lv_font_t * font, uint32_t unicode, lv_zipack_glyph_t * glyph)
 {
-    uint16_t map_p = pos >> 1; // devide by 2
-    uint8_t col    = pos % 2;  // remainder
+    lv_font_fmt_zifont_dsc_t * fdsc = (lv_font_fmt_zifont_dsc_t *)font->dsc;
+    if(fdsc->last_packed.unicode == unicode) {
+        *glyph = fdsc->last_packed;
+        return true;
+    }
 
-    if(color1 == ColorBlack) {
-        //  && color1 != ColorWhite) { // Don't check white, as the function is only used for colors
-        if(col == 0) {
-            charBitmap_p[map_p] = 0xf0;
-        } else {
-            charBitmap_p[map_p] |= color1;
-        }
+    zifont_reader_t * reader = NULL;
+    if(!fdsc->glyphs) {
+        reader = getReader((char *)font->user_data);
+        if(!reader) return false;
+    }
+
+    if(!lv_zipack_find(fdsc->glyphs, readFontCb, reader, fdsc->glyph_offset, fdsc->glyph_count, unicode, glyph))
+        return false;
+    fdsc->last_packed = *glyph;
+    return true;
+}
+
+/**
+ * Used as `get_glyph_bitmap` callback for packed fonts.
+ * Uncompressed bitmaps of mapped fonts are returned straight from the flash.
+ * @param font pointer to font
+ * @param unicode_letter an unicode letter which bitmap should be get
+ * @return pointer to the bitmap or NULL if not found
+ */
+const uint8_t * lv_font_get_bitmap_fmt_zipack(const lv_font_t * font, uint32_t unicode_letter)
+{
+    lv_font_fmt_zifont_dsc_t * fdsc = (lv_font_fmt_zifont_dsc_t *)font->dsc;
+    uint8_t source                  = resolveGlyph(font, unicode_letter);
+    if(source == ZIFONT_SOURCE_NONE) return NULL;
+    if(source == ZIFONT_SOURCE_FALLBACK) return fdsc->fallback->get_glyph_bitmap(fdsc->fallback, unicode_letter);
+
+    const uint8_t * cached = glyphCacheFind(font, unicode_letter);
+    if(cached) return cached;
+
+    uint32_t startMicros = micros();
+    lv_zipack_glyph_t glyph;
+    if(!zipackFind(font, unicode_letter, &glyph)) return NULL;
+
+    zifont_reader_t * reader = getReader((char *)font->user_data);
+    if(!reader) return NULL;
+
+    uint32_t pos  = fdsc->bitmap_offset + glyph.offset;
+    uint32_t size = (glyph.box_w * glyph.box_h * fdsc->bpp + 7) / 8;
+    if(reader->mem && !(glyph.flags & LV_ZIPACK_RLE) && pos + size <= reader->mem_size) return reader->mem + pos;
+
+    initCharacterFrame(size);
+    if(!(glyph.flags & LV_ZIPACK_RLE)) {
+        readFont(reader, pos, charBitmap_p, size);
+    } else if(reader->mem) {
+        if(pos + glyph.size <= reader->mem_size)
+            lv_zipack_rle_decode(reader->mem + pos, glyph.size, charBitmap_p, size);
     } else {
-        // Serial.printf("%u color %u\n", pos, color1);
-        if(col == 0) {
-            charBitmap_p[map_p] = color1 << 5;
-        } else {
-            charBitmap_p[map_p] |= color1 << 1;
-        }
+        uint8_t * data = (uint8_t *)malloc(glyph.size);
+        if(!data) return NULL;
+        size_t len = readFont(reader, pos, data, glyph.size);
+        lv_zipack_rle_decode(data, len, charBitmap_p, size);
+        free(data);
     }
 
-    // return 1; // shift 1 position
+    glyphCacheStats.decode_time += micros() - startMicros;
+    return glyphCacheAdd(font, unicode_letter, charBitmap_p, size);
+}
+
+/**
+ * Used as `get_glyph_dsc` callback for packed fonts.
+ * @param font_p pointer to font
+ * @param dsc_out store the result descriptor here
+ * @param letter an UNICODE letter code
+ * @return true: descriptor is successfully loaded into `dsc_out`.
+ *         false: the letter was not found, no data is loaded to `dsc_out`
+ */
+bool lv_font_get_glyph_dsc_fmt_zipack(const lv_font_t * font, lv_font_glyph_dsc_t * dsc_out, uint32_t unicode_letter,
+                                      uint32_t unicode_letter_next)
+{
+    if(unicode_letter < 0x20) return false;
+
+    uint8_t source = resolveGlyph(font, unicode_letter);
+    if(source == ZIFONT_SOURCE_NONE) return false;
+    if(source == ZIFONT_SOURCE_FALLBACK) return fallbackGlyphDsc(font, dsc_out, unicode_letter, unicode_letter_next);
+
+    lv_zipack_glyph_t glyph;
+    if(!zipackFind(font, unicode_letter, &glyph)) return false;
+
+    dsc_out->adv_w = glyph.adv_w;
+    dsc_out->box_w = glyph.box_w;
+    dsc_out->box_h = glyph.box_h;
+    dsc_out->ofs_x = glyph.ofs_x;
+    dsc_out->ofs_y = glyph.ofs_y;
+    dsc_out->bpp   = ((lv_font_fmt_zifont_dsc_t *)font->dsc)->bpp;
+    return true;
 }
 
 /*
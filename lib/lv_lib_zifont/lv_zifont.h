@@ -16,26 +16,17 @@ extern "C" {
 #include <Arduino.h>
 #include <stdint.h>
 #include "lvgl.h"
+#include "lv_zipack.h"
+#include "lv_zifont_codec.h"
 
 /*********************
  *      DEFINES
  *********************/
+#define LV_ZIFONT_RESOLVE_SIZE 32 // codepoints remembered per font with the font of the chain that draws them
 
 /**********************
  *      TYPEDEFS
  **********************/
-typedef uint8_t lv_zifont_char_offset_t[3];
-
-typedef struct
-{
-    uint16_t character;
-    uint8_t width;
-    uint8_t kerningL;
-    uint8_t kerningR;
-    lv_zifont_char_offset_t pos;
-    uint16_t length;
-} lv_zifont_char_t;
-
 typedef struct
 {
     uint8_t Password;
@@ -68,6 +59,12 @@ typedef struct
 } zi_font_header_t;
 
 typedef struct
+{
+    uint16_t unicode;
+    uint8_t source; // font of the fallback chain that has the glyph
+} lv_zifont_resolve_t;
+
+typedef struct _lv_font_fmt_zifont_dsc_t
 {
     uint8_t Codepageid;
     uint8_t CharWidth;
@@ -79,14 +76,54 @@ typedef struct
     uint8_t Fontdataadd8byte;
     uint16_t last_glyph_id;
     lv_zifont_char_t * last_glyph_dsc;
+    lv_zifont_char_t last_glyph;
     lv_zifont_char_t * ascii_glyph_dsc;
+    lv_zifont_range_t * ranges; // sorted on codepoint
+    uint16_t range_count;
+
+    /* Packed fonts only */
+    const lv_zipack_glyph_t * glyphs; // glyph table in ram or mapped flash, NULL to search it in the file
+    uint32_t glyph_count;
+    uint32_t glyph_offset;
+    uint32_t bitmap_offset;
+    uint8_t bpp;
+    uint8_t glyphs_in_ram;
+    lv_zipack_glyph_t last_packed; // last glyph found
+
+    /* Fallback chain for glyphs this font does not have: the icon font, then the fallback font */
+    char * icon_path;           // zi icon font for 0xF000 and up, NULL for none
+    uint32_t icon_charmap;      // charmap position of the icon font, 0 until its header is read
+    const lv_font_t * fallback; // e.g. a built-in font, NULL for none
+    lv_zifont_resolve_t resolved[LV_ZIFONT_RESOLVE_SIZE];
+
+    struct _lv_font_fmt_zifont_dsc_t * next; // list of the loaded fonts
 } lv_font_fmt_zifont_dsc_t;
 
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t decode_time;   // us spent decoding glyphs that were not cached
+    uint32_t decode_pixels; // pixels decoded in that time
+    uint32_t file_opens;    // font files opened
+    uint32_t file_bytes;    // bytes read from the font files
+    uint32_t flash_fonts;   // fonts mapped from the font partition
+    uint32_t used;          // bytes of cached bitmaps
+    uint32_t budget;
+} lv_zifont_cache_stats_t;
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
 int lv_zifont_init(void);
 int lv_zifont_font_init(lv_font_t ** font, const char * font_path, uint16_t size);
+void lv_zifont_font_free(lv_font_t * font);
+uint32_t lv_zifont_font_size(const lv_font_t * font);
+void lv_zifont_set_fallback(lv_font_t * font, const char * icon_path, const lv_font_t * fallback);
+void lv_zifont_cache_flush(const lv_font_t * font);
+void lv_zifont_get_cache_stats(lv_zifont_cache_stats_t * stats);
+int lv_zifont_flash_fonts(void);
 
 /**********************
  *      MACROS
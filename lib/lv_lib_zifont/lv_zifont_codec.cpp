@@ -0,0 +1,310 @@
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdlib.h>
+#include <string.h>
+
+#include "lv_zifont_codec.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define ColorBlack LV_ZIFONT_COLOR_BLACK
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+
+/* Merge one pixel into the zeroed 4bpp bitmap, even pixels are the high nibble */
+static inline void putPixel(uint8_t * bitmap, uint32_t pos, uint8_t color, uint32_t pixels)
+{
+    if(pos < pixels) bitmap[pos >> 1] |= (pos & 1) ? color : color << 4;
+}
+
+/* Ink a run of pixels, whole bytes are set at once and only an odd pixel at either end is merged */
+static inline void putRun(uint8_t * bitmap, uint32_t pos, uint32_t count, uint32_t pixels)
+{
+    if(pos >= pixels) return;
+    if(count > pixels - pos) count = pixels - pos;
+    if(count == 0) return;
+
+    if(pos & 1) {
+        bitmap[pos >> 1] |= ColorBlack;
+        pos++;
+        count--;
+    }
+    memset(bitmap + (pos >> 1), 0xFF, count >> 1);
+    if(count & 1) bitmap[(pos + count) >> 1] |= ColorBlack << 4;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+/**
+ * Collapse the charmap of count entries at file position charmap into ranges of consecutive codepoints,
+ * so any glyph is found with a binary search. Replaces *ranges, returns false when out of memory.
+ */
+bool lv_zifont_build_ranges(lv_zifont_read_cb_t read_cb, void * ctx, uint32_t charmap, uint32_t count,
+                            lv_zifont_range_t ** ranges, uint16_t * range_count)
+{
+    free(*ranges);
+    *ranges      = NULL;
+    *range_count = 0;
+
+    lv_zifont_char_t batch[LV_ZIFONT_RANGE_BATCH];
+    uint16_t capacity = 0;
+    uint32_t index    = 0;
+    bool sorted       = true;
+    if(count > 0xFFFF) count = 0xFFFF;
+
+    while(index < count) {
+        uint32_t len    = count - index < LV_ZIFONT_RANGE_BATCH ? count - index : LV_ZIFONT_RANGE_BATCH;
+        uint32_t pos    = charmap + index * sizeof(lv_zifont_char_t);
+        size_t readSize = read_cb(ctx, pos, batch, len * sizeof(lv_zifont_char_t));
+        len             = readSize / sizeof(lv_zifont_char_t);
+        if(len == 0) break;
+
+        for(uint32_t i = 0; i < len; i++, index++) {
+            uint16_t unicode = batch[i].character;
+            if(unicode < 0x20) continue; // unused entry
+
+            lv_zifont_range_t * last = *range_count ? &(*ranges)[*range_count - 1] : NULL;
+            if(last && unicode == last->first + last->count && index == last->index + last->count) {
+                last->count++;
+                continue;
+            }
+            if(last && unicode < last->first) sorted = false;
+
+            if(*range_count == capacity) {
+                capacity += capacity < 16 ? 16 : capacity;
+                lv_zifont_range_t * grown = (lv_zifont_range_t *)realloc(*ranges, capacity * sizeof(lv_zifont_range_t));
+                if(!grown) {
+                    free(*ranges);
+                    *ranges      = NULL;
+                    *range_count = 0;
+                    return false;
+                }
+                *ranges = grown;
+            }
+            (*ranges)[*range_count].first = unicode;
+            (*ranges)[*range_count].count = 1;
+            (*ranges)[*range_count].index = index;
+            (*range_count)++;
+        }
+    }
+
+    /* The zi charmap is ordered by codepoint, only a hand edited font needs sorting */
+    if(!sorted) {
+        for(uint16_t i = 1; i < *range_count; i++) {
+            lv_zifont_range_t range = (*ranges)[i];
+            uint16_t j              = i;
+            for(; j > 0 && (*ranges)[j - 1].first > range.first; j--) (*ranges)[j] = (*ranges)[j - 1];
+            (*ranges)[j] = range;
+        }
+    }
+    return true;
+}
+
+/* Charmap entry of a codepoint with a binary search of the sorted ranges, or -1 if the font does not have it */
+int32_t lv_zifont_find_range(const lv_zifont_range_t * ranges, uint16_t range_count, uint32_t unicode)
+{
+    int32_t low  = 0;
+    int32_t high = range_count - 1;
+    while(low <= high) {
+        int32_t mid                     = (low + high) / 2;
+        const lv_zifont_range_t * range = &ranges[mid];
+        if(unicode < range->first) {
+            high = mid - 1;
+        } else if(unicode >= (uint32_t)range->first + range->count) {
+            low = mid + 1;
+        } else {
+            return range->index + (unicode - range->first);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Decode a chunk of zi run length data into the zeroed 4bpp bitmap, continuing at pixel *pos_p.
+ * Produces the same bitmap as colorsAdd() per pixel, without the per pixel nibble arithmetic.
+ */
+void lv_zifont_decode_chunk(const uint8_t * data, uint16_t len, uint8_t * bitmap, uint32_t pixels, uint32_t * pos_p)
+{
+    uint32_t pos = *pos_p;
+
+    for(uint16_t k = 0; k < len && pos < pixels; k++) {
+        uint8_t b       = data[k];
+        uint8_t repeats = b & 0b00011111; /* last 5 bits indicate repetition as the same color */
+
+        switch(b >> 5) {
+            case(0b000):
+                pos += repeats;
+                break;
+
+            case(0b001):
+                putRun(bitmap, pos, repeats, pixels);
+                pos += repeats;
+                break;
+
+            case(0b010):
+                pos += repeats;
+                putPixel(bitmap, pos++, ColorBlack, pixels);
+                break;
+
+            case(0b011):
+                pos += repeats;
+                putRun(bitmap, pos, 2, pixels);
+                pos += 2;
+                break;
+
+            case(0b100):
+            case(0b101):
+                pos += (b >> 3) & 0b111; /* 3 bits indicate repetition as the same color */
+                putPixel(bitmap, pos++, (b & 0b111) << 1, pixels);
+                break;
+
+            default:
+                putPixel(bitmap, pos++, ((b >> 3) & 0b111) << 1, pixels);
+                putPixel(bitmap, pos++, (b & 0b111) << 1, pixels);
+        }
+    }
+
+    *pos_p = pos;
+}
+
+/* The original per pixel decoder, the native tests check lv_zifont_decode_chunk against it */
+void lv_zifont_decode_chunk_reference(const uint8_t * data, uint16_t len, uint8_t * bitmap, uint32_t pixels,
+                                      uint32_t * pos_p)
+{
+    uint32_t arrindex = *pos_p;
+    uint8_t i, b, repeats, color1, color2;
+
+    for(uint16_t k = 0; k < len && arrindex < pixels; k++) {
+        b       = data[k];
+        repeats = b & 0b00011111;
+        switch(b >> 5) {
+            case(0b000):
+                arrindex += repeats;
+                break;
+
+            case(0b001):
+                for(i = 0; i < repeats; i++) {
+                    if(arrindex < pixels) colorsAdd(bitmap, ColorBlack, arrindex);
+                    arrindex++;
+                }
+                break;
+
+            case(0b010):
+                arrindex += repeats;
+                if(arrindex < pixels) colorsAdd(bitmap, ColorBlack, arrindex);
+                arrindex++;
+                break;
+
+            case(0b011):
+                arrindex += repeats;
+                if(arrindex < pixels) colorsAdd(bitmap, ColorBlack, arrindex);
+                arrindex++;
+                if(arrindex < pixels) colorsAdd(bitmap, ColorBlack, arrindex);
+                arrindex++;
+                break;
+
+            case(0b100):
+            case(0b101):
+                repeats = (uint8_t)((b & (0b111000)) >> 3);
+                color1  = (uint8_t)(b & (0b0111));
+                arrindex += repeats;
+                if(arrindex < pixels) colorsAdd(bitmap, color1, arrindex);
+                arrindex++;
+                break;
+
+            default:
+                color1 = (b & 0b111000) >> 3;
+                color2 = b & 0b000111;
+                if(arrindex < pixels) colorsAdd(bitmap, color1, arrindex);
+                arrindex++;
+                if(arrindex < pixels) colorsAdd(bitmap, color2, arrindex);
+                arrindex++;
+        }
+    }
+
+    *pos_p = arrindex;
+}
+
+void colorsAdd(uint8_t * charBitmap_p, uint8_t color1, uint16_t pos)
+{
+    uint16_t map_p = pos >> 1; // devide by 2
+    uint8_t col    = pos % 2;  // remainder
+
+    if(color1 == ColorBlack) {
+        //  && color1 != ColorWhite) { // Don't check white, as the function is only used for colors
+        if(col == 0) {
+            charBitmap_p[map_p] = 0xf0;
+        } else {
+            charBitmap_p[map_p] |= color1;
+        }
+    } else {
+        // Serial.printf("%u color %u\n", pos, color1);
+        if(col == 0) {
+            charBitmap_p[map_p] = color1 << 5;
+        } else {
+            charBitmap_p[map_p] |= color1 << 1;
+        }
+    }
+
+    // return 1; // shift 1 position
+}
+
+/**
+ * Find a glyph of a packed font with a binary search of its glyph table.
+ * The table is used in place when glyphs is not NULL, e.g. in ram or mapped flash, else it is read at glyph_offset.
+ */
+bool lv_zipack_find(const lv_zipack_glyph_t * glyphs, lv_zifont_read_cb_t read_cb, void * ctx, uint32_t glyph_offset,
+                    uint32_t glyph_count, uint32_t unicode, lv_zipack_glyph_t * glyph)
+{
+    int32_t low  = 0;
+    int32_t high = glyph_count - 1;
+    while(low <= high) {
+        int32_t mid = (low + high) / 2;
+        if(glyphs) {
+            memcpy(glyph, &glyphs[mid], sizeof(lv_zipack_glyph_t));
+        } else if(read_cb(ctx, glyph_offset + mid * sizeof(lv_zipack_glyph_t), glyph, sizeof(lv_zipack_glyph_t)) !=
+                  sizeof(lv_zipack_glyph_t)) {
+            return false;
+        }
+
+        if(unicode < glyph->unicode) {
+            high = mid - 1;
+        } else if(unicode > glyph->unicode) {
+            low = mid + 1;
+        } else {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Expand a run length encoded bitmap of len bytes into at most size bytes, returns the bytes written */
+uint32_t lv_zipack_rle_decode(const uint8_t * src, uint32_t len, uint8_t * dst, uint32_t size)
+{
+    const uint8_t * end = src + len;
+    uint32_t pos        = 0;
+    while(src < end && pos < size) {
+        uint8_t c = *src++;
+        uint32_t n;
+        if(c < 128) {
+            n = c + 1;
+            if(n > size - pos) n = size - pos;
+            if(n > (uint32_t)(end - src)) n = end - src;
+            memcpy(dst + pos, src, n);
+            src += n;
+        } else {
+            if(src >= end) break;
+            n = c - 126;
+            if(n > size - pos) n = size - pos;
+            memset(dst + pos, *src++, n);
+        }
+        pos += n;
+    }
+    return pos;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file lv_zifont_codec.h
+ * Charmap index and glyph decoder of zi fonts and the glyph lookup of packed fonts,
+ * without lvgl, Arduino or a file system.
+ * Shared between the device, tools/zipack.cpp and the native tests.
+ */
+
+#ifndef LV_ZIFONT_CODEC_H
+#define LV_ZIFONT_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "lv_zipack.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define LV_ZIFONT_RANGE_BATCH 32 // charmap entries read at once while indexing a font
+#define LV_ZIFONT_COLOR_BLACK 0x0f
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef uint8_t lv_zifont_char_offset_t[3];
+
+/* Charmap entry of a zi font, 10 bytes in the file */
+typedef struct
+{
+    uint16_t character;
+    uint8_t width;
+    uint8_t kerningL;
+    uint8_t kerningR;
+    lv_zifont_char_offset_t pos;
+    uint16_t length;
+} lv_zifont_char_t;
+
+/* Consecutive codepoints with consecutive charmap entries */
+typedef struct
+{
+    uint16_t first; // first codepoint
+    uint16_t count;
+    uint16_t index; // charmap entry of the first codepoint
+} lv_zifont_range_t;
+
+/* Read len bytes at file position pos into dst, returns the bytes read */
+typedef size_t (*lv_zifont_read_cb_t)(void * ctx, uint32_t pos, void * dst, size_t len);
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+bool lv_zifont_build_ranges(lv_zifont_read_cb_t read_cb, void * ctx, uint32_t charmap, uint32_t count,
+                            lv_zifont_range_t ** ranges, uint16_t * range_count);
+int32_t lv_zifont_find_range(const lv_zifont_range_t * ranges, uint16_t range_count, uint32_t unicode);
+void lv_zifont_decode_chunk(const uint8_t * data, uint16_t len, uint8_t * bitmap, uint32_t pixels, uint32_t * pos);
+void lv_zifont_decode_chunk_reference(const uint8_t * data, uint16_t len, uint8_t * bitmap, uint32_t pixels,
+                                      uint32_t * pos);
+void colorsAdd(uint8_t * charBitmap_p, uint8_t color1, uint16_t pos);
+bool lv_zipack_find(const lv_zipack_glyph_t * glyphs, lv_zifont_read_cb_t read_cb, void * ctx, uint32_t glyph_offset,
+                    uint32_t glyph_count, uint32_t unicode, lv_zipack_glyph_t * glyph);
+uint32_t lv_zipack_rle_decode(const uint8_t * src, uint32_t len, uint8_t * dst, uint32_t size);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /*LV_ZIFONT_CODEC_H*/
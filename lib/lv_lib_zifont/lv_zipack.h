@@ -0,0 +1,70 @@
+/**
+ * @file lv_zipack.h
+ * Packed font format, written by tools/zipack.cpp and read by lv_zifont_font_init.
+ * Only uses fixed size types, so it is shared between the device and the host tool.
+ */
+
+#ifndef LV_ZIPACK_H
+#define LV_ZIPACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+#define LV_ZIPACK_MAGIC 0x4B50495A // "ZIPK"
+#define LV_ZIPACK_VERSION 1
+
+/* Glyph flags */
+#define LV_ZIPACK_RLE 0x01 // bitmap is byte run length encoded
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/* The file starts with the header, followed by glyph_count glyphs sorted on unicode and the bitmaps.
+ * Bitmaps are stored in the LVGL glyph layout: box_w * box_h pixels of bpp bits, MSB first,
+ * rows are not padded. All values are little endian. */
+typedef struct
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t bpp; // 1, 2 or 4
+    uint8_t line_height;
+    uint8_t base_line;
+    uint32_t glyph_count;
+    uint32_t glyph_offset;  // file position of the glyph table
+    uint32_t bitmap_offset; // file position of the first bitmap
+} lv_zipack_header_t;
+
+typedef struct
+{
+    uint32_t unicode;
+    uint32_t offset; // from bitmap_offset
+    uint16_t size;   // bytes in the file
+    uint8_t adv_w;
+    uint8_t box_w;
+    uint8_t box_h;
+    int8_t ofs_x;
+    int8_t ofs_y;
+    uint8_t flags;
+} lv_zipack_glyph_t;
+
+/* Run length encoding of the compressed bitmaps, a control byte c is followed by
+ *   c < 128:  c + 1 literal bytes
+ *   c >= 128: one byte repeated c - 126 times */
+#define LV_ZIPACK_RLE_LITERAL_MAX 128
+#define LV_ZIPACK_RLE_REPEAT_MAX 129
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /*LV_ZIPACK_H*/
@@ -9,6 +9,7 @@
 #include "lv_conf.h"
 #include "lv_theme_hasp.h"
 #include "lv_objx/lv_roller.h"
+#include "lv_misc/lv_gc.h"
 
 #if HASP_USE_QRCODE != 0
 #include "lv_qrcode.h"
@@ -31,6 +32,10 @@
 #include "hasp_wifi.h"
 #include "hasp_gui.h"
 #include "hasp_tft.h"
+#include "hasp_font.h"
+#include "hasp_anim.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
 #include "hasp.h"
 
 //#if LV_USE_HASP
@@ -179,6 +184,14 @@ bool FindIdFromObj(lv_obj_t * obj, uint8_t * pageid, lv_obj_user_data_t * objid)
     return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Park the animations that were started on hidden pages since the last page change */
+void haspPauseHidden(void)
+{
+    if(current_page < sizeof pages / sizeof *pages)
+        animPauseHidden(pages, sizeof pages / sizeof *pages, pages[current_page]);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void haspGetAttr(String hmiAttribute)
 { // Get the value of a Nextion component attribute
@@ -362,7 +375,7 @@ void haspSetLabelText(lv_obj_t * obj, const char * value)
 
         if(check_obj_type(list.type[0], LV_HASP_LABEL)) {
             debugPrintln(String(F("HASP: Setting value to ")) + String(value));
-            lv_label_set_text(label, value);
+            textSetLabel(label, value);
         }
 
     } else {
@@ -537,7 +550,7 @@ void haspSetObjAttribute(lv_obj_t * obj, String strAttr, String strPayload)
                         haspSetLabelText(obj, strPayload.c_str());
                         return;
                     } else if(check_obj_type(list.type[0], LV_HASP_LABEL)) {
-                        lv_label_set_text(obj, strPayload.c_str());
+                        textSetLabel(obj, strPayload.c_str());
                         return;
                     } else if(check_obj_type(list.type[0], LV_HASP_CHECKBOX)) {
                         lv_cb_set_text(obj, strPayload.c_str());
@@ -634,9 +647,10 @@ void haspProcessAttribute(uint8_t pageid, uint8_t objid, String strAttr, String
 {
     lv_obj_t * obj = FindObjFromId((uint8_t)pageid, (uint8_t)objid);
     if(obj) {
-        if(strPayload != "")
+        if(strPayload != "") {
             haspSetObjAttribute(obj, strAttr, strPayload);
-        else {
+            if(pageid != current_page) guiPageCacheInvalidate(pageid);
+        } else {
             /* publish the change */
             std::string strValue = "";
             if(haspGetObjAttribute(obj, strAttr, strValue)) {
@@ -705,6 +719,7 @@ void haspDisconnect()
     lv_obj_set_click(lv_disp_get_layer_sys(NULL), true);
     lv_obj_set_event_cb(lv_disp_get_layer_sys(NULL), NULL);
     lv_obj_set_user_data(lv_disp_get_layer_sys(NULL), 255);
+    guiPageCacheInvalidate(255); // the system layer is shown on all pages
     /*
         lv_obj_t * obj = lv_obj_get_child(lv_disp_get_layer_sys(NULL), NULL);
         lv_obj_set_hidden(obj, false);
@@ -718,6 +733,7 @@ void haspReconnect()
     lv_obj_set_style(lv_disp_get_layer_sys(NULL), &lv_style_transp);
     lv_obj_set_click(lv_disp_get_layer_sys(NULL), false);
     lv_obj_set_event_cb(lv_disp_get_layer_sys(NULL), btn_event_handler);
+    guiPageCacheInvalidate(255); // the system layer is shown on all pages
     /*
         lv_obj_t * obj = lv_obj_get_child(lv_disp_get_layer_sys(NULL), NULL);
         lv_obj_set_hidden(obj, true);
@@ -747,6 +763,9 @@ void haspDisplayAP(const char * ssid, const char * pass)
     for(uint8_t i = 0; i < (sizeof pages / sizeof *pages); i++) {
         lv_obj_clean(pages[i]);
     }
+    fontReleaseUnused();
+    animDropScreen(NULL); // drop parked animations of deleted objects
+    guiPageCacheInvalidate(255);
 
 #if HASP_USE_QRCODE != 0
     lv_obj_t * qr = lv_qrcode_create(pages[0], 120, LV_COLOR_BLACK, LV_COLOR_WHITE);
@@ -912,39 +931,11 @@ void haspFirstSetup(void)
     lv_kb_set_cursor_manage(oneline_ta, true); /* Automatically show/hide cursors on text areas */
 }
 
-/**
- * Create a demo application
- */
-void haspSetup(JsonObject settings)
+/* Initialize one of the built-in themes, NULL if it is not compiled in */
+lv_theme_t * haspThemeInit(uint8_t themeid)
 {
-    haspSetConfig(settings);
-
-    /*
-    #ifdef LV_HASP_HOR_RES_MAX
-        lv_coord_t hres = LV_HASP_HOR_RES_MAX;
-    #else
-        lv_coord_t hres = lv_disp_get_hor_res(NULL);
-    #endif
-
-    #ifdef LV_HASP_VER_RES_MAX
-        lv_coord_t vres = LV_HASP_VER_RES_MAX;
-    #else
-        lv_coord_t vres = lv_disp_get_ver_res(NULL);
-    #endif
-    */
-
-    // static lv_font_t *
-    //    my_font = (lv_font_t *)lv_mem_alloc(sizeof(lv_font_t));
-
-    lv_zifont_init();
-
-    if(lv_zifont_font_init(&defaultFont, haspZiFontPath, 24) != 0) {
-        errorPrintln(String(F("HASP: %sFailed to set the custom font to ")) + String(haspZiFontPath));
-        defaultFont = NULL; // Use default font
-    }
-
-    lv_theme_t * th;
-    switch(haspThemeId) {
+    lv_theme_t * th = NULL;
+    switch(themeid) {
 #if LV_USE_THEME_ALIEN == 1
         case 1:
             th = lv_theme_alien_init(haspThemeHue, defaultFont);
@@ -992,10 +983,45 @@ void haspSetup(JsonObject settings)
             th = lv_theme_hasp_init(512, defaultFont);
 #endif
             break;
+    }
+    return th;
+}
 
-        default:
-            th = lv_theme_hasp_init(512, defaultFont);
-            debugPrintln(F("HASP: Unknown theme selected"));
+/**
+ * Create a demo application
+ */
+void haspSetup(JsonObject settings)
+{
+    haspSetConfig(settings);
+
+    /*
+    #ifdef LV_HASP_HOR_RES_MAX
+        lv_coord_t hres = LV_HASP_HOR_RES_MAX;
+    #else
+        lv_coord_t hres = lv_disp_get_hor_res(NULL);
+    #endif
+
+    #ifdef LV_HASP_VER_RES_MAX
+        lv_coord_t vres = LV_HASP_VER_RES_MAX;
+    #else
+        lv_coord_t vres = lv_disp_get_ver_res(NULL);
+    #endif
+    */
+
+    // static lv_font_t *
+    //    my_font = (lv_font_t *)lv_mem_alloc(sizeof(lv_font_t));
+
+    lv_zifont_init();
+
+    if(lv_zifont_font_init(&defaultFont, haspZiFontPath, 24) != 0) {
+        errorPrintln(String(F("HASP: %sFailed to set the custom font to ")) + String(haspZiFontPath));
+        defaultFont = NULL; // Use default font
+    }
+
+    lv_theme_t * th = haspThemeInit(haspThemeId);
+    if(!th) {
+        th = lv_theme_hasp_init(512, defaultFont);
+        debugPrintln(F("HASP: Unknown theme selected"));
     }
 
     if(th) {
@@ -1050,6 +1076,8 @@ void haspSetup(JsonObject settings)
         lv_obj_set_size(obj, 80, 80);
         lv_obj_set_pos(obj, lv_disp_get_hor_res(NULL) / 2 - 40, lv_disp_get_ver_res(NULL) / 2 - 40 - 20);
     */
+    animSetup();
+
     haspDisconnect();
     haspLoadPage(haspPagesPath);
     haspSetPage(haspStartPage);
@@ -1361,6 +1389,9 @@ void haspClearPage(uint16_t pageid)
     } else {
         debugPrintln(String(F("HASP: Clearing page ")) + String(pageid));
         lv_obj_clean(pages[pageid]);
+        fontReleaseUnused();
+        animDropScreen(page); // drop parked animations of deleted objects
+        guiPageCacheInvalidate(pageid);
     }
 }
 
@@ -1378,8 +1409,13 @@ void haspSetPage(uint16_t pageid)
         errorPrintln(F("HASP: %sCannot change to a layer"));
     } else {
         debugPrintln(String(F("HASP: Changing page to ")) + String(pageid));
+        guiPageCacheShow(pageid); // show the last rendered pixels right away
         lv_scr_load(page);
         current_page = pageid;
+
+        /* Only animate objects on the visible page */
+        animResumeScreen(page);
+        animPauseHidden(pages, sizeof pages / sizeof *pages, page);
     }
 }
 
@@ -1398,6 +1434,7 @@ void haspNewObject(const JsonObject & config)
     }
     /* save the current pageid */
     current_page = pageid;
+    guiPageCacheInvalidate(pageid);
 
     /* Validate type */
     if(config[F("objid")].isNull()) return; // comments
@@ -1451,6 +1488,7 @@ void haspNewObject(const JsonObject & config)
             lv_label_set_text(label, config[F("txt")].as<String>().c_str());
             lv_obj_set_opa_scale_enable(label, true);
             lv_obj_set_opa_scale(label, LV_OPA_COVER);
+            tileAttach(label);
             //}
             // lv_obj_set_event_cb(obj, btn_event_handler);
             break;
@@ -1463,6 +1501,7 @@ void haspNewObject(const JsonObject & config)
         }
         case LV_HASP_LABEL: {
             obj = lv_label_create(parent_obj, NULL);
+            tileAttach(obj);
             if(config[F("txt")]) {
                 lv_label_set_text(obj, config[F("txt")].as<String>().c_str());
             }
@@ -1590,6 +1629,24 @@ void haspNewObject(const JsonObject & config)
         return;
     }
 
+    /* Font by name and size, loaded on first use and shared by all objects using it */
+    if(!config[F("font")].isNull() && (objid == LV_HASP_LABEL || objid == LV_HASP_BUTTON)) {
+        String name  = config[F("font")].as<String>();
+        uint8_t size = config[F("fontsize")].as<uint8_t>();
+        if(objid == LV_HASP_BUTTON && !label->style_p) {
+            /* The label inherits from the button, so it keeps following the button states */
+            for(uint8_t type = LV_BTN_STYLE_REL; type <= LV_BTN_STYLE_INA; type++) {
+                const lv_style_t * base  = lv_btn_get_style(obj, (lv_btn_style_t)type);
+                const lv_style_t * style = fontGetStyle(name.c_str(), size, base);
+                if(style) lv_btn_set_style(obj, (lv_btn_style_t)type, style);
+            }
+        } else {
+            lv_obj_t * text          = objid == LV_HASP_BUTTON ? label : obj;
+            const lv_style_t * style = fontGetStyle(name.c_str(), size, lv_obj_get_style(text));
+            if(style) lv_label_set_style(text, LV_LABEL_STYLE_MAIN, style);
+        }
+    }
+
     if(!config[F("opacity")].isNull()) {
         uint8_t opacity = config[F("opacity")].as<uint8_t>();
         lv_obj_set_opa_scale_enable(obj, opacity < 255);
@@ -1658,6 +1715,7 @@ void haspLoadPage(String pages)
         haspNewObject(config.as<JsonObject>());
     }
     current_page = savedPage;
+    haspPauseHidden(); // objects on other pages may have started animations
 
     sprintf_P(msg, PSTR("HASP: File %s loaded"), pages.c_str());
     debugPrintln(msg);
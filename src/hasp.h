@@ -70,12 +70,14 @@ enum lv_hasp_obj_type_t {
  * Create a hasp application
  */
 void haspSetup(JsonObject settings);
+lv_theme_t * haspThemeInit(uint8_t themeid);
 void haspLoop(void);
 void haspFirstSetup(void);
 
 void haspSetPage(uint16_t id);
 uint16_t haspGetPage();
 void haspClearPage(uint16_t pageid);
+void haspPauseHidden(void);
 void haspSetNodename(String name);
 String haspGetNodename();
 String haspGetVersion();
@@ -0,0 +1,162 @@
+#include "lvgl.h"
+#include "lv_misc/lv_gc.h"
+
+#include "hasp_anim.h"
+
+/**
+ * Animations of objects on hidden pages are taken off the lvgl animation list, so lv_anim_task only
+ * walks the animations of the visible page. They are put back fast-forwarded when their page is shown.
+ */
+
+typedef struct
+{
+    lv_anim_t anim;     // copy of the animation taken off the lvgl animation list
+    lv_obj_t * screen;  // page of the animated object, looked up when the animation is parked
+    uint32_t parked;    // tick when the animation was parked
+} anim_parked_t;
+
+static lv_ll_t animParked;
+
+/* The page of an animated object, NULL if it is not on one of the screens */
+static lv_obj_t * animGetScreen(void * var, lv_obj_t * const * screens, uint8_t count)
+{
+    lv_obj_t * screen = lv_obj_get_screen((lv_obj_t *)var);
+    for(uint8_t i = 0; i < count; i++) {
+        if(screens[i] == screen) return screen;
+    }
+    return NULL;
+}
+
+/* Check if lvgl already runs an animation of var with exec_cb, e.g. one created while the page was hidden */
+static bool animRunning(const void * var, lv_anim_exec_xcb_t exec_cb)
+{
+    lv_anim_t * anim = (lv_anim_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_anim_ll));
+    while(anim) {
+        if(anim->var == var && anim->exec_cb == exec_cb) return true;
+        anim = (lv_anim_t *)lv_ll_get_next(&LV_GC_ROOT(_lv_anim_ll), anim);
+    }
+    return false;
+}
+
+void animSetup(void)
+{
+    lv_ll_init(&animParked, sizeof(anim_parked_t));
+}
+
+/**
+ * Advance an animation by elapsed ms the way lv_anim_task would, including the pauses and the playback.
+ * Repeating animations keep their phase, the others stop at their end and are finished by lvgl on the next tick.
+ */
+void animFastForward(lv_anim_t * a, uint32_t elapsed)
+{
+    if(a->time == 0) return;
+
+    if(a->repeat) {
+        uint32_t period = (uint32_t)a->time + a->repeat_pause;
+        if(a->playback) period += (uint32_t)a->time + a->playback_pause;
+        elapsed %= period;
+    }
+
+    while(elapsed > 0) {
+        int32_t left = (int32_t)a->time - a->act_time;
+        if(left < 0) left = 0;
+        if((uint32_t)left > elapsed) {
+            a->act_time += elapsed;
+            return;
+        }
+        elapsed -= left;
+        a->act_time = a->time;
+
+        /* One shot animation, or the end of its playback */
+        if(!a->repeat && (!a->playback || a->playback_now)) return;
+
+        /* Restart like the ready handler of lvgl */
+        a->act_time = -(int32_t)a->repeat_pause;
+        if(a->playback) {
+            if(!a->playback_now) a->act_time = -(int32_t)a->playback_pause;
+            a->playback_now = !a->playback_now;
+
+            int32_t tmp = a->start;
+            a->start    = a->end;
+            a->end      = tmp;
+        }
+    }
+}
+
+/**
+ * Take the animations of objects on the screens other than active off the lvgl animation list.
+ * Animations of objects on other screens, e.g. the layers, keep running.
+ */
+void animPauseHidden(lv_obj_t * const * screens, uint8_t count, lv_obj_t * active)
+{
+    lv_anim_t * anim = (lv_anim_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_anim_ll));
+    while(anim) {
+        lv_anim_t * next = (lv_anim_t *)lv_ll_get_next(&LV_GC_ROOT(_lv_anim_ll), anim);
+
+        /* Animations without exec_cb are not unique per object, lv_anim_del would delete them all */
+        lv_obj_t * screen = anim->exec_cb ? animGetScreen(anim->var, screens, count) : NULL;
+        if(screen && screen != active) {
+            anim_parked_t * parked = (anim_parked_t *)lv_ll_ins_tail(&animParked);
+            if(parked) {
+                parked->anim   = *anim;
+                parked->screen = screen;
+                parked->parked = lv_tick_get();
+
+                /* Also flags the list as changed for lv_anim_task, next is a different animation */
+                lv_anim_del(anim->var, anim->exec_cb);
+            }
+        }
+        anim = next;
+    }
+}
+
+/**
+ * Put the parked animations of a screen back on the lvgl animation list, fast-forwarded by the time
+ * they were parked. Animations replaced by a newer one of the same object and property are dropped.
+ */
+void animResumeScreen(lv_obj_t * screen)
+{
+    anim_parked_t * parked = (anim_parked_t *)lv_ll_get_head(&animParked);
+    while(parked) {
+        anim_parked_t * next = (anim_parked_t *)lv_ll_get_next(&animParked, parked);
+
+        if(parked->screen == screen) {
+            if(!animRunning(parked->anim.var, parked->anim.exec_cb)) {
+                lv_anim_t a = parked->anim;
+                animFastForward(&a, lv_tick_elaps(parked->parked));
+                uint8_t playback_now = a.playback_now;
+
+                /* lv_anim_create resets the playback state and inserts the animation at the head */
+                lv_anim_create(&a);
+                lv_anim_t * anim = (lv_anim_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_anim_ll));
+                if(anim && anim->var == a.var && anim->exec_cb == a.exec_cb) {
+                    anim->act_time     = a.act_time;
+                    anim->playback_now = playback_now;
+                    if(anim->act_time >= 0 && anim->path_cb) anim->exec_cb(anim->var, anim->path_cb(anim));
+                }
+            }
+            lv_ll_remove(&animParked, parked);
+            lv_mem_free(parked);
+        }
+        parked = next;
+    }
+}
+
+/* Drop the parked animations of a screen whose objects are deleted, NULL drops all */
+void animDropScreen(lv_obj_t * screen)
+{
+    anim_parked_t * parked = (anim_parked_t *)lv_ll_get_head(&animParked);
+    while(parked) {
+        anim_parked_t * next = (anim_parked_t *)lv_ll_get_next(&animParked, parked);
+        if(!screen || parked->screen == screen) {
+            lv_ll_remove(&animParked, parked);
+            lv_mem_free(parked);
+        }
+        parked = next;
+    }
+}
+
+uint16_t animGetParkedCount(void)
+{
+    return lv_ll_get_len(&animParked);
+}
@@ -0,0 +1,13 @@
+#ifndef HASP_ANIM_H
+#define HASP_ANIM_H
+
+#include "lvgl.h"
+
+void animSetup(void);
+void animPauseHidden(lv_obj_t * const * screens, uint8_t count, lv_obj_t * active);
+void animResumeScreen(lv_obj_t * screen);
+void animDropScreen(lv_obj_t * screen);
+void animFastForward(lv_anim_t * a, uint32_t elapsed);
+uint16_t animGetParkedCount(void);
+
+#endif
@@ -0,0 +1,408 @@
+#include "Arduino.h"
+#include "lvgl.h"
+
+#include "hasp_conf.h"
+#include "hasp_log.h"
+#include "hasp_debug.h"
+#include "hasp_gui.h"
+#include "hasp_mqtt.h"
+#include "hasp_bench.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
+#include "hasp.h"
+
+#if HASP_USE_SPIFFS
+#if defined(ARDUINO_ARCH_ESP32)
+#include "SPIFFS.h"
+#endif
+#include <FS.h> // Include the SPIFFS library
+#endif
+
+#define BENCH_THEMES 9 // theme ids 0..8 of haspThemeInit
+#define BENCH_GOLDEN_FILE "/bench.crc"
+#define BENCH_CLOCK_TICKS 60 // seconds rendered by the clock benchmark
+#define BENCH_TEXT_FRAMES 20  // relayouts and redraws of the text benchmark
+
+/* Every object type of lv_hasp_obj_type_t, in the order of the reports */
+static const uint8_t benchTypes[] PROGMEM = {
+    LV_HASP_BUTTON, LV_HASP_CHECKBOX, LV_HASP_LABEL, LV_HASP_CPICKER, LV_HASP_PRELOADER,
+    LV_HASP_ARC,    LV_HASP_SLIDER,   LV_HASP_GAUGE, LV_HASP_BAR,     LV_HASP_LMETER,
+    LV_HASP_SWITCH, LV_HASP_LED,      LV_HASP_DDLIST, LV_HASP_ROLLER, LV_HASP_CONTAINER,
+};
+#define BENCH_TYPES sizeof(benchTypes)
+
+static bool benchActive = false;
+static uint32_t benchCrc; // crc32 of the pixels flushed in the current frame
+static uint32_t benchPixels;
+
+static uint32_t benchCrcUpdate(uint32_t crc, const uint8_t * data, size_t len)
+{
+    while(len--) {
+        crc ^= *data++;
+        for(uint8_t i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc;
+}
+
+/* Called for every flushed area, hashes the rendered pixels while a benchmark is running */
+void benchFlush(const lv_area_t * area, const lv_color_t * color_p, lv_coord_t stride)
+{
+    if(!benchActive) return;
+
+    lv_coord_t w = area->x2 - area->x1 + 1;
+    lv_coord_t h = area->y2 - area->y1 + 1;
+
+    for(lv_coord_t y = 0; y < h; y++) {
+        benchCrc = benchCrcUpdate(benchCrc, (const uint8_t *)color_p, w * sizeof(lv_color_t));
+        color_p += stride;
+    }
+    benchPixels += w * h;
+}
+
+/* Create the object like a jsonl line with only the objid would, with a fixed size where it has none */
+static lv_obj_t * benchCreate(lv_obj_t * parent, uint8_t objid)
+{
+    lv_obj_t * obj = NULL;
+
+    switch(objid) {
+        case LV_HASP_BUTTON:
+            obj = lv_btn_create(parent, NULL);
+            lv_label_set_text(lv_label_create(obj, NULL), "Button");
+            break;
+        case LV_HASP_CHECKBOX:
+            obj = lv_cb_create(parent, NULL);
+            lv_cb_set_text(obj, "Checkbox");
+            lv_cb_set_checked(obj, true);
+            break;
+        case LV_HASP_LABEL:
+            obj = lv_label_create(parent, NULL);
+            lv_label_set_text(obj, "Label");
+            break;
+        case LV_HASP_CPICKER:
+            obj = lv_cpicker_create(parent, NULL);
+            lv_obj_set_size(obj, 120, 120);
+            break;
+        case LV_HASP_PRELOADER:
+            obj = lv_preload_create(parent, NULL);
+            lv_obj_set_size(obj, 80, 80);
+            break;
+        case LV_HASP_ARC:
+            obj = lv_arc_create(parent, NULL);
+            lv_obj_set_size(obj, 120, 120);
+            break;
+        case LV_HASP_SLIDER:
+            obj = lv_slider_create(parent, NULL);
+            lv_slider_set_value(obj, 50, LV_ANIM_OFF);
+            break;
+        case LV_HASP_GAUGE:
+            obj = lv_gauge_create(parent, NULL);
+            lv_obj_set_size(obj, 120, 120);
+            lv_gauge_set_value(obj, 0, 50);
+            break;
+        case LV_HASP_BAR:
+            obj = lv_bar_create(parent, NULL);
+            lv_bar_set_value(obj, 50, LV_ANIM_OFF);
+            break;
+        case LV_HASP_LMETER:
+            obj = lv_lmeter_create(parent, NULL);
+            lv_obj_set_size(obj, 120, 120);
+            lv_lmeter_set_value(obj, 50);
+            break;
+        case LV_HASP_SWITCH:
+            obj = lv_sw_create(parent, NULL);
+            lv_sw_on(obj, LV_ANIM_OFF);
+            break;
+        case LV_HASP_LED:
+            obj = lv_led_create(parent, NULL);
+            lv_led_on(obj);
+            break;
+        case LV_HASP_DDLIST:
+            obj = lv_ddlist_create(parent, NULL);
+            lv_ddlist_set_options(obj, "Option 1\nOption 2\nOption 3");
+            break;
+        case LV_HASP_ROLLER:
+            obj = lv_roller_create(parent, NULL);
+            lv_roller_set_options(obj, "Option 1\nOption 2\nOption 3", LV_ROLLER_MODE_NORMAL);
+            break;
+        case LV_HASP_CONTAINER:
+            obj = lv_cont_create(parent, NULL);
+            lv_obj_set_size(obj, 120, 80);
+            break;
+    }
+
+    if(obj) lv_obj_align(obj, NULL, LV_ALIGN_CENTER, 0, 0);
+    return obj;
+}
+
+#if HASP_USE_GLYPH_TILES > 0
+/* Tick a clock label through a minute and return the render time, the pixel crc of all frames is in benchCrc */
+static uint32_t benchClockRun(lv_obj_t * label, lv_disp_t * disp)
+{
+    uint32_t elapsed = 0;
+    benchCrc         = 0xFFFFFFFF;
+    benchPixels      = 0;
+
+    for(uint8_t s = 0; s < BENCH_CLOCK_TICKS; s++) {
+        char text[16];
+        snprintf_P(text, sizeof(text), PSTR("12:34:%02u"), s);
+        lv_label_set_text(label, text);
+
+        uint32_t start = micros();
+        lv_refr_now(disp);
+        elapsed += micros() - start;
+        yield();
+    }
+    return elapsed;
+}
+
+/**
+ * Render a seconds ticking clock with LVGL blending the glyphs and with glyph tiles.
+ * Both must give the same pixels, the tiles only change the time it takes.
+ */
+static void benchClock(void)
+{
+    lv_obj_t * active = lv_scr_act();
+    lv_disp_t * disp  = lv_disp_get_default();
+
+    lv_obj_t * screen = lv_obj_create(NULL, NULL);
+    lv_scr_load(screen);
+    lv_obj_t * label = lv_label_create(screen, NULL);
+    tileAttach(label);
+    lv_label_set_text(label, "12:34:56");
+    lv_obj_align(label, NULL, LV_ALIGN_CENTER, 0, 0);
+    lv_obj_set_auto_realign(label, true);
+    lv_refr_now(disp);
+
+    tileSetEnabled(false);
+    uint32_t blendUs  = benchClockRun(label, disp);
+    uint32_t blendCrc = ~benchCrc;
+
+    tile_stats_t before;
+    tileGetStats(&before);
+    tileSetEnabled(true);
+    uint32_t tileUs  = benchClockRun(label, disp);
+    uint32_t tileCrc = ~benchCrc;
+    tile_stats_t after;
+    tileGetStats(&after);
+
+    lv_scr_load(active);
+    lv_obj_del(screen);
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("BENCH: Clock %u us blended, %u us with tiles, %u hits, %u misses%s"),
+               blendUs, tileUs, after.hits - before.hits, after.misses - before.misses,
+               blendCrc == tileCrc ? "" : ", image changed");
+    debugPrintln(buffer);
+
+    snprintf_P(buffer, sizeof(buffer), PSTR("{\"clock\":{\"us\":[%u,%u],\"same\":%s}}"), blendUs, tileUs,
+               blendCrc == tileCrc ? "true" : "false");
+    mqttSendState(String(F("benchmark")).c_str(), buffer);
+}
+
+#endif
+
+static const char * const benchTexts[2] = {
+    "Living room 21.5 C, 45 %\nKitchen 22.0 C, 51 %\nBedroom 19.5 C, 48 %\n"
+    "Outside 12.5 C, 78 %, wind from the south west at 14 km/h with gusts up to 30 km/h",
+    "Living room 21.0 C, 46 %\nKitchen 22.5 C, 50 %\nBedroom 19.5 C, 49 %\n"
+    "Outside 12.0 C, 81 %, wind from the west at 11 km/h with gusts up to 25 km/h"};
+
+/**
+ * Switch a label between two pages of wrapped text and return the relayout and render time,
+ * the pixel crc of all frames is in benchCrc
+ */
+static uint32_t benchTextRun(lv_obj_t * label, lv_disp_t * disp)
+{
+    uint32_t elapsed = 0;
+    benchCrc         = 0xFFFFFFFF;
+    benchPixels      = 0;
+
+    for(uint8_t i = 0; i < BENCH_TEXT_FRAMES; i++) {
+        uint32_t start = micros();
+        lv_label_set_text(label, benchTexts[(i + 1) % 2]);
+        lv_refr_now(disp);
+        elapsed += micros() - start;
+        yield();
+    }
+    return elapsed;
+}
+
+/**
+ * Relayout and redraw a label with several wrapped lines with and without the text layout cache.
+ * Both must give the same pixels, the layouts only change the time it takes.
+ */
+static void benchText(void)
+{
+    lv_obj_t * active = lv_scr_act();
+    lv_disp_t * disp  = lv_disp_get_default();
+
+    lv_obj_t * screen = lv_obj_create(NULL, NULL);
+    lv_scr_load(screen);
+    lv_obj_t * label = lv_label_create(screen, NULL);
+    tileAttach(label);
+    lv_label_set_long_mode(label, LV_LABEL_LONG_BREAK);
+    lv_obj_set_width(label, lv_obj_get_width(screen) - 20);
+    lv_label_set_align(label, LV_LABEL_ALIGN_CENTER);
+    lv_label_set_text(label, benchTexts[0]);
+    lv_obj_align(label, NULL, LV_ALIGN_CENTER, 0, 0);
+    lv_refr_now(disp);
+
+    text_stats_t before;
+    textGetStats(&before);
+    textSetEnabled(false);
+    uint32_t uncachedUs  = benchTextRun(label, disp);
+    uint32_t uncachedCrc = ~benchCrc;
+    text_stats_t middle;
+    textGetStats(&middle);
+    textSetEnabled(true);
+    uint32_t cachedUs  = benchTextRun(label, disp);
+    uint32_t cachedCrc = ~benchCrc;
+    text_stats_t after;
+    textGetStats(&after);
+
+    lv_scr_load(active);
+    lv_obj_del(screen);
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("BENCH: Text %u us, %u us layout, cached %u us, %u us layout%s"),
+               uncachedUs, middle.layout_time - before.layout_time, cachedUs, after.layout_time - middle.layout_time,
+               uncachedCrc == cachedCrc ? "" : ", image changed");
+    debugPrintln(buffer);
+
+    snprintf_P(buffer, sizeof(buffer), PSTR("{\"text\":{\"us\":[%u,%u],\"same\":%s}}"), uncachedUs, cachedUs,
+               uncachedCrc == cachedCrc ? "true" : "false");
+    mqttSendState(String(F("benchmark")).c_str(), buffer);
+}
+
+/**
+ * Render every object type with every compiled in theme on a scratch screen.
+ * Reports the render time and the pixels drawn per combination and compares the pixel crc
+ * with the golden file, or stores the crcs as the new golden file if save is set.
+ */
+void benchRun(bool save)
+{
+    static uint32_t golden[BENCH_THEMES][BENCH_TYPES];
+    static uint32_t crcs[BENCH_THEMES][BENCH_TYPES];
+    bool compare = false;
+
+    if(!save) {
+        File file = SPIFFS.open(BENCH_GOLDEN_FILE, "r");
+        if(file) {
+            compare = file.read((uint8_t *)golden, sizeof(golden)) == sizeof(golden);
+            file.close();
+        }
+        if(!compare) warningPrintln(F("BENCH: %sNo golden file, only timing the render"));
+    }
+
+    lv_theme_t * theme   = lv_theme_get_current();
+    lv_obj_t * active    = lv_scr_act();
+    lv_disp_t * disp     = lv_disp_get_default();
+    uint16_t mismatches  = 0;
+    uint32_t slowestUs   = 0;
+    uint8_t slowestTheme = 0;
+    uint8_t slowestType  = 0;
+
+    memset(crcs, 0, sizeof(crcs));
+    benchActive = true;
+
+    for(uint8_t t = 0; t < BENCH_THEMES; t++) {
+        lv_theme_t * th = haspThemeInit(t);
+        if(!th) continue;
+        lv_theme_set_current(th);
+
+        String us((char *)0);
+        String px((char *)0);
+        String fail((char *)0);
+        us.reserve(128);
+        px.reserve(128);
+        fail.reserve(64);
+
+        /* A new screen gets the background style of the theme */
+        lv_obj_t * screen = lv_obj_create(NULL, NULL);
+        lv_scr_load(screen);
+        lv_refr_now(disp);
+
+        for(uint8_t i = 0; i < BENCH_TYPES; i++) {
+            uint8_t objid  = pgm_read_byte(&benchTypes[i]);
+            lv_obj_t * obj = benchCreate(screen, objid);
+
+            benchCrc       = 0xFFFFFFFF;
+            benchPixels    = 0;
+            uint32_t start = micros();
+            lv_refr_now(disp);
+            uint32_t elapsed = micros() - start;
+            crcs[t][i]       = ~benchCrc;
+
+            if(elapsed > slowestUs) {
+                slowestUs    = elapsed;
+                slowestTheme = t;
+                slowestType  = objid;
+            }
+            if(compare && golden[t][i] != crcs[t][i]) {
+                if(fail.length() > 0) fail += ",";
+                fail += String(objid);
+                mismatches++;
+            }
+
+            char buffer[128];
+            snprintf_P(buffer, sizeof(buffer), PSTR("BENCH: Theme %u objid %u: %u us, %u px, %u ns/px%s"), t, objid,
+                       elapsed, benchPixels, benchPixels ? elapsed * 1000 / benchPixels : 0,
+                       compare && golden[t][i] != crcs[t][i] ? ", image changed" : "");
+            debugPrintln(buffer);
+
+            if(i > 0) {
+                us += ",";
+                px += ",";
+            }
+            us += String(elapsed);
+            px += String(benchPixels);
+
+            /* Remove it again and clear its area so the next object starts from the bare screen */
+            if(obj) lv_obj_del(obj);
+            lv_refr_now(disp);
+            yield();
+        }
+
+        lv_scr_load(active);
+        lv_obj_del(screen);
+
+        String payload((char *)0);
+        payload.reserve(384);
+        payload = F("{\"theme\":");
+        payload += String(t);
+        payload += F(",\"us\":[");
+        payload += us;
+        payload += F("],\"px\":[");
+        payload += px;
+        payload += F("],\"changed\":[");
+        payload += fail;
+        payload += F("]}");
+        mqttSendState(String(F("benchmark")).c_str(), payload.c_str());
+    }
+
+#if HASP_USE_GLYPH_TILES > 0
+    benchClock();
+#endif
+    benchText();
+
+    benchActive = false;
+    lv_theme_set_current(theme);
+    guiPageCacheInvalidate(255); // the scratch frames were captured into the page cache
+    lv_obj_invalidate(active);
+
+    if(save) {
+        File file = SPIFFS.open(BENCH_GOLDEN_FILE, "w");
+        if(file) {
+            file.write((uint8_t *)crcs, sizeof(crcs));
+            file.close();
+            debugPrintln(F("BENCH: Golden file saved"));
+        } else {
+            errorPrintln(F("BENCH: %sCould not save the golden file"));
+        }
+    }
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("BENCH: Slowest is theme %u objid %u with %u us, %u images changed"),
+               slowestTheme, slowestType, slowestUs, mismatches);
+    debugPrintln(buffer);
+}
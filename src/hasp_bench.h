@@ -0,0 +1,9 @@
+#ifndef HASP_BENCH_H
+#define HASP_BENCH_H
+
+#include "lvgl.h"
+
+void benchRun(bool save);
+void benchFlush(const lv_area_t * area, const lv_color_t * color_p, lv_coord_t stride);
+
+#endif
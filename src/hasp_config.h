@@ -25,6 +25,12 @@ const char F_GUI_IDLEPERIOD2[] PROGMEM  = "idle2";
 const char F_GUI_CALIBRATION[] PROGMEM  = "calibration";
 const char F_GUI_BACKLIGHTPIN[] PROGMEM = "bcklpin";
 const char F_GUI_POINTER[] PROGMEM      = "pointer";
+const char F_GUI_TOUCHIRQPIN[] PROGMEM  = "touchirq";
+const char F_GUI_BUFFER[] PROGMEM       = "buffer";
+const char F_GUI_REFRMIN[] PROGMEM      = "refrmin";
+const char F_GUI_REFRMAX[] PROGMEM      = "refrmax";
+const char F_GUI_READMIN[] PROGMEM      = "readmin";
+const char F_GUI_READMAX[] PROGMEM      = "readmax";
 const char F_DEBUG_TELEPERIOD[] PROGMEM = "teleperiod";
 
 const char HASP_CONFIG_FILE[] PROGMEM = "/config.json";
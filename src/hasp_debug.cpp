@@ -70,8 +70,24 @@ String debugHaspHeader()
     return header;
 }
 
+#if HASP_USE_TASKS
+/* The gui and network tasks both log, only one of them writes to serial, telnet and syslog at a time */
+static SemaphoreHandle_t debugMutex = NULL;
+#define DEBUG_LOCK()                                                                                                   \
+    if(debugMutex) xSemaphoreTakeRecursive(debugMutex, portMAX_DELAY)
+#define DEBUG_UNLOCK()                                                                                                 \
+    if(debugMutex) xSemaphoreGiveRecursive(debugMutex)
+#else
+#define DEBUG_LOCK()
+#define DEBUG_UNLOCK()
+#endif
+
 void debugStart()
 {
+#if HASP_USE_TASKS
+    if(!debugMutex) debugMutex = xSemaphoreCreateRecursiveMutex(); // before the network task is started
+#endif
+
 #if defined(ARDUINO_ARCH_ESP32)
     Serial.begin(115200); /* prepare for possible serial debug */
 #else
@@ -120,6 +136,7 @@ void serialPrintln(const char * debugText)
     debugTimeText += F("b ");*/
 #endif
 
+    DEBUG_LOCK();
     Serial.print(debugTimeText);
     Serial.println(debugText);
 
@@ -127,6 +144,7 @@ void serialPrintln(const char * debugText)
     telnetPrint(debugTimeText.c_str());
     telnetPrintln(debugText);
 #endif
+    DEBUG_UNLOCK();
 }
 
 void serialPrintln(String & debugText)
@@ -138,6 +156,7 @@ void serialPrintln(String & debugText)
 void syslogSend(uint8_t log, const char * debugText)
 {
     if(WiFi.isConnected() && debugSyslogHost != "") {
+        DEBUG_LOCK();
         switch(log) {
             case 1:
                 syslog.log(LOG_WARNING, debugText);
@@ -148,6 +167,7 @@ void syslogSend(uint8_t log, const char * debugText)
             default:
                 syslog.log(LOG_INFO, debugText);
         }
+        DEBUG_UNLOCK();
     }
 }
 #endif
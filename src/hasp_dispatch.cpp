@@ -1,6 +1,8 @@
 #include "StringStream.h"
 #include "ArduinoJson.h"
 
+#include "hasp_conf.h"
+#include "hasp_queue.h"
 #include "hasp_dispatch.h"
 #include "hasp_config.h"
 #include "hasp_debug.h"
@@ -10,6 +12,10 @@
 #include "hasp_wifi.h"
 #include "hasp_log.h"
 #include "hasp_gui.h"
+#include "hasp_trace.h"
+#include "hasp_record.h"
+#include "hasp_bench.h"
+#include "lv_zifont.h"
 #include "hasp.h"
 
 bool isON(const char * payload)
@@ -25,11 +31,140 @@ String getOnOff(bool state)
     return result;
 }
 
+/* ---------- Inbound Command Queue ---------- */
+#if defined(ARDUINO_ARCH_ESP32)
+#define DISPATCH_QUEUE_SIZE 16
+#else
+#define DISPATCH_QUEUE_SIZE 8
+#endif
+
+typedef struct
+{
+    uint8_t type; // one of dispatch_queue_type_t
+    String topic;
+    String payload;
+    uint32_t received; // micros() when the command was queued
+} dispatch_queue_item_t;
+
+/* Filled by the network task, drained by the gui task */
+static HaspQueue<dispatch_queue_item_t, DISPATCH_QUEUE_SIZE> dispatchQueue;
+static uint8_t dispatchQueuePeak   = 0; // highest queue depth since the last status update
+static uint32_t dispatchApplyPeak  = 0; // longest apply time of one frame since the last status update, in us
+static uint32_t dispatchDuplicates = 0; // attribute writes replaced by a newer value before they were applied
+
 void dispatchSetup()
 {}
 
+/* Check if a newer write to the same attribute follows in the queue, without other commands in between */
+static bool dispatchIsOverwritten(dispatch_queue_item_t * item, uint8_t count)
+{
+    for(uint8_t i = 1; i < count; i++) {
+        dispatch_queue_item_t * next = dispatchQueue.front(i);
+        if(next->type != DISPATCH_ATTRIBUTE) return false;
+        if(next->topic == item->topic) return true;
+    }
+    return false;
+}
+
+/* Apply one command on the gui task, the payload can be modified by the json parsers */
+void dispatchApply(uint8_t type, String & topic, char * payload)
+{
+    switch(type) {
+        case DISPATCH_COMMAND:
+            dispatchCommand(payload);
+            break;
+        case DISPATCH_JSON:
+            dispatchJson(payload);
+            break;
+        case DISPATCH_JSONL:
+            dispatchJsonl(payload);
+            break;
+        case DISPATCH_ATTRIBUTE:
+            dispatchAttribute(topic, payload);
+            break;
+        case DISPATCH_RECONNECT:
+            haspReconnect();
+            break;
+    }
+}
+
+/* Apply all queued commands in arrival order, called from the gui task right before the refresh */
 void dispatchLoop()
-{}
+{
+    uint8_t count = dispatchQueue.size();
+    if(count == 0) return;
+
+    uint32_t start = micros();
+
+    while(count > 0) {
+        dispatch_queue_item_t * item = dispatchQueue.front();
+        recordMqttIn(item->type, item->topic, item->payload, item->received);
+
+        if(item->type == DISPATCH_ATTRIBUTE && dispatchIsOverwritten(item, count))
+            dispatchDuplicates++;
+        else
+            dispatchApply(item->type, item->topic, (char *)item->payload.c_str());
+        if(item->type != DISPATCH_RECONNECT) traceCommandApplied(item->received);
+        item->topic   = "";
+        item->payload = "";
+        dispatchQueue.pop();
+        count--;
+    }
+
+    haspPauseHidden(); // commands may have started animations on hidden pages
+
+    uint32_t elapsed = micros() - start;
+    if(elapsed > dispatchApplyPeak) dispatchApplyPeak = elapsed;
+}
+
+/**
+ * Queue an incoming command until the next gui refresh.
+ * Writes to the same attribute are deduplicated when the queue is applied, the invalidated areas
+ * of all queued commands are merged by lvgl when the frame is rendered.
+ */
+void dispatchEnqueue(uint8_t type, const String & topic, const char * payload)
+{
+    dispatch_queue_item_t * item = dispatchQueue.back();
+
+    while(!item) {
+#if HASP_USE_TASKS
+        delay(1); // queue full, wait for the gui task to apply the pending commands
+#else
+        dispatchLoop(); // queue full, apply the pending commands now
+#endif
+        item = dispatchQueue.back();
+    }
+
+    item->type     = type;
+    item->topic    = topic;
+    item->payload  = payload;
+    item->received = micros();
+    dispatchQueue.push();
+
+    uint8_t depth = dispatchQueue.size();
+    if(depth > dispatchQueuePeak) dispatchQueuePeak = depth;
+}
+
+uint8_t dispatchGetQueuePeak()
+{
+    return dispatchQueuePeak;
+}
+
+uint32_t dispatchGetApplyPeak()
+{
+    return dispatchApplyPeak;
+}
+
+uint32_t dispatchGetDuplicates()
+{
+    return dispatchDuplicates;
+}
+
+void dispatchResetStats()
+{
+    dispatchQueuePeak = 0;
+    dispatchApplyPeak = 0;
+}
 
 void dispatchStatusUpdate()
 {
@@ -165,6 +300,18 @@ void dispatchCommand(String cmnd)
         guiCalibrate();
     } else if(cmnd == F("wakeup")) {
         haspWakeUp();
+    } else if(cmnd.startsWith(F("record "))) {
+        cmnd = cmnd.substring(7, cmnd.length());
+        if(cmnd == F("stop"))
+            recordStop();
+        else
+            recordStart(cmnd.c_str());
+    } else if(cmnd.startsWith(F("replay "))) {
+        replayStart(cmnd.substring(7, cmnd.length()).c_str());
+    } else if(cmnd == F("benchmark") || cmnd == F("benchmark save")) {
+        benchRun(cmnd.endsWith(F(" save")));
+    } else if(cmnd == F("fontflash")) {
+        lv_zifont_flash_fonts();
     } else if(cmnd == F("screenshot")) {
         // guiTakeScreenshot("/screenhot.bmp");
     } else if(cmnd == F("reboot") || cmnd == F("restart")) {
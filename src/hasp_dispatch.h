@@ -3,9 +3,24 @@
 
 #include "ArduinoJson.h"
 
+enum dispatch_queue_type_t {
+    DISPATCH_COMMAND = 0,
+    DISPATCH_JSON,
+    DISPATCH_JSONL,
+    DISPATCH_ATTRIBUTE,
+    DISPATCH_RECONNECT, // the mqtt broker connection is restored
+};
+
 void dispatchSetup(void);
 void dispatchLoop(void);
 
+void dispatchEnqueue(uint8_t type, const String & topic, const char * payload);
+void dispatchApply(uint8_t type, String & topic, char * payload);
+uint8_t dispatchGetQueuePeak(void);
+uint32_t dispatchGetApplyPeak(void);
+uint32_t dispatchGetDuplicates(void);
+void dispatchResetStats(void);
+
 void dispatchAttribute(String & strTopic, const char * strPayload);
 void dispatchCommand(String cmnd);
 void dispatchJson(char * strPayload);
@@ -0,0 +1,222 @@
+#include "Arduino.h"
+#include "lvgl.h"
+#include "lv_zifont.h"
+
+#include "hasp_conf.h"
+#include "hasp_log.h"
+#include "hasp_debug.h"
+#include "hasp_font.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define FONT_MAX_LOADED 8
+#define FONT_MEMORY_BUDGET 32768u // bytes of descriptors and cached glyphs of the fonts used by pages
+#else
+#define FONT_MAX_LOADED 3
+#define FONT_MEMORY_BUDGET 8192u
+#endif
+
+/* Label style with the font of an entry, one per base style the font is combined with */
+typedef struct font_style_t
+{
+    struct font_style_t * next;
+    const lv_style_t * base;
+    lv_style_t style;
+} font_style_t;
+
+typedef struct
+{
+    lv_font_t * font;
+    char name[24];
+    uint8_t size;
+    uint32_t last_used;
+    font_style_t * styles;
+} font_entry_t;
+
+static font_entry_t fontEntries[FONT_MAX_LOADED];
+static uint32_t fontTick = 0;
+
+static bool fontUsesStyle(const font_entry_t * entry, const lv_style_t * style)
+{
+    if(!style) return false;
+    if(style->text.font == entry->font) return true;
+    for(font_style_t * node = entry->styles; node; node = node->next) {
+        if(&node->style == style) return true;
+    }
+    return false;
+}
+
+/* Check if an object or any of its children draws with the font */
+static bool fontUsedBy(const font_entry_t * entry, lv_obj_t * obj)
+{
+    if(fontUsesStyle(entry, obj->style_p)) return true;
+    lv_obj_t * child = lv_obj_get_child(obj, NULL);
+    while(child) {
+        if(fontUsedBy(entry, child)) return true;
+        child = lv_obj_get_child(obj, child);
+    }
+    return false;
+}
+
+/* Check every screen and both layers, so a font is never unloaded under an object using it */
+static bool fontInUse(const font_entry_t * entry)
+{
+    lv_disp_t * disp = lv_disp_get_default();
+    lv_obj_t * scr;
+    LV_LL_READ(disp->scr_ll, scr)
+    {
+        if(fontUsedBy(entry, scr)) return true;
+    }
+    return fontUsedBy(entry, lv_disp_get_layer_top(disp)) || fontUsedBy(entry, lv_disp_get_layer_sys(disp));
+}
+
+static void fontUnload(font_entry_t * entry)
+{
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("FONT: Unloading %s size %u"), entry->name, entry->size);
+    debugPrintln(buffer);
+
+    tileFlushFont(entry->font);
+    textFlushFont(entry->font);
+    lv_zifont_font_free(entry->font);
+    while(entry->styles) {
+        font_style_t * next = entry->styles->next;
+        /* Copies based on this style keep their own values, but the freed address must not match a new base */
+        for(uint8_t i = 0; i < FONT_MAX_LOADED; i++) {
+            for(font_style_t * node = fontEntries[i].styles; node; node = node->next) {
+                if(node->base == &entry->styles->style) node->base = NULL;
+            }
+        }
+        free(entry->styles);
+        entry->styles = next;
+    }
+    memset(entry, 0, sizeof(font_entry_t));
+}
+
+uint32_t fontGetMemory(void)
+{
+    uint32_t size = 0;
+    for(uint8_t i = 0; i < FONT_MAX_LOADED; i++) {
+        if(fontEntries[i].font) size += lv_zifont_font_size(fontEntries[i].font);
+    }
+    return size;
+}
+
+uint8_t fontGetCount(void)
+{
+    uint8_t count = 0;
+    for(uint8_t i = 0; i < FONT_MAX_LOADED; i++) {
+        if(fontEntries[i].font) count++;
+    }
+    return count;
+}
+
+/* Fonts in use stay loaded, drop the glyph caches of the least recently used ones until all fit the budget */
+static void fontEnforceBudget(const font_entry_t * keep)
+{
+    uint16_t flushed = 0;
+    while(fontGetMemory() > FONT_MEMORY_BUDGET) {
+        int8_t oldest = -1;
+        for(uint8_t i = 0; i < FONT_MAX_LOADED; i++) {
+            if(!fontEntries[i].font || &fontEntries[i] == keep || (flushed & (1 << i))) continue;
+            if(oldest < 0 || fontEntries[i].last_used < fontEntries[oldest].last_used) oldest = i;
+        }
+        if(oldest < 0) return;
+
+        lv_zifont_cache_flush(fontEntries[oldest].font);
+        flushed |= 1 << oldest;
+    }
+}
+
+/* Find a loaded font, or load it from /<name><size>.zi into a free slot */
+static font_entry_t * fontAcquire(const char * name, uint8_t size)
+{
+    font_entry_t * entry = NULL;
+    for(uint8_t i = 0; i < FONT_MAX_LOADED && !entry; i++) {
+        if(fontEntries[i].font && fontEntries[i].size == size && strcmp(fontEntries[i].name, name) == 0)
+            entry = &fontEntries[i];
+    }
+
+    if(!entry) {
+        if(strlen(name) >= sizeof(entry->name)) {
+            errorPrintln(F("FONT: %sFont name too long"));
+            return NULL;
+        }
+        for(uint8_t i = 0; i < FONT_MAX_LOADED && !entry; i++) {
+            if(!fontEntries[i].font) entry = &fontEntries[i];
+        }
+        if(!entry) {
+            errorPrintln(F("FONT: %sToo many fonts in use"));
+            return NULL;
+        }
+
+        /* The path is owned by the font once it is loaded */
+        size_t len  = strlen(name) + 8;
+        char * path = (char *)malloc(len);
+        if(!path) return NULL;
+        if(size > 0)
+            snprintf_P(path, len, PSTR("/%s%u.zi"), name, size);
+        else
+            snprintf_P(path, len, PSTR("/%s"), name);
+
+        lv_font_t * font = NULL;
+        if(lv_zifont_font_init(&font, path, size) != 0) {
+            errorPrintln(String(F("FONT: %sFailed to load ")) + path);
+            free(path);
+            lv_zifont_font_free(font);
+            return NULL;
+        }
+
+        memset(entry, 0, sizeof(font_entry_t));
+        entry->font = font;
+        entry->size = size;
+        strcpy(entry->name, name);
+    }
+
+    entry->last_used = ++fontTick;
+    fontEnforceBudget(entry);
+    return entry;
+}
+
+/* Get a font by name and size, it is loaded on first use and shared by all objects using it */
+lv_font_t * fontGet(const char * name, uint8_t size)
+{
+    font_entry_t * entry = fontAcquire(name, size);
+    return entry ? entry->font : NULL;
+}
+
+/**
+ * Get a label style with the font, copied from the base style of the object asking for it.
+ * Objects with the same base share the style, objects with another base get their own copy.
+ */
+const lv_style_t * fontGetStyle(const char * name, uint8_t size, const lv_style_t * base)
+{
+    font_entry_t * entry = fontAcquire(name, size);
+    if(!entry) return NULL;
+    if(!base) base = &lv_style_plain;
+
+    for(font_style_t * node = entry->styles; node; node = node->next) {
+        if(node->base == base || &node->style == base) return &node->style;
+    }
+
+    font_style_t * node = (font_style_t *)malloc(sizeof(font_style_t));
+    if(!node) {
+        errorPrintln(F("FONT: %sOut of memory for the font style"));
+        return NULL;
+    }
+    lv_style_copy(&node->style, base);
+    node->style.text.font = entry->font;
+    node->base            = base;
+    node->next            = entry->styles;
+    entry->styles         = node;
+    return &node->style;
+}
+
+/* Unload the fonts no object uses anymore, after a page or the screens were cleared */
+void fontReleaseUnused(void)
+{
+    for(uint8_t i = 0; i < FONT_MAX_LOADED; i++) {
+        if(fontEntries[i].font && !fontInUse(&fontEntries[i])) fontUnload(&fontEntries[i]);
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef HASP_FONT_H
+#define HASP_FONT_H
+
+#include "lvgl.h"
+
+lv_font_t * fontGet(const char * name, uint8_t size);
+const lv_style_t * fontGetStyle(const char * name, uint8_t size, const lv_style_t * base);
+void fontReleaseUnused(void);
+
+uint8_t fontGetCount(void);
+uint32_t fontGetMemory(void);
+
+#endif
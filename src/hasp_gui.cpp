@@ -3,6 +3,7 @@
 #include "lv_conf.h"
 #include "lvgl.h"
 #include "lv_fs_if.h"
+#include "lv_misc/lv_gc.h"
 
 #include "TFT_eSPI.h"
 
@@ -12,7 +13,14 @@
 #include "hasp_debug.h"
 #include "hasp_config.h"
 #include "hasp_dispatch.h"
+#include "hasp_hal.h"
 #include "hasp_gui.h"
+#include "hasp_touch.h"
+#include "hasp_live.h"
+#include "hasp_qoi.h"
+#include "hasp_trace.h"
+#include "hasp_record.h"
+#include "hasp_bench.h"
 #include "hasp.h"
 
 #if HASP_USE_PNGDECODE != 0
@@ -28,7 +36,9 @@
 
 /* ---------- Screenshot Variables ---------- */
 File pFileOut;
-uint8_t guiSnapshot = 0;
+uint8_t guiSnapshot = 0; // 0 = off, 1 = bmp file, 2 = bmp webclient, 3 = qoi webclient
+
+static qoi_encoder_t * guiQoi;
 
 #if defined(ARDUINO_ARCH_ESP8266)
 #include <ESP8266WebServer.h>
@@ -49,20 +59,76 @@ WebServer * webClient; // for snatshot
 #ifndef TFT_ROTATION
 #define TFT_ROTATION 0
 #endif
+#ifndef TOUCH_IRQ
+#define TOUCH_IRQ -1 // No Touch IRQ line, poll the controller
+#endif
 
 static bool guiShowPointer    = false;
 static bool guiBacklightIsOn  = true;
 static int8_t guiDimLevel     = -1;
 static int8_t guiBacklightPin = TFT_BCKL;
+static int8_t guiTouchIrqPin  = TOUCH_IRQ;
 static bool guiAutoCalibrate  = true;
 static uint16_t guiSleepTime1 = 60;  // 1 second resolution
 static uint16_t guiSleepTime2 = 120; // 1 second resolution
 static uint8_t guiSleeping    = 0;   // 0 = off, 1 = short, 2 = long
 static uint8_t guiTickPeriod  = 50;
 static uint8_t guiRotation    = TFT_ROTATION;
-static Ticker tick;  /* timer for interrupt handler */
+#if LV_TICK_CUSTOM == 0
+static Ticker tick; /* timer for interrupt handler */
+#endif
 static TFT_eSPI tft; // = TFT_eSPI(); /* TFT instance */
 static uint16_t calData[5] = {0, 65535, 0, 65535, 0};
+static lv_indev_t * guiIndev;
+static uint8_t guiBufferMode   = 0; // 0 = auto, 1 = single, 2 = double, 3 = full frame double in psram
+static uint8_t guiBufferActive = 0; // the strategy in use
+static uint16_t guiBufferLines = 0; // lines of the partial draw buffers
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define GUI_MAX_BUFFER_SIZE 32768u // bytes per partial draw buffer
+#else
+#define GUI_MAX_BUFFER_SIZE 6144u
+#endif
+#define GUI_MIN_BUFFER_LINES 10
+
+/* ---------- Page Cache Variables ---------- */
+#define GUI_PAGE_CACHE_SIZE 4 // rendered pages kept in memory
+typedef struct
+{
+    uint8_t pageid;
+    bool complete;       // all pixels of the page have been captured
+    uint32_t used;       // last time the page was shown
+    lv_color_t * pixels; // full frame, NULL when not allocated
+} gui_page_cache_t;
+static gui_page_cache_t guiPageCache[GUI_PAGE_CACHE_SIZE];
+static gui_page_cache_t * guiPageCacheCurrent = NULL; // entry of the visible page, captures the flushed areas
+static uint32_t guiPageCacheHits              = 0;
+static uint32_t guiPageCacheMisses            = 0;
+static uint32_t guiPageCmdTime                = 0; // time of the last page change, 0 when the first pixel is sent
+static uint32_t guiPageLatency                = 0; // ms from the last page change to its first pixel
+
+/* ---------- Display-off Variables ---------- */
+static bool guiDisplayOff        = false; // rendering is suspended while the panel is dark
+static uint32_t guiOffLastCheck  = 0;     // last time the skipped frames were accounted
+static uint32_t guiFramesSkipped = 0;     // frames not rendered while the display was off
+static uint32_t guiFrameTimeAvg  = 0;     // moving average of the render time of a frame, in 1/16 ms
+typedef struct
+{
+    lv_task_t * task;
+    uint8_t prio;
+} gui_suspended_task_t;
+static gui_suspended_task_t * guiSuspended = NULL; // tasks paused while the display is off
+static uint16_t guiSuspendedCount         = 0;
+static uint32_t guiSuspendFailed          = 0; // tasks that kept running because the list could not be allocated
+
+/* ---------- Adaptive Period Variables ---------- */
+#define GUI_RAMP_TIME 5000 // ms of inactivity to ramp from the fastest to the slowest periods
+static uint16_t guiRefrPeriodMin = 15;  // ms, refresh period while the screen is touched
+static uint16_t guiRefrPeriodMax = 200; // ms, refresh period of animations when idle
+static uint16_t guiReadPeriodMin = 10;  // ms, touch polling period while the screen is touched
+static uint16_t guiReadPeriodMax = 100; // ms, touch polling period when idle
+static uint16_t guiFrameCount    = 0;   // frames rendered in the current second
+static uint16_t guiFps           = 0;   // frames rendered in the last second
 
 bool guiCheckSleep()
 {
@@ -87,6 +153,263 @@ bool guiCheckSleep()
     return false;
 }
 
+/* Called by lvgl after every refresh cycle with the render and flush time in ms */
+static void guiMonitor(lv_disp_drv_t * disp_drv, uint32_t time, uint32_t px)
+{
+    /* The page was rendered completely, e.g. after it was loaded */
+    if(guiPageCacheCurrent && px >= (uint32_t)disp_drv->hor_res * disp_drv->ver_res) {
+        guiPageCacheCurrent->complete = true;
+    }
+
+    guiFrameTimeAvg = (guiFrameTimeAvg * 7 + (time << 4)) / 8;
+    guiFrameCount++;
+
+    traceFrameDone();
+    recordFrame(time, px);
+}
+
+static bool guiTaskExists(lv_task_t * task)
+{
+    lv_task_t * item = (lv_task_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_task_ll));
+    while(item) {
+        if(item == task) return true;
+        item = (lv_task_t *)lv_ll_get_next(&LV_GC_ROOT(_lv_task_ll), item);
+    }
+    return false;
+}
+
+/* Pause the refresh task, animations and all other lvgl tasks.
+ * Only the input device keeps running so a touch can still wake up the display. */
+static void guiSuspendRendering()
+{
+    /* Collect first, lv_task_set_prio reorders the task list */
+    uint16_t count   = 0;
+    lv_task_t * task = (lv_task_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_task_ll));
+    while(task) {
+        if(task != guiIndev->driver.read_task && task->prio != LV_TASK_PRIO_OFF) count++;
+        task = (lv_task_t *)lv_ll_get_next(&LV_GC_ROOT(_lv_task_ll), task);
+    }
+
+    free(guiSuspended);
+    guiSuspendedCount = 0;
+    guiSuspended      = (gui_suspended_task_t *)malloc(count * sizeof(gui_suspended_task_t) + 1);
+    if(!guiSuspended) {
+        guiSuspendFailed += count;
+        errorPrintln(F("GUI: %sNot enough memory to suspend the lvgl tasks"));
+        return;
+    }
+
+    task = (lv_task_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_task_ll));
+    while(task && guiSuspendedCount < count) {
+        if(task != guiIndev->driver.read_task && task->prio != LV_TASK_PRIO_OFF) {
+            guiSuspended[guiSuspendedCount].task = task;
+            guiSuspended[guiSuspendedCount].prio = task->prio;
+            guiSuspendedCount++;
+        }
+        task = (lv_task_t *)lv_ll_get_next(&LV_GC_ROOT(_lv_task_ll), task);
+    }
+
+    for(uint16_t i = 0; i < guiSuspendedCount; i++) {
+        lv_task_set_prio(guiSuspended[i].task, LV_TASK_PRIO_OFF);
+    }
+
+    guiOffLastCheck = millis();
+    debugPrintln(F("GUI: Display off, rendering suspended"));
+}
+
+/* Restore the suspended tasks and redraw the whole screen once */
+static void guiResumeRendering()
+{
+    for(uint16_t i = 0; i < guiSuspendedCount; i++) {
+        if(guiTaskExists(guiSuspended[i].task)) {
+            lv_task_set_prio(guiSuspended[i].task, (lv_task_prio_t)guiSuspended[i].prio);
+        }
+    }
+    free(guiSuspended);
+    guiSuspended      = NULL;
+    guiSuspendedCount = 0;
+
+    /* Animations resume from the current tick, so they are fast-forwarded */
+    lv_obj_invalidate(lv_scr_act());
+    lv_refr_now(NULL);
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("GUI: Display on, %u frames skipped, about %u ms saved"), guiFramesSkipped,
+               guiEstimateTimeSaved());
+    debugPrintln(buffer);
+}
+
+static void guiCheckDisplayOff()
+{
+    bool off = !guiBacklightIsOn || guiSleeping == 2;
+
+    if(off != guiDisplayOff) {
+        guiDisplayOff = off;
+        if(off)
+            guiSuspendRendering();
+        else
+            guiResumeRendering();
+
+    } else if(off) {
+        /* Count the frames lvgl would have rendered while the display is off */
+        lv_disp_t * disp = lv_disp_get_default();
+        if(millis() - guiOffLastCheck >= disp->refr_task->period) {
+            guiOffLastCheck = millis();
+            if(disp->inv_p > 0 || lv_anim_count_running() > 0) guiFramesSkipped++;
+        }
+    }
+}
+
+/* Linear ramp from min to max over GUI_RAMP_TIME ms of inactivity */
+static uint16_t guiRampPeriod(uint32_t idle, uint16_t min, uint16_t max)
+{
+    if(max <= min) return min;
+    if(idle >= GUI_RAMP_TIME) return max;
+    return min + (uint32_t)(max - min) * idle / GUI_RAMP_TIME;
+}
+
+/* Refresh and poll the touch controller fast on input, back off gradually when idle */
+static void guiAdaptPeriods()
+{
+    lv_disp_t * disp = lv_disp_get_default();
+    uint32_t idle    = lv_disp_get_inactive_time(disp);
+
+    uint16_t period = guiRampPeriod(idle, guiRefrPeriodMin, guiRefrPeriodMax);
+    if(disp->refr_task->period != period) lv_task_set_period(disp->refr_task, period);
+
+    period = guiRampPeriod(idle, guiReadPeriodMin, guiReadPeriodMax);
+    if(guiIndev->driver.read_task->period != period) lv_task_set_period(guiIndev->driver.read_task, period);
+
+    /* Without animations only redraw on invalidation, but do it right away */
+    if(disp->inv_p > 0 && lv_anim_count_running() == 0) lv_task_ready(disp->refr_task);
+}
+
+void guiEverySecond()
+{
+    guiFps        = guiFrameCount;
+    guiFrameCount = 0;
+    touchEverySecond();
+}
+
+/* Time from the last page change to its first pixels on the panel */
+static void guiPageLatencyCheck()
+{
+    if(guiPageCmdTime == 0) return;
+    guiPageLatency = millis() - guiPageCmdTime;
+    guiPageCmdTime = 0;
+}
+
+/* Allocate a full frame for the page cache, only when there is plenty of memory */
+static lv_color_t * guiPageCacheAlloc()
+{
+    size_t size = lv_disp_get_hor_res(NULL) * lv_disp_get_ver_res(NULL) * sizeof(lv_color_t);
+#if defined(ARDUINO_ARCH_ESP32)
+    if(psramFound()) return (lv_color_t *)ps_malloc(size);
+#endif
+    if(halGetMaxFreeBlock() < size * 2) return NULL;
+    return (lv_color_t *)malloc(size);
+}
+
+/**
+ * Called on a page change before the page is loaded. Sends the cached pixels of the page to the panel,
+ * lvgl redraws the page afterwards to pick up any changes.
+ * @return true if the page was in the cache
+ */
+bool guiPageCacheShow(uint8_t pageid)
+{
+    gui_page_cache_t * entry = NULL;
+    gui_page_cache_t * lru   = &guiPageCache[0];
+    guiPageCmdTime           = millis() | 1; // never 0
+
+    for(uint8_t i = 0; i < GUI_PAGE_CACHE_SIZE; i++) {
+        if(guiPageCache[i].pixels && guiPageCache[i].pageid == pageid) entry = &guiPageCache[i];
+        if(!guiPageCache[i].pixels || (lru->pixels && guiPageCache[i].used < lru->used)) lru = &guiPageCache[i];
+    }
+
+    if(entry && entry->complete && !guiDisplayOff) {
+        lv_area_t area;
+        lv_area_set(&area, 0, 0, lv_disp_get_hor_res(NULL) - 1, lv_disp_get_ver_res(NULL) - 1);
+
+        tft.startWrite();
+        tft.setAddrWindow(0, 0, area.x2 + 1, area.y2 + 1);
+        tft.pushColors((uint16_t *)entry->pixels, (area.x2 + 1) * (area.y2 + 1), true);
+        tft.endWrite();
+        liveFlush(&area, entry->pixels, area.x2 + 1);
+
+        guiPageLatencyCheck();
+        guiPageCacheHits++;
+    } else {
+        guiPageCacheMisses++;
+    }
+
+    if(!entry) {
+        /* Reuse the least recently used entry */
+        entry = lru;
+        if(!entry->pixels) entry->pixels = guiPageCacheAlloc();
+        entry->pageid   = pageid;
+        entry->complete = false;
+    }
+
+    entry->used         = millis();
+    guiPageCacheCurrent = entry->pixels ? entry : NULL;
+    return guiPageCacheCurrent && guiPageCacheCurrent->complete;
+}
+
+/* Drop the cached pixels of a page after its objects changed, the layers 254 and 255 are part of all pages */
+void guiPageCacheInvalidate(uint8_t pageid)
+{
+    for(uint8_t i = 0; i < GUI_PAGE_CACHE_SIZE; i++) {
+        if(pageid >= 254 || guiPageCache[i].pageid == pageid) guiPageCache[i].complete = false;
+    }
+}
+
+uint8_t guiGetPageCacheHitRate()
+{
+    uint32_t total = guiPageCacheHits + guiPageCacheMisses;
+    return total > 0 ? guiPageCacheHits * 100 / total : 0;
+}
+
+uint32_t guiGetPageLatency()
+{
+    return guiPageLatency;
+}
+
+uint16_t guiGetFps()
+{
+    return guiFps;
+}
+
+uint16_t guiGetRefrPeriod()
+{
+    return lv_disp_get_default()->refr_task->period;
+}
+
+uint16_t guiGetReadPeriod()
+{
+    return guiIndev->driver.read_task->period;
+}
+
+uint32_t guiGetFramesSkipped()
+{
+    return guiFramesSkipped;
+}
+
+bool guiIsRenderingSuspended()
+{
+    return guiDisplayOff;
+}
+
+uint32_t guiGetSuspendFailed()
+{
+    return guiSuspendFailed;
+}
+
+/* Estimate only: the skipped frames times the average frame time, nothing is measured while the display is off */
+uint32_t guiEstimateTimeSaved()
+{
+    return guiFramesSkipped * guiFrameTimeAvg / 16;
+}
+
 #if LV_USE_LOG != 0
 /* Serial debugging */
 void debugLvgl(lv_log_level_t level, const char * file, uint32_t line, const char * dsc)
@@ -97,81 +420,89 @@ void debugLvgl(lv_log_level_t level, const char * file, uint32_t line, const cha
 }
 #endif
 
+static void guiQoiWrite(const uint8_t * data, uint16_t len)
+{
+    webClient->sendContent_P((const char *)data, len);
+}
+
+/* Keep the rendered pixels of the visible page up to date */
+static void guiPageCacheCapture(const lv_area_t * area, const lv_color_t * color_p, lv_coord_t stride)
+{
+    if(!guiPageCacheCurrent) return;
+
+    lv_coord_t hor_res = lv_disp_get_hor_res(NULL);
+    lv_coord_t w       = area->x2 - area->x1 + 1;
+    lv_color_t * dest  = guiPageCacheCurrent->pixels + area->y1 * hor_res + area->x1;
+
+    for(lv_coord_t y = area->y1; y <= area->y2; y++) {
+        memcpy(dest, color_p, w * sizeof(lv_color_t));
+        dest += hor_res;
+        color_p += stride;
+    }
+}
+
+/* Send an area to the panel, rows are stride pixels apart in color_p */
+static void guiPushArea(const lv_area_t * area, lv_color_t * color_p, lv_coord_t stride)
+{
+    lv_coord_t w = area->x2 - area->x1 + 1;
+    lv_coord_t h = area->y2 - area->y1 + 1;
+
+    guiPageLatencyCheck();
+    guiPageCacheCapture(area, color_p, stride);
+    liveFlush(area, color_p, stride); /* copy the area for the live view */
+    benchFlush(area, color_p, stride);
+
+    tft.setAddrWindow(area->x1, area->y1, w, h); /* set the working window */
+    if(stride == w) {
+        tft.pushColors((uint16_t *)color_p, w * h, true);
+    } else {
+        for(lv_coord_t y = 0; y < h; y++) {
+            tft.pushColors((uint16_t *)color_p, w, true);
+            color_p += stride;
+        }
+    }
+}
+
 /* Display flushing */
 void tft_espi_flush(lv_disp_drv_t * disp, const lv_area_t * area, lv_color_t * color_p)
 {
     if(guiSnapshot != 0) {
-        int i = 0;
-        uint8_t pixel[1024];
-
-        for(int y = area->y1; y <= area->y2; y++) {
-            for(int x = area->x1; x <= area->x2; x++) {
-                /* Function for converting LittlevGL pixel format to RGB888 */
-                // data = DISP_IMPL_lvgl_formatPixel(*color_p);
-
-                // Complex 32 bpp
-                /* pixel[i++] = (LV_COLOR_GET_B(*color_p) * 263 + 7) >> 5;
-                 pixel[i++] = (LV_COLOR_GET_G(*color_p) * 259 + 3) >> 6;
-                 pixel[i++] = (LV_COLOR_GET_R(*color_p) * 263 + 7) >> 5;
-                 pixel[i++] = 0xFF;*/
-
-                // Simple 32 bpp
-                // pixel[i++] = (LV_COLOR_GET_B(*color_p) << 3);
-                // pixel[i++] = (LV_COLOR_GET_G(*color_p) << 2);
-                // pixel[i++] = (LV_COLOR_GET_R(*color_p) << 3);
-                // pixel[i++] = 0xFF;
-
-                // Simple 16 bpp
-                pixel[i++] = color_p->full & 0xFF;
-                pixel[i++] = (color_p->full >> 8) & 0xFF;
-
-                color_p++;
-                // i += 4;
-
-                if(i + 4 >= sizeof(pixel)) {
-                    switch(guiSnapshot) {
-                        case 1:
-                            // Save to local file
-                            pFileOut.write(pixel, i);
-                            break;
-                        case 2:
-                            // Send to remote client
-                            if(webClient->client().write(pixel, i) != i) {
-                                errorPrintln(F("GUI: %sPixelbuffer not completely sent"));
-                                lv_disp_flush_ready(disp); /* tell lvgl that flushing is done */
-                                return;
-                            }
-                    }
-                    i = 0;
+        /* lvgl renders the invalidated screen in full-width bands from top to bottom,
+         * so the areas arrive in the row order of the image */
+        size_t len = (area->x2 - area->x1 + 1) * (area->y2 - area->y1 + 1);
+
+        switch(guiSnapshot) {
+            case 1:
+                // Save to local file
+                pFileOut.write((uint8_t *)color_p, len * sizeof(lv_color_t));
+                break;
+            case 2:
+                // Send to remote client
+                if(webClient->client().write((uint8_t *)color_p, len * sizeof(lv_color_t)) !=
+                   len * sizeof(lv_color_t)) {
+                    errorPrintln(F("GUI: %sPixelbuffer not completely sent"));
                 }
-            }
-        }
-
-        if(i > 0) {
-            switch(guiSnapshot) {
-                case 1:
-                    // Save to local file
-                    pFileOut.write(pixel, i);
-                    break;
-                case 2:
-                    // Send to remote client
-                    if(webClient->client().write(pixel, i) != i) {
-                        errorPrintln(F("GUI: %sPixelbuffer not completely sent"));
-                    }
-            }
+                break;
+            case 3:
+                // Compress and send to remote client, lv_color_t is plain RGB565 without LV_COLOR_16_SWAP
+                qoiEncodeRgb565(guiQoi, &color_p->full, len);
+                break;
         }
     } else {
-        uint16_t c;
+        lv_disp_t * disp_refr = lv_refr_get_disp_refreshing();
 
         tft.startWrite(); /* Start new TFT transaction */
-        tft.setAddrWindow(area->x1, area->y1, (area->x2 - area->x1 + 1),
-                          (area->y2 - area->y1 + 1)); /* set the working window */
-        for(int y = area->y1; y <= area->y2; y++) {
-            for(int x = area->x1; x <= area->x2; x++) {
-                c = color_p->full;
-                tft.writeColor(c, 1);
-                color_p++;
+        if(lv_disp_is_true_double_buf(disp_refr)) {
+            /* The full frame is passed, only send the areas that changed */
+            lv_coord_t hor_res = lv_disp_get_hor_res(disp_refr);
+            for(uint16_t i = 0; i < disp_refr->inv_p; i++) {
+                if(disp_refr->inv_area_joined[i]) continue;
+
+                const lv_area_t * inv = &disp_refr->inv_areas[i];
+                guiPushArea(inv, color_p + inv->y1 * hor_res + inv->x1, hor_res);
             }
+        } else {
+            guiPushArea(area, color_p, area->x2 - area->x1 + 1);
         }
         tft.endWrite(); /* terminate TFT transaction */
     }
@@ -179,11 +510,13 @@ void tft_espi_flush(lv_disp_drv_t * disp, const lv_area_t * area, lv_color_t * c
     lv_disp_flush_ready(disp); /* tell lvgl that flushing is done */
 }
 
+#if LV_TICK_CUSTOM == 0
 /* Interrupt driven periodic handler */
 static void IRAM_ATTR lv_tick_handler(void)
 {
     lv_tick_inc(guiTickPeriod);
 }
+#endif
 
 /* Reading input device (simulated encoder here) */
 /*bool read_encoder(lv_indev_drv_t * indev, lv_indev_data_t * data)
@@ -206,43 +539,6 @@ void guiFirstCalibration()
     // haspFirstSetup();
 }
 
-bool my_touchpad_read(lv_indev_drv_t * indev_driver, lv_indev_data_t * data)
-{
-    uint16_t touchX, touchY;
-
-    bool touched = tft.getTouch(&touchX, &touchY, 600);
-    if(!touched) return false;
-
-    if(guiAutoCalibrate) {
-        guiFirstCalibration();
-        return false;
-    }
-
-    guiCheckSleep();
-
-    // Ignore first press?
-
-    if(touchX > tft.width() || touchY > tft.height()) {
-        Serial.print(F("Y or y outside of expected parameters.. x: "));
-        Serial.print(touchX);
-        Serial.print(F("  / y: "));
-        Serial.println(touchY);
-    } else {
-        /*Save the state and save the pressed coordinate*/
-        data->state   = touched ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
-        data->point.x = touchX;
-        data->point.y = touchY;
-        /*
-                Serial.print("Data x");
-                Serial.println(touchX);
-
-                Serial.print("Data y");
-                Serial.println(touchY);*/
-    }
-
-    return false; /*Return `false` because we are not buffering and no more data to read*/
-}
-
 void guiCalibrate()
 {
     tft.fillScreen(TFT_BLACK);
@@ -267,6 +563,91 @@ void guiCalibrate()
     lv_obj_invalidate(lv_disp_get_layer_sys(NULL));
 }
 
+/* Select the draw buffer strategy and allocate the buffers, returns the size of a buffer in pixels.
+ * Partial buffers share half of the largest free block, up to GUI_MAX_BUFFER_SIZE each. */
+static size_t guiAllocBuffers(lv_disp_buf_t * disp_buf, lv_coord_t hor_res, lv_coord_t ver_res)
+{
+    lv_color_t * buf1 = NULL;
+    lv_color_t * buf2 = NULL;
+    uint8_t mode      = guiBufferMode;
+    size_t size;
+
+#if defined(ARDUINO_ARCH_ESP32)
+    if(mode == 0 || mode == 3) {
+        size = hor_res * ver_res;
+        if(psramFound()) {
+            buf1 = (lv_color_t *)ps_malloc(size * sizeof(lv_color_t));
+            buf2 = (lv_color_t *)ps_malloc(size * sizeof(lv_color_t));
+        }
+        if(buf1 && buf2) {
+            guiBufferActive = 3;
+            guiBufferLines  = ver_res;
+            lv_disp_buf_init(disp_buf, buf1, buf2, size);
+            return size;
+        }
+        free(buf1);
+        free(buf2);
+        buf1 = buf2 = NULL;
+        if(mode == 3) errorPrintln(F("GUI: %sNo PSRAM for full frame buffers"));
+        mode = 2;
+    }
+#else
+    if(mode == 0 || mode == 3) mode = 1;
+#endif
+
+    /* Halve the lines until the buffers fit, then try a single buffer */
+    while(true) {
+        size_t budget = halGetMaxFreeBlock() / (2 * mode);
+        if(budget > GUI_MAX_BUFFER_SIZE) budget = GUI_MAX_BUFFER_SIZE;
+        guiBufferLines = budget / (hor_res * sizeof(lv_color_t));
+        if(guiBufferLines < GUI_MIN_BUFFER_LINES) guiBufferLines = GUI_MIN_BUFFER_LINES;
+        if(guiBufferLines > ver_res) guiBufferLines = ver_res;
+
+        while(true) {
+            size = hor_res * guiBufferLines;
+            buf1 = (lv_color_t *)malloc(size * sizeof(lv_color_t));
+            if(buf1 && mode == 2) buf2 = (lv_color_t *)malloc(size * sizeof(lv_color_t));
+            if(buf1 && (buf2 || mode == 1)) break;
+
+            free(buf1);
+            buf1 = NULL;
+            if(guiBufferLines == 1) break;
+            guiBufferLines /= 2;
+        }
+        if(buf1 || mode == 1) break;
+
+        warningPrintln(F("GUI: %sNot enough memory for double draw buffers, using a single buffer"));
+        mode = 1;
+    }
+
+    /* lvgl can not draw without a buffer, keep the display working one line at a time */
+    if(!buf1) {
+        static lv_color_t guiMinBuffer[LV_HOR_RES_MAX > LV_VER_RES_MAX ? LV_HOR_RES_MAX : LV_VER_RES_MAX];
+        errorPrintln(F("GUI: %sNot enough memory for the draw buffer, using a single line"));
+        buf1           = guiMinBuffer;
+        size           = hor_res;
+        guiBufferLines = 1;
+    }
+
+    guiBufferActive = mode;
+    lv_disp_buf_init(disp_buf, buf1, buf2, size);
+    return size;
+}
+
+const char * guiGetBufferMode()
+{
+    switch(guiBufferActive) {
+        case 1:
+            return "single";
+        case 2:
+            return "double";
+        case 3:
+            return "full frame";
+        default:
+            return "none";
+    }
+}
+
 void guiSetup(TFT_eSPI & screen, JsonObject settings)
 {
     size_t buffer_size;
@@ -279,23 +660,23 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
     tft.setTouch(calData);
 
     tft.setRotation(guiRotation); /* 1/3=Landscape or 0/2=Portrait orientation */
+    touchSetup(tft, guiTouchIrqPin);
     lv_init();
 
-#if defined(ARDUINO_ARCH_ESP32)
-    /* allocate on iram (or psram ?) */
-    buffer_size                       = 16 * 1024u; // 32 KBytes *2
-    static lv_color_t * guiVdbBuffer1 = (lv_color_t *)malloc(sizeof(lv_color_t) * buffer_size);
-    static lv_color_t * guiVdbBuffer2 = (lv_color_t *)malloc(sizeof(lv_color_t) * buffer_size);
-    static lv_disp_buf_t disp_buf;
-    lv_disp_buf_init(&disp_buf, guiVdbBuffer1, guiVdbBuffer2, buffer_size);
-#else
-    /* allocate on heap */
-    static lv_color_t guiVdbBuffer1[3 * 1024u]; // 6 KBytes
-    // static lv_color_t guiVdbBuffer2[3 * 1024u]; // 6 KBytes
-    buffer_size = sizeof(guiVdbBuffer1) / sizeof(guiVdbBuffer1[0]);
+    lv_coord_t hor_res, ver_res;
+    if(guiRotation == 0 || guiRotation == 2 || guiRotation == 4 || guiRotation == 6) {
+        /* 1/3=Landscape or 0/2=Portrait orientation */
+        // Normal width & height
+        hor_res = TFT_WIDTH;  // From User_Setup.h
+        ver_res = TFT_HEIGHT; // From User_Setup.h
+    } else {
+        // Swapped width & height
+        hor_res = TFT_HEIGHT; // From User_Setup.h
+        ver_res = TFT_WIDTH;  // From User_Setup.h
+    }
+
     static lv_disp_buf_t disp_buf;
-    lv_disp_buf_init(&disp_buf, guiVdbBuffer1, NULL, buffer_size);
-#endif
+    buffer_size = guiAllocBuffers(&disp_buf, hor_res, ver_res);
 
     char buffer[128];
     snprintf_P(buffer, sizeof(buffer), PSTR("LVGL: Rotation : %d"), guiRotation);
@@ -307,6 +688,9 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
     snprintf_P(buffer, sizeof(buffer), PSTR("LVGL: VFB size : %d"), (size_t)sizeof(lv_color_t) * buffer_size);
     debugPrintln(buffer);
 
+    snprintf_P(buffer, sizeof(buffer), PSTR("LVGL: VFB mode : %s, %u lines"), guiGetBufferMode(), guiBufferLines);
+    debugPrintln(buffer);
+
 #if LV_USE_LOG != 0
     debugPrintln(F("LVGL: Registering lvgl logging handler"));
     lv_log_register_print_cb(debugLvgl); /* register print function for debugging */
@@ -324,18 +708,11 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
     /* Initialize the display driver */
     lv_disp_drv_t disp_drv;
     lv_disp_drv_init(&disp_drv);
-    disp_drv.flush_cb = tft_espi_flush;
-    disp_drv.buffer   = &disp_buf;
-    if(guiRotation == 0 || guiRotation == 2 || guiRotation == 4 || guiRotation == 6) {
-        /* 1/3=Landscape or 0/2=Portrait orientation */
-        // Normal width & height
-        disp_drv.hor_res = TFT_WIDTH;  // From User_Setup.h
-        disp_drv.ver_res = TFT_HEIGHT; // From User_Setup.h
-    } else {
-        // Swapped width & height
-        disp_drv.hor_res = TFT_HEIGHT; // From User_Setup.h
-        disp_drv.ver_res = TFT_WIDTH;  // From User_Setup.h
-    }
+    disp_drv.flush_cb   = tft_espi_flush;
+    disp_drv.monitor_cb = guiMonitor;
+    disp_drv.buffer     = &disp_buf;
+    disp_drv.hor_res    = hor_res;
+    disp_drv.ver_res    = ver_res;
     lv_disp_drv_register(&disp_drv);
 
     /*Initialize the touch pad*/
@@ -344,8 +721,9 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
     // indev_drv.type = LV_INDEV_TYPE_ENCODER;
     // indev_drv.read_cb = read_encoder;
     indev_drv.type           = LV_INDEV_TYPE_POINTER;
-    indev_drv.read_cb        = my_touchpad_read;
+    indev_drv.read_cb        = touchRead;
     lv_indev_t * mouse_indev = lv_indev_drv_register(&indev_drv);
+    guiIndev                 = mouse_indev;
 
     if(guiShowPointer) {
         lv_obj_t * label = lv_label_create(lv_layer_sys(), NULL);
@@ -383,8 +761,10 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
     lv_indev_set_cursor(mouse_indev, cursor);
     // }*/
 
+#if LV_TICK_CUSTOM == 0
     /*Initialize the graphics library's tick*/
     tick.attach_ms(guiTickPeriod, lv_tick_handler);
+#endif
 
     /* Setup Backlight Control Pin */
     if(guiBacklightPin >= 0) {
@@ -406,7 +786,13 @@ void guiSetup(TFT_eSPI & screen, JsonObject settings)
 void IRAM_ATTR guiLoop()
 {
     lv_task_handler(); /* let the GUI do its work */
+
+    touchLoop(); /* buffer touch samples in the gap after a flush */
+    if(guiAutoCalibrate && touchIsPressed()) guiFirstCalibration();
+
     guiCheckSleep();
+    guiCheckDisplayOff();
+    if(!guiDisplayOff) guiAdaptPeriods();
 }
 void guiStop()
 {}
@@ -464,8 +850,14 @@ bool guiGetConfig(const JsonObject & settings)
     settings[FPSTR(F_GUI_IDLEPERIOD1)]  = guiSleepTime1;
     settings[FPSTR(F_GUI_IDLEPERIOD2)]  = guiSleepTime2;
     settings[FPSTR(F_GUI_BACKLIGHTPIN)] = guiBacklightPin;
+    settings[FPSTR(F_GUI_TOUCHIRQPIN)]  = guiTouchIrqPin;
     settings[FPSTR(F_GUI_ROTATION)]     = guiRotation;
     settings[FPSTR(F_GUI_POINTER)]      = guiShowPointer;
+    settings[FPSTR(F_GUI_BUFFER)]       = guiBufferMode;
+    settings[FPSTR(F_GUI_REFRMIN)]      = guiRefrPeriodMin;
+    settings[FPSTR(F_GUI_REFRMAX)]      = guiRefrPeriodMax;
+    settings[FPSTR(F_GUI_READMIN)]      = guiReadPeriodMin;
+    settings[FPSTR(F_GUI_READMAX)]      = guiReadPeriodMax;
 
     JsonArray array = settings[FPSTR(F_GUI_CALIBRATION)].to<JsonArray>();
     for(uint8_t i = 0; i < 5; i++) {
@@ -487,9 +879,15 @@ bool guiSetConfig(const JsonObject & settings)
 
     changed |= configSet(guiTickPeriod, settings[FPSTR(F_GUI_TICKPERIOD)], PSTR("guiTickPeriod"));
     changed |= configSet(guiBacklightPin, settings[FPSTR(F_GUI_BACKLIGHTPIN)], PSTR("guiBacklightPin"));
+    changed |= configSet(guiTouchIrqPin, settings[FPSTR(F_GUI_TOUCHIRQPIN)], PSTR("guiTouchIrqPin"));
     changed |= configSet(guiSleepTime1, settings[FPSTR(F_GUI_IDLEPERIOD1)], PSTR("guiSleepTime1"));
     changed |= configSet(guiSleepTime2, settings[FPSTR(F_GUI_IDLEPERIOD2)], PSTR("guiSleepTime2"));
     changed |= configSet(guiRotation, settings[FPSTR(F_GUI_ROTATION)], PSTR("guiRotation"));
+    changed |= configSet(guiBufferMode, settings[FPSTR(F_GUI_BUFFER)], PSTR("guiBufferMode"));
+    changed |= configSet(guiRefrPeriodMin, settings[FPSTR(F_GUI_REFRMIN)], PSTR("guiRefrPeriodMin"));
+    changed |= configSet(guiRefrPeriodMax, settings[FPSTR(F_GUI_REFRMAX)], PSTR("guiRefrPeriodMax"));
+    changed |= configSet(guiReadPeriodMin, settings[FPSTR(F_GUI_READMIN)], PSTR("guiReadPeriodMin"));
+    changed |= configSet(guiReadPeriodMax, settings[FPSTR(F_GUI_READMAX)], PSTR("guiReadPeriodMax"));
 
     if(!settings[FPSTR(F_GUI_POINTER)].isNull()) {
         if(guiShowPointer != settings[FPSTR(F_GUI_POINTER)].as<bool>()) {
@@ -641,20 +1039,48 @@ void guiTakeScreenshot(const char * pFileName)
 }
 
 #if defined(ARDUINO_ARCH_ESP8266)
-void guiTakeScreenshot(ESP8266WebServer & client)
+void guiTakeScreenshot(ESP8266WebServer & client, bool compressed)
 #endif
 #if defined(ARDUINO_ARCH_ESP32)
-    void guiTakeScreenshot(WebServer & client)
+    void guiTakeScreenshot(WebServer & client, bool compressed)
 #endif // ESP32{
 {
     webClient = &client;
 
-    guiSnapshot = 2;
-    guiSendBmpHeader();
+    if(compressed) {
+        guiQoi = (qoi_encoder_t *)malloc(sizeof(qoi_encoder_t));
+        if(!guiQoi) {
+            errorPrintln(F("GUI: %sNot enough memory for the screenshot encoder"));
+            client.sendContent("");
+            return;
+        }
+
+        lv_disp_t * disp = lv_disp_get_default();
+        qoiStart(guiQoi, guiQoiWrite, disp->driver.hor_res, disp->driver.ver_res);
+
+        guiSnapshot = 3;
+    } else {
+        guiSnapshot = 2;
+        guiSendBmpHeader();
+    }
 
+    uint32_t start = millis();
     lv_obj_invalidate(lv_scr_act());
     lv_refr_now(NULL); /* Will call our disp_drv.disp_flush function */
     guiSnapshot = 0;
 
-    debugPrintln(F("GUI: Bitmap data flushed to webclient"));
+    if(compressed) {
+        qoiFinish(guiQoi);
+        client.sendContent(""); // last chunk
+
+        char buffer[128];
+        snprintf_P(buffer, sizeof(buffer), PSTR("GUI: QOI image of %u bytes flushed to webclient in %u ms"),
+                   guiQoi->size, millis() - start);
+        debugPrintln(buffer);
+
+        free(guiQoi);
+        guiQoi = NULL;
+    } else {
+        debugPrintln(F("GUI: Bitmap data flushed to webclient"));
+    }
 }
@@ -8,17 +8,18 @@
 
 #if defined(ARDUINO_ARCH_ESP8266)
 #include <ESP8266WebServer.h>
-void guiTakeScreenshot(ESP8266WebServer & client);
+void guiTakeScreenshot(ESP8266WebServer & client, bool compressed = false);
 #endif
 
 #if defined(ARDUINO_ARCH_ESP32)
 #include <WebServer.h>
-void guiTakeScreenshot(WebServer & client);
+void guiTakeScreenshot(WebServer & client, bool compressed = false);
 #endif // ESP32
 
 void guiSetup(TFT_eSPI & screen, JsonObject settings);
 void guiLoop(void);
 void guiStop(void);
+void guiEverySecond(void);
 
 void guiCalibrate();
 void guiTakeScreenshot(const char * pFileName);
@@ -28,6 +29,20 @@ int8_t guiGetDim(void);
 void guiSetBacklight(bool lighton);
 bool guiGetBacklight();
 
+bool guiPageCacheShow(uint8_t pageid);
+void guiPageCacheInvalidate(uint8_t pageid);
+uint8_t guiGetPageCacheHitRate(void);
+uint32_t guiGetPageLatency(void);
+
+const char * guiGetBufferMode(void);
+uint16_t guiGetFps(void);
+uint16_t guiGetRefrPeriod(void);
+uint16_t guiGetReadPeriod(void);
+bool guiIsRenderingSuspended(void);
+uint32_t guiGetFramesSkipped(void);
+uint32_t guiGetSuspendFailed(void);
+uint32_t guiEstimateTimeSaved(void);
+
 bool guiGetConfig(const JsonObject & settings);
 bool guiSetConfig(const JsonObject & settings);
 
@@ -3,11 +3,13 @@
 #include "ArduinoJson.h"
 //#include "Update.h"
 #include "lvgl.h"
+#include "lv_zifont.h"
 
 #include "hasp_conf.h"
 
 #include "hasp_log.h"
 #include "hasp_gui.h"
+#include "hasp_live.h"
 #include "hasp_hal.h"
 #include "hasp_debug.h"
 #include "hasp_http.h"
@@ -16,6 +18,9 @@
 #include "hasp_spiffs.h"
 #include "hasp_config.h"
 #include "hasp_dispatch.h"
+#include "hasp_record.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
 #include "hasp.h"
 
 #if defined(ARDUINO_ARCH_ESP32)
@@ -36,15 +41,59 @@ HTTPUpload * upload;
 
 #if defined(ARDUINO_ARCH_ESP8266)
 #include <ESP8266WebServer.h>
-ESP8266WebServer webServer(80);
+typedef ESP8266WebServer HaspWebServerBase;
 #endif
 
 #if defined(ARDUINO_ARCH_ESP32)
 #include <WebServer.h>
-WebServer webServer(80);
-
+typedef WebServer HaspWebServerBase;
 #endif // ESP32
 
+/* The web server with an entry point for replayed requests */
+class HaspWebServer : public HaspWebServerBase {
+  public:
+    HaspWebServer(int port) : HaspWebServerBase(port)
+    {}
+
+    /**
+     * Run the handler of a recorded request the way handleClient does, without a client.
+     * The response is written to an unconnected client and discarded.
+     * data is the uri \0 followed by the arguments as name \0 value \0 pairs.
+     */
+    void replay(HTTPMethod method, const char * data, size_t len)
+    {
+        WiFiClient client = _currentClient; // a live request may be waiting for its data
+        _currentClient    = WiFiClient();
+        _currentMethod    = method;
+        _currentUri       = data;
+
+        const char * end = data + len;
+        const char * arg = data + strlen(data) + 1;
+        uint8_t count    = 0;
+        for(const char * p = arg; p < end; p += strlen(p) + 1) count++;
+
+        delete[] _currentArgs;
+        _currentArgCount = count / 2;
+        _currentArgs     = new RequestArgument[_currentArgCount + 1];
+        for(int i = 0; i < _currentArgCount; i++) {
+            _currentArgs[i].key = arg;
+            arg += strlen(arg) + 1;
+            _currentArgs[i].value = arg;
+            arg += strlen(arg) + 1;
+        }
+
+        for(_currentHandler = _firstHandler; _currentHandler; _currentHandler = _currentHandler->next()) {
+            if(_currentHandler->canHandle(_currentMethod, _currentUri)) break;
+        }
+        _handleRequest();
+
+        _currentClient = client;
+    }
+};
+
+HaspWebServer webServer(80);
+static bool httpReplaying = false; // a recorded request is being replayed
+
 const char MAIN_MENU_BUTTON[] PROGMEM =
     "</p><p><form method='get' action='/'><button type='submit'>Main Menu</button></form>";
 const char MIT_LICENSE[] PROGMEM = "</br>MIT License</p>";
@@ -94,9 +143,69 @@ String lcdFirmwareUrl = "http://haswitchplate.com/update/HASwitchPlate.tft";
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void webHandleHaspConfig();
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Record the request as the uri \0 and its arguments as name \0 value \0 pairs */
+static void httpRecord()
+{
+    if(!recordIsRecording()) return;
+
+    size_t len = webServer.uri().length() + 1;
+    for(int i = 0; i < webServer.args(); i++) len += webServer.argName(i).length() + webServer.arg(i).length() + 2;
+
+    char * data = (char *)malloc(len);
+    if(!data) return;
+
+    char * p = data;
+    strcpy(p, webServer.uri().c_str());
+    p += webServer.uri().length() + 1;
+    for(int i = 0; i < webServer.args(); i++) {
+        strcpy(p, webServer.argName(i).c_str());
+        p += webServer.argName(i).length() + 1;
+        strcpy(p, webServer.arg(i).c_str());
+        p += webServer.arg(i).length() + 1;
+    }
+
+    recordHttp(webServer.method(), data, len);
+    free(data);
+}
+
+/**
+ * Replay a recorded request on the gui task, through the same handlers as a live request.
+ * Requests that reboot, write the flash, take over the connection or change the network settings are skipped.
+ */
+bool httpReplay(uint8_t method, const char * data, size_t len)
+{
+    static const char * const skipped[] = {"/reboot", "/resetConfig", "/saveConfig", "/firmware",
+                                           "/espfirmware", "/edit", "/live"};
+    for(uint8_t i = 0; i < sizeof(skipped) / sizeof(skipped[0]); i++) {
+        if(strcmp(data, skipped[i]) == 0) return false;
+    }
+
+    /* The config page applies the posted settings of one module */
+    if(strcmp_P(data, PSTR("/config")) == 0) {
+        for(const char * arg = data + strlen(data) + 1; arg < data + len; arg += strlen(arg) + 1) {
+            if(strcmp_P(arg, PSTR("save")) == 0) {
+                const char * value = arg + strlen(arg) + 1;
+                if(strcmp_P(value, PSTR("wifi")) == 0 || strcmp_P(value, PSTR("mqtt")) == 0 ||
+                   strcmp_P(value, PSTR("http")) == 0)
+                    return false;
+            }
+            arg += strlen(arg) + 1; // skip the value
+        }
+    }
+
+    /* Recordings of version 1 without the method are all page views */
+    httpReplaying = true;
+    webServer.replay(method == HTTP_ANY ? HTTP_GET : (HTTPMethod)method, data, len);
+    httpReplaying = false;
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 bool httpIsAuthenticated(const String & page)
 {
+    if(httpReplaying) return true; // authenticated when it was recorded
+
     if(httpPassword[0] != '\0') { // Request HTTP auth if httpPassword is set
         if(!webServer.authenticate(httpUser, httpPassword)) {
             webServer.requestAuthentication();
@@ -104,6 +213,8 @@ bool httpIsAuthenticated(const String & page)
         }
     }
 
+    httpRecord();
+
     char buffer[128];
     snprintf(buffer, sizeof(buffer), PSTR("HTTP: Sending %s page to client connected from: %s"), page.c_str(),
              webServer.client().remoteIP().toString().c_str());
@@ -191,6 +302,7 @@ void webHandleRoot()
 
     httpMessage += F("<p><form method='get' action='info'><button type='submit'>Information</button></form></p>");
     httpMessage += F("<p><form method='get' action='screenshot'><button type='submit'>Screenshot</button></form></p>");
+    httpMessage += F("<p><form method='get' action='live'><button type='submit'>Live View</button></form></p>");
     httpMessage +=
         PSTR("<p><form method='get' action='config'><button type='submit'>Configuration</button></form></p>");
 
@@ -236,16 +348,65 @@ void httpHandleReboot()
     dispatchReboot(true);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+void webHandleLive()
+{ // http://plate01/live
+    if(!httpIsAuthenticated(F("live"))) return;
+
+    if(webServer.hasArg(F("s"))) {
+        /* Keep the connection open, the areas are streamed from liveLoop */
+        WiFiClient client = webServer.client();
+        liveStart(client);
+    } else {
+
+        String nodename((char *)0);
+        nodename.reserve(128);
+        nodename = mqttGetNodename();
+
+        String httpMessage((char *)0);
+        httpMessage.reserve(HTTP_PAGE_SIZE);
+        httpMessage += F("<h1>");
+        httpMessage += nodename;
+        httpMessage += F("</h1><hr>");
+
+        httpMessage += F("<p class='c'><canvas id='live'></canvas></p>");
+        httpMessage += F("<script>var c=document.getElementById('live'),x=c.getContext('2d'),q=new Uint8Array(0),W=0;");
+        httpMessage += F("function px(d,i,v){i*=4;d[i]=(v>>11&31)*255/31;d[i+1]=(v>>5&63)*255/63;d[i+2]=(v&31)*255/31;");
+        httpMessage += F("d[i+3]=255;}function u16(p){return q[p]|q[p+1]<<8;}function parse(){var p=0;if(!W){");
+        httpMessage += F("if(q.length<4)return;W=c.width=u16(0);c.height=u16(2);p=4;}while(q.length-p>=8){");
+        httpMessage += F("var w=u16(p+4),h=u16(p+6),n=w*h,i=0,k=p+8,im=x.createImageData(w,h),d=im.data,t,m;");
+        httpMessage += F("while(i<n){if(k>=q.length)break;t=q[k];m=(t&127)+1;if(t&128){if(k+3>q.length)break;");
+        httpMessage += F("while(m--)px(d,i++,u16(k+1));k+=3;}else{if(k+1+2*m>q.length)break;k++;");
+        httpMessage += F("while(m--){px(d,i++,u16(k));k+=2;}}}if(i<n)break;x.putImageData(im,u16(p),u16(p+2));p=k;}");
+        httpMessage += F("q=q.slice(p);}fetch('?s=1').then(function(r){var rd=r.body.getReader();function next(){");
+        httpMessage += F("rd.read().then(function(e){if(e.done)return;var t=new Uint8Array(q.length+e.value.length);");
+        httpMessage += F("t.set(q);t.set(e.value,q.length);q=t;parse();next();});}next();});</script>");
+        httpMessage += FPSTR(MAIN_MENU_BUTTON);
+
+        webSendPage(nodename, httpMessage.length(), false);
+        webServer.sendContent(httpMessage);
+        httpMessage.clear();
+        webSendFooter();
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 void webHandleScreenshot()
 { // http://plate01/screenshot
     if(!httpIsAuthenticated(F("screenshot"))) return;
 
     if(webServer.hasArg(F("q"))) {
-        webServer.setContentLength(122 + 320 * 240 * 2);
-        webServer.send(200, PSTR("image/bmp"), "");
+        if(webServer.arg(F("f")) == F("qoi")) {
+            webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+            webServer.send(200, PSTR("image/qoi"), "");
+
+            guiTakeScreenshot(webServer, true);
+        } else {
+            webServer.setContentLength(122 + lv_disp_get_hor_res(NULL) * lv_disp_get_ver_res(NULL) * 2);
+            webServer.send(200, PSTR("image/bmp"), "");
 
-        guiTakeScreenshot(webServer);
+            guiTakeScreenshot(webServer);
+        }
     } else {
 
         String nodename((char *)0);
@@ -258,9 +419,20 @@ void webHandleScreenshot()
         httpMessage += nodename;
         httpMessage += F("</h1><hr>");
 
-        httpMessage += F("<p class='c'><img id='bmp' src='?q=0'></p>");
-        httpMessage += F("<p><form method='get' onsubmit=\"var timestamp = new Date().getTime();var ");
-        httpMessage += F("el=document.getElementById('bmp');el.src='?q='+timestamp;return false;\">");
+        httpMessage += F("<p class='c'><canvas id='scr'></canvas></p>");
+        httpMessage += F("<script>function qoi(buf){var d=new Uint8Array(buf),v=new DataView(buf),w=v.getUint32(4),");
+        httpMessage += F("h=v.getUint32(8),c=document.getElementById('scr'),x=c.getContext('2d'),im=x.createImageData(w,h),");
+        httpMessage += F("o=im.data,ix=new Uint8Array(256),r=0,g=0,b=0,a=255,p=14,n=0,i,t,q,dg;c.width=w;c.height=h;");
+        httpMessage += F("for(i=0;i<w*h*4;i+=4){if(n>0)n--;else{t=d[p++];if(t==254){r=d[p++];g=d[p++];b=d[p++];}");
+        httpMessage += F("else if(t==255){r=d[p++];g=d[p++];b=d[p++];a=d[p++];}");
+        httpMessage += F("else if((t&192)==0){q=t*4;r=ix[q];g=ix[q+1];b=ix[q+2];a=ix[q+3];}");
+        httpMessage += F("else if((t&192)==64){r=(r+(t>>4&3)-2)&255;g=(g+(t>>2&3)-2)&255;b=(b+(t&3)-2)&255;}");
+        httpMessage += F("else if((t&192)==128){q=d[p++];dg=(t&63)-32;r=(r+dg-8+(q>>4))&255;g=(g+dg)&255;");
+        httpMessage += F("b=(b+dg-8+(q&15))&255;}else n=t&63;q=(r*3+g*5+b*7+a*11)%64*4;ix[q]=r;ix[q+1]=g;ix[q+2]=b;");
+        httpMessage += F("ix[q+3]=a;}o[i]=r;o[i+1]=g;o[i+2]=b;o[i+3]=a;}x.putImageData(im,0,0);}");
+        httpMessage += F("function scr(){fetch('?f=qoi&q='+new Date().getTime()).then(function(r){");
+        httpMessage += F("return r.arrayBuffer();}).then(qoi);return false;}scr();</script>");
+        httpMessage += F("<p><form method='get' onsubmit='return scr();'>");
         httpMessage += F("<button type='submit'>Refresh</button></form></p>");
         httpMessage += FPSTR(MAIN_MENU_BUTTON);
 
@@ -357,6 +529,64 @@ void webHandleInfo()
     httpMessage += spiffsFormatBytes(mem_mon.free_size);
     httpMessage += F("<br/><b>LVGL Fragmentation: </b>");
     httpMessage += mem_mon.frag_pct;
+    httpMessage += F("<br/><b>LVGL Draw Buffer: </b>");
+    httpMessage += guiGetBufferMode();
+
+    lv_zifont_cache_stats_t font_stats;
+    lv_zifont_get_cache_stats(&font_stats);
+    httpMessage += F("<br/><b>Glyph Cache: </b>");
+    httpMessage += spiffsFormatBytes(font_stats.used);
+    httpMessage += F(" of ");
+    httpMessage += spiffsFormatBytes(font_stats.budget);
+    httpMessage += F(", ");
+    httpMessage += String(font_stats.hits);
+    httpMessage += F(" hits, ");
+    httpMessage += String(font_stats.misses);
+    httpMessage += F(" misses");
+    httpMessage += F("<br/><b>Font File Reads: </b>");
+    httpMessage += String(font_stats.file_opens);
+    httpMessage += F(" opens, ");
+    httpMessage += spiffsFormatBytes(font_stats.file_bytes);
+    httpMessage += F(", ");
+    httpMessage += String(font_stats.flash_fonts);
+    httpMessage += F(" fonts in flash");
+    httpMessage += F("<br/><b>Glyph Decoding: </b>");
+    httpMessage += String(font_stats.decode_pixels);
+    httpMessage += F(" pixels in ");
+    httpMessage += String(font_stats.decode_time / 1000);
+    httpMessage += F(" ms");
+
+#if HASP_USE_GLYPH_TILES > 0
+    tile_stats_t tile_stats;
+    tileGetStats(&tile_stats);
+    httpMessage += F("<br/><b>Glyph Tiles: </b>");
+    httpMessage += spiffsFormatBytes(tile_stats.used);
+    httpMessage += F(" of ");
+    httpMessage += spiffsFormatBytes(tile_stats.budget);
+    httpMessage += F(", ");
+    httpMessage += String(tile_stats.hits);
+    httpMessage += F(" hits, ");
+    httpMessage += String(tile_stats.misses);
+    httpMessage += F(" misses, ");
+    httpMessage += String(tile_stats.fallbacks);
+    httpMessage += F(" blended by LVGL");
+#endif
+
+    text_stats_t text_stats;
+    textGetStats(&text_stats);
+    httpMessage += F("<br/><b>Text Layouts: </b>");
+    httpMessage += spiffsFormatBytes(text_stats.used);
+    httpMessage += F(" of ");
+    httpMessage += spiffsFormatBytes(text_stats.budget);
+    httpMessage += F(", ");
+    httpMessage += String(text_stats.hits);
+    httpMessage += F(" hits, ");
+    httpMessage += String(text_stats.misses);
+    httpMessage += F(" misses in ");
+    httpMessage += String(text_stats.layout_time / 1000);
+    httpMessage += F(" ms, ");
+    httpMessage += String(text_stats.skipped);
+    httpMessage += F(" unchanged texts");
 
     // httpMessage += F("<br/><b>LCD Model: </b>")) + String(LV_HASP_HOR_RES_MAX) + " x " +
     // String(LV_HASP_VER_RES_MAX); httpMessage += F("<br/><b>LCD Version: </b>")) + String(lcdVersion);
@@ -1289,6 +1519,7 @@ void httpSetup(const JsonObject & settings)
         webServer.on(F("/config/wifi"), webHandleWifiConfig);
 #endif
         webServer.on(F("/screenshot"), webHandleScreenshot);
+        webServer.on(F("/live"), webHandleLive);
         webServer.on(F("/saveConfig"), webHandleSaveConfig);
         webServer.on(F("/resetConfig"), httpHandleResetConfig);
         webServer.on(F("/firmware"), webHandleFirmware);
@@ -1337,6 +1568,7 @@ void httpReconnect()
 void httpLoop()
 {
     if(httpEnable) webServer.handleClient();
+    liveLoop();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -9,6 +9,8 @@ void httpLoop(void);
 void httpEverySecond(void);
 void httpReconnect(void);
 
+bool httpReplay(uint8_t method, const char * data, size_t len);
+
 bool httpGetConfig(const JsonObject & settings);
 bool httpSetConfig(const JsonObject & settings);
 
@@ -0,0 +1,178 @@
+#include "Arduino.h"
+#include "lvgl.h"
+
+#include "hasp_log.h"
+#include "hasp_debug.h"
+#include "hasp_live.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <lwip/sockets.h>
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define LIVE_BUFFER_SIZE 16384u // bytes of encoded areas waiting to be sent
+#else
+#define LIVE_BUFFER_SIZE 4096u
+#endif
+#define LIVE_SEND_SIZE 1436u // bytes sent per loop, one tcp segment
+#define LIVE_RESYNC_TIME 1000 // ms between full screen resyncs while the client is too slow
+
+/* The stream starts with the screen width and height as uint16_t.
+ * Then every flushed area follows as x, y, width and height uint16_t values and the
+ * RGB565 pixels, run-length encoded in tokens of 1..128 pixels:
+ *   0x80 | (n - 1), color    -> n times the same color
+ *   0x00 | (n - 1), n colors -> n literal colors
+ * All values are little endian. */
+
+static WiFiClient liveClient;
+static uint8_t * liveBuffer    = NULL;
+static size_t liveHead         = 0; // end of the encoded data
+static size_t liveTail         = 0; // start of the unsent data
+static bool liveResync         = false;
+static uint32_t liveLastResync = 0;
+static uint32_t liveDropped    = 0; // areas dropped because the client was too slow
+
+static void liveStop()
+{
+    liveClient.stop();
+    free(liveBuffer);
+    liveBuffer = NULL;
+    debugPrintln(F("LIVE: Client disconnected"));
+}
+
+static inline bool livePut(size_t & pos, uint16_t value)
+{
+    if(pos + 2 > LIVE_BUFFER_SIZE) return false;
+    liveBuffer[pos++] = value & 0xFF;
+    liveBuffer[pos++] = value >> 8;
+    return true;
+}
+
+/* Run-length encode len pixels at pos, returns false when they do not fit */
+static bool liveEncode(size_t & pos, const lv_color_t * color_p, size_t len)
+{
+    while(len > 0) {
+        /* Count the repeats of the current color */
+        size_t n = 1;
+        while(n < len && n < 128 && color_p[n].full == color_p[0].full) n++;
+
+        if(n > 1) {
+            if(pos + 3 > LIVE_BUFFER_SIZE) return false;
+            liveBuffer[pos++] = 0x80 | (n - 1);
+            livePut(pos, color_p[0].full);
+        } else {
+            /* Collect literals up to the next run */
+            while(n < len && n < 128 && color_p[n].full != color_p[n - 1].full) n++;
+            if(n < len && color_p[n].full == color_p[n - 1].full) n--;
+            if(pos + 1 + n * 2 > LIVE_BUFFER_SIZE) return false;
+            liveBuffer[pos++] = n - 1;
+            for(size_t i = 0; i < n; i++) livePut(pos, color_p[i].full);
+        }
+        color_p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Called from the display flush callback, only copies into the buffer and never blocks.
+ * Rows of the area are stride pixels apart in color_p. */
+void liveFlush(const lv_area_t * area, const lv_color_t * color_p, lv_coord_t stride)
+{
+    if(!liveBuffer || liveResync) return;
+
+    /* Make room at the end of the buffer */
+    if(liveTail > 0) {
+        memmove(liveBuffer, liveBuffer + liveTail, liveHead - liveTail);
+        liveHead -= liveTail;
+        liveTail = 0;
+    }
+
+    lv_coord_t w = area->x2 - area->x1 + 1;
+    lv_coord_t h = area->y2 - area->y1 + 1;
+    size_t pos   = liveHead;
+    bool fits    = livePut(pos, area->x1) && livePut(pos, area->y1) && livePut(pos, w) && livePut(pos, h);
+
+    if(stride == w) {
+        fits = fits && liveEncode(pos, color_p, w * h);
+    } else {
+        for(lv_coord_t y = 0; fits && y < h; y++) fits = liveEncode(pos, color_p + y * stride, w);
+    }
+
+    if(!fits) {
+        /* The client can not keep up, drop this and the next areas and send the whole screen again
+         * once the queued data is sent. The queued data is kept, part of it may be on the wire already. */
+        liveResync = true;
+        liveDropped++;
+    } else {
+        liveHead = pos;
+    }
+}
+
+/* Write what the socket takes right now, the gui task must never wait on a slow client */
+static size_t liveWrite(const uint8_t * data, size_t len)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    /* WiFiClient::write retries until all data is sent, a non-blocking send only takes what fits.
+     * A full socket buffer returns EAGAIN, other errors are noticed by connected() in the next loop. */
+    int sent = send(liveClient.fd(), data, len, MSG_DONTWAIT);
+    return sent > 0 ? sent : 0;
+#else
+    if(len > liveClient.availableForWrite()) len = liveClient.availableForWrite();
+    return len > 0 ? liveClient.write(data, len) : 0;
+#endif
+}
+
+void liveLoop()
+{
+    if(!liveBuffer) return;
+
+    if(!liveClient.connected()) {
+        liveStop();
+        return;
+    }
+
+    if(liveTail < liveHead) {
+        size_t len = liveHead - liveTail;
+        if(len > LIVE_SEND_SIZE) len = LIVE_SEND_SIZE;
+        liveTail += liveWrite(liveBuffer + liveTail, len);
+        if(liveTail >= liveHead) liveTail = liveHead = 0;
+
+    } else if(liveResync && millis() - liveLastResync >= LIVE_RESYNC_TIME) {
+        /* All queued data is sent, redraw the whole screen for the client */
+        liveResync     = false;
+        liveLastResync = millis();
+        lv_obj_invalidate(lv_scr_act());
+        lv_obj_invalidate(lv_layer_top());
+        lv_obj_invalidate(lv_layer_sys());
+    }
+}
+
+void liveStart(WiFiClient & client)
+{
+    if(liveBuffer) liveStop(); // only one viewer at a time
+
+    liveBuffer = (uint8_t *)malloc(LIVE_BUFFER_SIZE);
+    if(!liveBuffer) {
+        errorPrintln(F("LIVE: %sNot enough memory for the live view"));
+        client.stop();
+        return;
+    }
+
+    liveClient = client;
+    liveClient.print(F("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                       "Cache-Control: no-cache\r\nConnection: close\r\n\r\n"));
+
+    liveHead = liveTail = 0;
+    livePut(liveHead, lv_disp_get_hor_res(NULL));
+    livePut(liveHead, lv_disp_get_ver_res(NULL));
+
+    /* Start with the whole screen */
+    liveResync     = true;
+    liveLastResync = millis() - LIVE_RESYNC_TIME;
+    debugPrintln(F("LIVE: Client connected"));
+}
+
+uint32_t liveGetDropped()
+{
+    return liveDropped;
+}
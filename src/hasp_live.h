@@ -0,0 +1,18 @@
+#ifndef HASP_LIVE_H
+#define HASP_LIVE_H
+
+#include "lvgl.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+
+void liveStart(WiFiClient & client);
+void liveLoop(void);
+void liveFlush(const lv_area_t * area, const lv_color_t * color_p, lv_coord_t stride);
+
+uint32_t liveGetDropped(void);
+
+#endif
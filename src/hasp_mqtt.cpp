@@ -10,13 +10,24 @@
 #endif
 #include <PubSubClient.h>
 
+#include "hasp_conf.h"
 #include "hasp_log.h"
 #include "hasp_hal.h"
 #include "hasp_debug.h"
 #include "hasp_config.h"
 #include "hasp_mqtt.h"
+#include "hasp_mqtt_backoff.h"
+#include "hasp_queue.h"
 #include "hasp_wifi.h"
 #include "hasp_dispatch.h"
+#include "hasp_gui.h"
+#include "lv_zifont.h"
+#include "hasp_font.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
+#include "hasp_touch.h"
+#include "hasp_trace.h"
+#include "hasp_record.h"
 #include "hasp.h"
 
 #ifdef USE_CONFIG_OVERRIDE
@@ -56,6 +67,15 @@ String mqttNodeTopic((char *)0);
 String mqttGroupTopic((char *)0);
 bool mqttEnabled;
 
+/* Reconnect backoff, randomized per plate so a fleet does not reconnect in lockstep after a broker restart */
+static mqtt_backoff_t mqttRetry;
+
+/* Message counters, since boot */
+static uint32_t mqttMsgIn       = 0;
+static uint32_t mqttMsgOut      = 0;
+static uint32_t mqttConnects    = 0;
+static uint32_t mqttConnectFail = 0;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // These defaults may be overwritten with values saved by the web interface
 #ifdef MQTT_HOST
@@ -87,24 +107,63 @@ const String mqttLightBrightSubscription  = "hasp/" + String(haspGetNodename())
 WiFiClient mqttWifiClient;
 PubSubClient mqttClient(mqttWifiClient);
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-// Send changed values OUT
+#if HASP_USE_TASKS
+/* Outgoing states, queued by the gui task and published by the network task */
+typedef struct
+{
+    String subtopic;
+    String payload;
+    uint32_t touched; // time of the touch sample that caused the state, 0 if not caused by a touch
+} mqtt_queue_item_t;
+static HaspQueue<mqtt_queue_item_t, 16> mqttOutQueue;
+static TaskHandle_t mqttTask   = NULL; // the task running mqttLoop
+static uint32_t mqttOutDropped = 0;
+#endif
 
-void IRAM_ATTR mqttSendState(const char * subtopic, const char * payload)
+/* Connection settings used by mqttReconnect, a copy owned by the task running mqttLoop */
+typedef struct
 {
-    // page = 0
-    // p[0].b[0].attr = abc
-    // dim = 100
-    // idle = 0/1
-    // light = 0/1
-    // brightness = 100
+    char server[16];
+    uint16_t port;
+    char user[23];
+    char password[32];
+    char node[16];
+    char group[16];
+} mqtt_config_t;
+static mqtt_config_t mqttConn;
+static std::atomic<bool> mqttStopped{false}; // set by the task running mqttLoop once the client is stopped
+
+#if HASP_USE_TASKS
+/**
+ * PubSubClient is not thread-safe and keeps a pointer to the server name, so the gui task never touches
+ * mqttClient or mqttConn. It queues stop and config requests for the network task instead.
+ */
+enum mqtt_control_type_t {
+    MQTT_CONTROL_CONFIG = 0,
+    MQTT_CONTROL_STOP,
+};
+typedef struct
+{
+    uint8_t type;
+    mqtt_config_t config;
+} mqtt_control_t;
+static HaspQueue<mqtt_control_t, 4> mqttControlQueue;
+static SemaphoreHandle_t mqttControlMutex = NULL;  // mqttStop is also called from the wifi event task
+static std::atomic<bool> mqttConnected{false};     // connection state for the other tasks
+static bool mqttSetupDone                 = false; // requests are queued once the network task may run
+#endif
 
-    // char mqttPayload[128 * 5];
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Send changed values OUT
 
+static void mqttPublishState(const char * subtopic, const char * payload, uint32_t touched)
+{
     if(mqttClient.connected()) {
         char mqttTopic[128];
         snprintf_P(mqttTopic, sizeof(mqttTopic), PSTR("%sstate/%s"), mqttNodeTopic.c_str(), subtopic);
         mqttClient.publish(mqttTopic, payload);
+        mqttMsgOut++;
+        if(touched) traceAdd(TRACE_TOUCH_PUBLISH, micros() - touched);
 
         String msg((char *)0);
         msg.reserve(512);
@@ -116,6 +175,54 @@ void IRAM_ATTR mqttSendState(const char * subtopic, const char * payload)
     } else {
         errorPrintln(F("MQTT: %sNot connected"));
     }
+}
+
+void IRAM_ATTR mqttSendState(const char * subtopic, const char * payload)
+{
+    // page = 0
+    // p[0].b[0].attr = abc
+    // dim = 100
+    // idle = 0/1
+    // light = 0/1
+    // brightness = 100
+
+    /* lvgl sets the active input device while it processes a touch, so the state is a result of that touch */
+    uint32_t touched = lv_indev_get_act() ? touchGetLastReadTime() : 0;
+
+    /* A replay only reproduces the load of the plate, the broker never sees the replayed states */
+    if(recordIsReplaying()) {
+        if(touched) traceAdd(TRACE_TOUCH_PUBLISH, micros() - touched);
+        recordMqttOut(subtopic, payload);
+        return;
+    }
+
+#if HASP_USE_TASKS
+    if(xTaskGetCurrentTaskHandle() != mqttTask) {
+        /* Without mqtt the network task never drains the queue */
+        if(!mqttEnabled) {
+            recordMqttOut(subtopic, payload);
+            return;
+        }
+
+        /* Called from the gui task, the network task publishes it. Never wait for the network here. */
+        mqtt_queue_item_t * item = mqttOutQueue.back();
+        if(!item) {
+            mqttOutDropped++;
+            errorPrintln(F("MQTT: %sOutgoing queue full"));
+            return;
+        }
+        item->subtopic = subtopic;
+        item->payload  = payload;
+        item->touched  = touched;
+        mqttOutQueue.push();
+        recordMqttOut(subtopic, payload);
+        return;
+    }
+#else
+    recordMqttOut(subtopic, payload);
+#endif
+
+    mqttPublishState(subtopic, payload, touched);
 
     // as json
     // snprintf_P(mqttTopic, sizeof(mqttTopic), PSTR("%sstate/json"), mqttNodeTopic.c_str());
@@ -198,6 +305,122 @@ void mqttStatusUpdate()
     mqttStatusPayload += F("\"heapFragmentation\":");
     mqttStatusPayload += String(halGetHeapFragmentation());
     mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"mqttMsgIn\":");
+    mqttStatusPayload += String(mqttMsgIn);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"mqttMsgOut\":");
+    mqttStatusPayload += String(mqttMsgOut);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"mqttReconnects\":");
+    mqttStatusPayload += String(mqttConnects > 0 ? mqttConnects - 1 : 0);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"mqttConnectFailures\":");
+    mqttStatusPayload += String(mqttConnectFail);
+    mqttStatusPayload += F(",");
+    lv_zifont_cache_stats_t fontStats;
+    lv_zifont_get_cache_stats(&fontStats);
+    mqttStatusPayload += F("\"fontCacheHitRate\":");
+    mqttStatusPayload += String(fontStats.hits + fontStats.misses > 0
+                                    ? fontStats.hits * 100 / (fontStats.hits + fontStats.misses)
+                                    : 0);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontCacheUsed\":");
+    mqttStatusPayload += String(fontStats.used);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontDecodeTime\":");
+    mqttStatusPayload += String(fontStats.decode_time);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontDecodePixels\":");
+    mqttStatusPayload += String(fontStats.decode_pixels);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontFileOpens\":");
+    mqttStatusPayload += String(fontStats.file_opens);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontFileBytes\":");
+    mqttStatusPayload += String(fontStats.file_bytes);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontsLoaded\":");
+    mqttStatusPayload += String(fontGetCount());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"fontMemory\":");
+    mqttStatusPayload += String(fontGetMemory());
+    mqttStatusPayload += F(",");
+    text_stats_t textStats;
+    textGetStats(&textStats);
+    mqttStatusPayload += F("\"textCacheHitRate\":");
+    mqttStatusPayload += String(
+        textStats.hits + textStats.misses > 0 ? textStats.hits * 100 / (textStats.hits + textStats.misses) : 0);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"textLayoutTime\":");
+    mqttStatusPayload += String(textStats.layout_time);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"textSetSkipped\":");
+    mqttStatusPayload += String(textStats.skipped);
+    mqttStatusPayload += F(",");
+#if HASP_USE_GLYPH_TILES > 0
+    tile_stats_t tileStats;
+    tileGetStats(&tileStats);
+    mqttStatusPayload += F("\"tileCacheHitRate\":");
+    mqttStatusPayload += String(
+        tileStats.hits + tileStats.misses > 0 ? tileStats.hits * 100 / (tileStats.hits + tileStats.misses) : 0);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"tileCacheUsed\":");
+    mqttStatusPayload += String(tileStats.used);
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"tileFallbacks\":");
+    mqttStatusPayload += String(tileStats.fallbacks);
+    mqttStatusPayload += F(",");
+#endif
+    mqttStatusPayload += F("\"guiFps\":");
+    mqttStatusPayload += String(guiGetFps());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"guiRefrPeriod\":");
+    mqttStatusPayload += String(guiGetRefrPeriod());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"guiReadPeriod\":");
+    mqttStatusPayload += String(guiGetReadPeriod());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"touchBusTransactions\":");
+    mqttStatusPayload += String(touchGetBusRate());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"pageCacheHitRate\":");
+    mqttStatusPayload += String(guiGetPageCacheHitRate());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"pageLatency\":");
+    mqttStatusPayload += String(guiGetPageLatency());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"queuePeak\":");
+    mqttStatusPayload += String(dispatchGetQueuePeak());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"queueApplyTime\":");
+    mqttStatusPayload += String(dispatchGetApplyPeak());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"queueDuplicates\":");
+    mqttStatusPayload += String(dispatchGetDuplicates());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"touchLatency\":[");
+    mqttStatusPayload += String(tracePercentile(TRACE_TOUCH_PUBLISH, 50));
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += String(tracePercentile(TRACE_TOUCH_PUBLISH, 95));
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += String(tracePercentile(TRACE_TOUCH_PUBLISH, 99));
+    mqttStatusPayload += F("],");
+    mqttStatusPayload += F("\"cmdLatency\":[");
+    mqttStatusPayload += String(tracePercentile(TRACE_COMMAND_FLUSH, 50));
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += String(tracePercentile(TRACE_COMMAND_FLUSH, 95));
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += String(tracePercentile(TRACE_COMMAND_FLUSH, 99));
+    mqttStatusPayload += F("],");
+    mqttStatusPayload += F("\"guiFramesSkipped\":");
+    mqttStatusPayload += String(guiGetFramesSkipped());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"guiTimeSavedEstimate\":");
+    mqttStatusPayload += String(guiEstimateTimeSaved());
+    mqttStatusPayload += F(",");
+    mqttStatusPayload += F("\"guiSuspendFailed\":");
+    mqttStatusPayload += String(guiGetSuspendFailed());
+    mqttStatusPayload += F(",");
     mqttStatusPayload += F("\"espCore\":\"");
     mqttStatusPayload += halGetCoreVersion();
     mqttStatusPayload += F("\"");
@@ -213,6 +436,13 @@ void mqttStatusUpdate()
     // mqttClient.publish(mqttSensorTopic, mqttStatusPayload);
     // mqttClient.publish(mqttStatusTopic, "ON", true); //, 1);
     mqttSendState(String(F("statusupdate")).c_str(), mqttStatusPayload.c_str());
+    dispatchResetStats();
+
+    /* Latency percentiles in ms since the previous status update */
+    char latency[192];
+    traceGetJson(latency, sizeof(latency));
+    mqttSendState(String(F("latency")).c_str(), latency);
+    if(!recordIsReplaying()) traceReset(); // the replay reports the percentiles of the whole run
 
     // debugPrintln(String(F("MQTT: status update: ")) + String(mqttStatusPayload));
     // debugPrintln(String(F("MQTT: binary_sensor state: [")) + mqttStatusTopic + "] : [ON]");
@@ -224,6 +454,7 @@ void mqttCallback(char * topic, byte * payload, unsigned int length)
 { // Handle incoming commands from MQTT
     payload[length] = '\0';
     String strTopic = topic;
+    mqttMsgIn++;
 
     // strTopic: homeassistant/haswitchplate/devicename/command/p[1].b[4].txt
     // strPayload: "Lights On"
@@ -255,8 +486,9 @@ void mqttCallback(char * topic, byte * payload, unsigned int length)
     }
     // debugPrintln(String(F("MQTT Short Topic : '")) + strTopic + "'");
 
+    /* Commands are applied by dispatchLoop, right before the next gui refresh */
     if(strTopic == F("command")) {
-        dispatchCommand((char *)payload);
+        dispatchEnqueue(DISPATCH_COMMAND, strTopic, (char *)payload);
         return;
     }
 
@@ -266,14 +498,14 @@ void mqttCallback(char * topic, byte * payload, unsigned int length)
 
         if(strTopic == F("json")) { // '[...]/device/command/json' -m '["dim=5", "page 1"]' =
             // nextionSendCmd("dim=50"), nextionSendCmd("page 1")
-            dispatchJson((char *)payload); // Send to nextionParseJson()
+            dispatchEnqueue(DISPATCH_JSON, strTopic, (char *)payload); // Send to nextionParseJson()
         } else if(strTopic == F("jsonl")) {
-            dispatchJsonl((char *)payload);
+            dispatchEnqueue(DISPATCH_JSONL, strTopic, (char *)payload);
         } else if(length == 0) {
-            dispatchCommand(strTopic.c_str());
+            dispatchEnqueue(DISPATCH_COMMAND, strTopic, strTopic.c_str());
         } else { // '[...]/device/command/p[1].b[4].txt' -m '"Lights On"' ==
                  // nextionSetAttr("p[1].b[4].txt", "\"Lights On\"")
-            dispatchAttribute(strTopic, (char *)payload);
+            dispatchEnqueue(DISPATCH_ATTRIBUTE, strTopic, (char *)payload);
         }
         return;
     }
@@ -311,8 +543,7 @@ void mqttCallback(char * topic, byte * payload, unsigned int length)
 
 void mqttReconnect()
 {
-    static uint8_t mqttReconnectCount = 0;
-    bool mqttFirstConnect             = true;
+    bool mqttFirstConnect = true;
     String nodeName((char *)0);
     nodeName.reserve(128);
     nodeName = haspGetNodename();
@@ -325,31 +556,33 @@ void mqttReconnect()
     mqttClientId += wifiGetMacAddress(3, "");
     WiFi.macAddress();
 
-    snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("hasp/%s/"), mqttNodeName);
+    snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("hasp/%s/"), mqttConn.node);
     mqttNodeTopic = topicBuffer;
-    snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("hasp/%s/"), mqttGroupName);
+    snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("hasp/%s/"), mqttConn.group);
     mqttGroupTopic = topicBuffer;
 
     // haspSetPage(0);
     snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("MQTT: Attempting connection to broker %s as clientID %s"),
-               mqttServer, mqttClientId.c_str());
+               mqttConn.server, mqttClientId.c_str());
     debugPrintln(topicBuffer);
 
     // Attempt to connect and set LWT and Clean Session
     snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("%sstatus"), mqttNodeTopic.c_str());
-    if(!mqttClient.connect(mqttClientId.c_str(), mqttUser, mqttPassword, topicBuffer, 0, false, "OFF", true)) {
-        // Retry until we give up and restart after connectTimeout seconds
-        mqttReconnectCount++;
-
-        Serial.print(String(F("failed, rc=")));
-        Serial.print(mqttClient.state());
-        // Wait 5 seconds before retrying
-        // delay(50);
+    if(!mqttClient.connect(mqttClientId.c_str(), mqttConn.user, mqttConn.password, topicBuffer, 0, false, "OFF",
+                           true)) {
+        // Retry with an increasing delay
+        mqttConnectFail++;
+        uint32_t delay = mqttBackoffFailed(&mqttRetry);
+
+        snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("MQTT: %%sConnection failed, rc=%d, retry in %u ms"),
+                   mqttClient.state(), delay);
+        warningPrintln(topicBuffer);
         return;
     }
+    mqttConnects++;
 
     debugPrintln(F("MQTT: MQTT Client is Connected"));
-    haspReconnect();
+    dispatchEnqueue(DISPATCH_RECONNECT, "", ""); // update the gui from the gui task
 
     /*
         // MQTT topic string definitions
@@ -415,22 +648,84 @@ void mqttReconnect()
                mqttNodeTopic.c_str(), mqttFirstConnect ? PSTR("OFF") : PSTR("ON"));
     debugPrintln(topicBuffer);
 
-    mqttFirstConnect   = false;
-    mqttReconnectCount = 0;
+    mqttFirstConnect = false;
+}
+
+/* Copy the settings into the connection settings, on the task running mqttLoop */
+static void mqttApplyConfig(const mqtt_config_t * config)
+{
+    mqttConn = *config;
+    if(strlen(mqttConn.server) > 0) mqttClient.setServer(mqttConn.server, mqttConn.port);
 }
 
+/* Publish the offline state and disconnect, on the task running mqttLoop */
+static void mqttStopClient()
+{
+    if(mqttClient.connected()) {
+        char topicBuffer[128];
+
+        snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("%sstatus"), mqttNodeTopic.c_str());
+        mqttClient.publish(topicBuffer, "OFF");
+
+        snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("%ssensor"), mqttNodeTopic.c_str());
+        mqttClient.publish(topicBuffer, "{\"status\": \"unavailable\"}");
+
+        mqttClient.disconnect();
+        debugPrintln(F("MQTT: Disconnected from broker"));
+    }
+    mqttStopped = true;
+}
+
+#if HASP_USE_TASKS
+/* Queue a request for the network task, false if the queue is full */
+static bool mqttControlEnqueue(uint8_t type, const mqtt_config_t * config)
+{
+    if(mqttControlMutex) xSemaphoreTake(mqttControlMutex, portMAX_DELAY);
+    mqtt_control_t * item = mqttControlQueue.back();
+    if(item) {
+        item->type = type;
+        if(config) item->config = *config;
+        mqttControlQueue.push();
+    }
+    if(mqttControlMutex) xSemaphoreGive(mqttControlMutex);
+
+    if(!item) errorPrintln(F("MQTT: %sControl queue full"));
+    return item != NULL;
+}
+
+/* Apply the requests of the other tasks */
+static void mqttControlLoop()
+{
+    mqtt_control_t * item;
+    while((item = mqttControlQueue.front()) != NULL) {
+        if(item->type == MQTT_CONTROL_CONFIG) {
+            mqttApplyConfig(&item->config);
+        } else if(item->type == MQTT_CONTROL_STOP) {
+            mqttStopClient();
+        }
+        mqttControlQueue.pop();
+    }
+}
+#endif
+
 void mqttSetup(const JsonObject & settings)
 {
     mqttClientId.reserve(128);
     mqttNodeTopic.reserve(128);
     mqttGroupTopic.reserve(128);
 
+#if HASP_USE_TASKS
+    if(!mqttControlMutex) mqttControlMutex = xSemaphoreCreateMutex(); // before the network task is started
+#endif
+
     mqttSetConfig(settings);
 
     mqttEnabled = strcmp(mqttServer, "") != 0 && mqttPort > 0;
+#if HASP_USE_TASKS
+    mqttSetupDone = true;
+#endif
     if(!mqttEnabled) return;
 
-    mqttClient.setServer(mqttServer, 1883);
     mqttClient.setCallback(mqttCallback);
 
     debugPrintln(F("MQTT: Setup Complete"));
@@ -438,12 +733,40 @@ void mqttSetup(const JsonObject & settings)
 
 void mqttLoop(bool wifiIsConnected)
 {
-    if(!mqttEnabled) return;
+#if HASP_USE_TASKS
+    mqttTask = xTaskGetCurrentTaskHandle();
+    mqttControlLoop();
+#endif
 
-    if(wifiIsConnected && !mqttClient.connected())
-        mqttReconnect();
-    else
+    if(!mqttEnabled || mqttStopped) return;
+
+    if(mqttRetry.random == 0) {
+        uint8_t mac[6];
+        WiFi.macAddress(mac);
+        mqttBackoffSeed(&mqttRetry, mac);
+    }
+
+    if(wifiIsConnected && !mqttClient.connected()) {
+        if(mqttBackoffDue(&mqttRetry, millis())) mqttReconnect();
+    } else {
         mqttClient.loop();
+
+        /* Spread the first attempt of all plates over a window when the broker goes away */
+        mqttBackoffConnected(&mqttRetry, millis());
+    }
+
+#if HASP_USE_TASKS
+    /* Publish the states queued by the gui task */
+    mqtt_queue_item_t * item;
+    while((item = mqttOutQueue.front()) != NULL) {
+        mqttPublishState(item->subtopic.c_str(), item->payload.c_str(), item->touched);
+        item->subtopic = "";
+        item->payload  = "";
+        mqttOutQueue.pop();
+    }
+
+    mqttConnected = mqttClient.connected();
+#endif
 }
 
 String mqttGetNodename()
@@ -453,23 +776,26 @@ String mqttGetNodename()
 
 bool mqttIsConnected()
 {
+#if HASP_USE_TASKS
+    return mqttConnected;
+#else
     return mqttClient.connected();
+#endif
 }
 
 void mqttStop()
 {
-    if(mqttClient.connected()) {
-        char topicBuffer[128];
+#if HASP_USE_TASKS
+    if(mqttSetupDone && xTaskGetCurrentTaskHandle() != mqttTask) {
+        if(!mqttControlEnqueue(MQTT_CONTROL_STOP, NULL)) return;
 
-        snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("%sstatus"), mqttNodeTopic.c_str());
-        mqttClient.publish(topicBuffer, "OFF");
-
-        snprintf_P(topicBuffer, sizeof(topicBuffer), PSTR("%ssensor"), mqttNodeTopic.c_str());
-        mqttClient.publish(topicBuffer, "{\"status\": \"unavailable\"}");
-
-        mqttClient.disconnect();
-        debugPrintln(F("MQTT: Disconnected from broker"));
+        /* The network task may be busy in a connect attempt, do not hold up the reboot for long */
+        for(uint8_t i = 0; i < 100 && !mqttStopped; i++) delay(10);
+        if(!mqttStopped) warningPrintln(F("MQTT: %sNetwork task did not stop the client in time"));
+        return;
     }
+#endif
+    mqttStopClient();
 }
 
 bool mqttGetConfig(const JsonObject & settings)
@@ -526,5 +852,22 @@ bool mqttSetConfig(const JsonObject & settings)
         strncpy(mqttPassword, settings[FPSTR(F_CONFIG_PASS)], sizeof(mqttPassword));
     }
 
+    /* Hand a copy of the settings to the task running mqttLoop */
+    mqtt_config_t config;
+    strncpy(config.server, mqttServer, sizeof(config.server));
+    config.port = mqttPort;
+    strncpy(config.user, mqttUser, sizeof(config.user));
+    strncpy(config.password, mqttPassword, sizeof(config.password));
+    strncpy(config.node, mqttNodeName, sizeof(config.node));
+    strncpy(config.group, mqttGroupName, sizeof(config.group));
+
+#if HASP_USE_TASKS
+    if(mqttSetupDone) {
+        mqttControlEnqueue(MQTT_CONTROL_CONFIG, &config);
+        return changed;
+    }
+#endif
+    mqttApplyConfig(&config);
+
     return changed;
 }
@@ -0,0 +1,46 @@
+#include "hasp_mqtt_backoff.h"
+
+/* Plain code without the mqtt client, so the native fleet simulation runs the same policy for every plate */
+
+/* Seed the random generator with the fnv-1a hash of the mac address, every plate gets its own sequence */
+void mqttBackoffSeed(mqtt_backoff_t * backoff, const uint8_t * mac)
+{
+    backoff->random = 2166136261u;
+    for(uint8_t i = 0; i < 6; i++) backoff->random = (backoff->random ^ mac[i]) * 16777619u;
+    if(backoff->random == 0) backoff->random = 1;
+}
+
+/* xorshift32 */
+uint32_t mqttBackoffRandom(mqtt_backoff_t * backoff)
+{
+    backoff->random ^= backoff->random << 13;
+    backoff->random ^= backoff->random >> 17;
+    backoff->random ^= backoff->random << 5;
+    return backoff->random;
+}
+
+/* Called while connected: when the broker goes away, the first attempt is spread over a window */
+void mqttBackoffConnected(mqtt_backoff_t * backoff, uint32_t now)
+{
+    backoff->last_attempt = now;
+    backoff->delay        = mqttBackoffRandom(backoff) % MQTT_RECONNECT_SPREAD;
+    backoff->failed       = 0;
+}
+
+/* Check if a reconnect attempt is due at now, and if so count it as started */
+bool mqttBackoffDue(mqtt_backoff_t * backoff, uint32_t now)
+{
+    if(now - backoff->last_attempt < backoff->delay) return false;
+    backoff->last_attempt = now;
+    return true;
+}
+
+/* Exponential backoff with equal jitter: half of the delay is fixed, the other half random. Returns the delay */
+uint32_t mqttBackoffFailed(mqtt_backoff_t * backoff)
+{
+    uint32_t delay = (uint32_t)MQTT_RECONNECT_MIN << (backoff->failed > 6 ? 6 : backoff->failed);
+    if(delay > MQTT_RECONNECT_MAX) delay = MQTT_RECONNECT_MAX;
+    backoff->delay = delay / 2 + mqttBackoffRandom(backoff) % (delay / 2);
+    if(backoff->failed < 255) backoff->failed++;
+    return backoff->delay;
+}
@@ -0,0 +1,25 @@
+#ifndef HASP_MQTT_BACKOFF_H
+#define HASP_MQTT_BACKOFF_H
+
+#include <stdint.h>
+
+#define MQTT_RECONNECT_MIN 1000    // ms, first retry delay after a failed attempt
+#define MQTT_RECONNECT_MAX 60000   // ms, longest retry delay
+#define MQTT_RECONNECT_SPREAD 5000 // ms, window for the first attempt after the connection was lost
+
+/* Reconnect backoff of one plate, randomized per plate so a fleet does not reconnect in lockstep */
+typedef struct
+{
+    uint32_t random;       // xorshift32 state, 0 until seeded
+    uint32_t last_attempt; // ms
+    uint32_t delay;        // ms from the last attempt to the next one
+    uint8_t failed;        // failed attempts since the last connection
+} mqtt_backoff_t;
+
+void mqttBackoffSeed(mqtt_backoff_t * backoff, const uint8_t * mac);
+uint32_t mqttBackoffRandom(mqtt_backoff_t * backoff);
+void mqttBackoffConnected(mqtt_backoff_t * backoff, uint32_t now);
+bool mqttBackoffDue(mqtt_backoff_t * backoff, uint32_t now);
+uint32_t mqttBackoffFailed(mqtt_backoff_t * backoff);
+
+#endif
@@ -0,0 +1,109 @@
+#include <string.h>
+
+#include "hasp_qoi.h"
+
+/* Plain code without the display driver, so the native tests can check the encoder */
+
+static void qoiFlush(qoi_encoder_t * qoi)
+{
+    if(qoi->len == 0) return;
+    qoi->write(qoi->out, qoi->len);
+    qoi->size += qoi->len;
+    qoi->len = 0;
+}
+
+static inline void qoiPut(qoi_encoder_t * qoi, uint8_t data)
+{
+    qoi->out[qoi->len++] = data;
+}
+
+static inline void qoiPutRun(qoi_encoder_t * qoi)
+{
+    if(qoi->run == 0) return;
+    qoiPut(qoi, 0xC0 | (qoi->run - 1)); // QOI_OP_RUN
+    qoi->run = 0;
+}
+
+static void qoiPut32(qoi_encoder_t * qoi, uint32_t value)
+{
+    qoiPut(qoi, (value >> 24) & 0xFF);
+    qoiPut(qoi, (value >> 16) & 0xFF);
+    qoiPut(qoi, (value >> 8) & 0xFF);
+    qoiPut(qoi, value & 0xFF);
+}
+
+/* Reset the encoder and write the header: magic, width, height, channels and colorspace */
+void qoiStart(qoi_encoder_t * qoi, qoi_write_cb_t write, uint32_t width, uint32_t height)
+{
+    memset(qoi, 0, sizeof(qoi_encoder_t));
+    qoi->write = write;
+    qoi->prev  = 0xFF000000;
+
+    qoiPut(qoi, 'q');
+    qoiPut(qoi, 'o');
+    qoiPut(qoi, 'i');
+    qoiPut(qoi, 'f');
+    qoiPut32(qoi, width);
+    qoiPut32(qoi, height);
+    qoiPut(qoi, 3); // RGB
+    qoiPut(qoi, 0); // sRGB with linear alpha
+}
+
+/* Compress RGB565 pixels to the QOI stream, without alpha channel */
+void qoiEncodeRgb565(qoi_encoder_t * qoi, const uint16_t * pixels, size_t len)
+{
+    while(len--) {
+        uint8_t r   = *pixels >> 11;
+        uint8_t g   = (*pixels >> 5) & 0x3F;
+        uint8_t b   = *pixels & 0x1F;
+        r           = (r << 3) | (r >> 2);
+        g           = (g << 2) | (g >> 4);
+        b           = (b << 3) | (b >> 2);
+        uint32_t px = 0xFF000000 | (r << 16) | (g << 8) | b;
+        pixels++;
+
+        if(qoi->len > sizeof(qoi->out) - 5) qoiFlush(qoi);
+
+        if(px == qoi->prev) {
+            if(++qoi->run == 62) qoiPutRun(qoi);
+            continue;
+        }
+        qoiPutRun(qoi);
+
+        uint8_t hash = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+        if(qoi->index[hash] == px) {
+            qoiPut(qoi, hash); // QOI_OP_INDEX
+        } else {
+            qoi->index[hash] = px;
+
+            int8_t dr   = r - ((qoi->prev >> 16) & 0xFF);
+            int8_t dg   = g - ((qoi->prev >> 8) & 0xFF);
+            int8_t db   = b - (qoi->prev & 0xFF);
+            int8_t dr_g = dr - dg;
+            int8_t db_g = db - dg;
+
+            if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                qoiPut(qoi, 0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)); // QOI_OP_DIFF
+            } else if(dg >= -32 && dg <= 31 && dr_g >= -8 && dr_g <= 7 && db_g >= -8 && db_g <= 7) {
+                qoiPut(qoi, 0x80 | (dg + 32)); // QOI_OP_LUMA
+                qoiPut(qoi, (dr_g + 8) << 4 | (db_g + 8));
+            } else {
+                qoiPut(qoi, 0xFE); // QOI_OP_RGB
+                qoiPut(qoi, r);
+                qoiPut(qoi, g);
+                qoiPut(qoi, b);
+            }
+        }
+        qoi->prev = px;
+    }
+}
+
+/* Close the pending run, write the end marker and flush the output buffer */
+void qoiFinish(qoi_encoder_t * qoi)
+{
+    if(qoi->len > sizeof(qoi->out) - 9) qoiFlush(qoi);
+    qoiPutRun(qoi);
+    for(uint8_t i = 0; i < 7; i++) qoiPut(qoi, 0x00);
+    qoiPut(qoi, 0x01);
+    qoiFlush(qoi);
+}
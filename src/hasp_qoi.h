@@ -0,0 +1,25 @@
+#ifndef HASP_QOI_H
+#define HASP_QOI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*qoi_write_cb_t)(const uint8_t * data, uint16_t len);
+
+/* QOI image encoder state, see https://qoiformat.org */
+typedef struct
+{
+    uint32_t index[64];   // previously seen pixels, 0xFFRRGGBB
+    uint32_t prev;        // previous pixel, 0xFFRRGGBB
+    uint8_t run;          // number of repeats of the previous pixel
+    uint16_t len;         // bytes in the output buffer
+    uint32_t size;        // total bytes written
+    qoi_write_cb_t write; // receives the output buffer when it is full
+    uint8_t out[512];     // output buffer
+} qoi_encoder_t;
+
+void qoiStart(qoi_encoder_t * qoi, qoi_write_cb_t write, uint32_t width, uint32_t height);
+void qoiEncodeRgb565(qoi_encoder_t * qoi, const uint16_t * pixels, size_t len);
+void qoiFinish(qoi_encoder_t * qoi);
+
+#endif
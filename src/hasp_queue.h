@@ -0,0 +1,53 @@
+#ifndef HASP_QUEUE_H
+#define HASP_QUEUE_H
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free queue for one producer and one consumer task.
+ * The producer fills the slot returned by back() and publishes it with push(),
+ * the consumer reads the slot returned by front() and releases it with pop().
+ * SIZE must be a power of 2, up to 128.
+ */
+template <typename T, uint8_t SIZE> class HaspQueue {
+  public:
+    /* Producer side: free slot to fill, NULL when the queue is full */
+    T * back()
+    {
+        uint8_t head = _head.load(std::memory_order_relaxed);
+        if((uint8_t)(head - _tail.load(std::memory_order_acquire)) >= SIZE) return NULL;
+        return &_items[head & (SIZE - 1)];
+    }
+
+    void push()
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* Consumer side: the i-th oldest slot, NULL when there are not that many */
+    T * front(uint8_t i = 0)
+    {
+        uint8_t tail = _tail.load(std::memory_order_relaxed);
+        if(i >= (uint8_t)(_head.load(std::memory_order_acquire) - tail)) return NULL;
+        return &_items[(tail + i) & (SIZE - 1)];
+    }
+
+    void pop()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /* Number of queued slots, only exact when called from the producer or consumer */
+    uint8_t size()
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    T _items[SIZE];
+    std::atomic<uint8_t> _head{0};
+    std::atomic<uint8_t> _tail{0};
+};
+
+#endif
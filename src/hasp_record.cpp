@@ -0,0 +1,352 @@
+#include "Arduino.h"
+#include "lvgl.h"
+
+#include "hasp_conf.h"
+#include "hasp_log.h"
+#include "hasp_debug.h"
+#include "hasp_hal.h"
+#include "hasp_dispatch.h"
+#include "hasp_http.h"
+#include "hasp_mqtt.h"
+#include "hasp_touch.h"
+#include "hasp_trace.h"
+#include "hasp_record.h"
+
+#if HASP_USE_SPIFFS
+#if defined(ARDUINO_ARCH_ESP32)
+#include "SPIFFS.h"
+#endif
+#include <FS.h> // Include the SPIFFS library
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define RECORD_MAX_DATA 2048u // largest event, longer mqtt messages are not recorded
+#else
+#define RECORD_MAX_DATA 1024u
+#endif
+#define RECORD_BUFFER_SIZE 1024u // events collected in ram before they are written to the file
+#define RECORD_VERSION 1
+
+/* The log starts with "HREC", the version byte and the screen width and height as uint16_t.
+ * Every event follows as a record_event_t header and len bytes of data:
+ *   REC_TOUCH     arg = pressed, data = x, y as int16_t
+ *   REC_MQTT_IN   arg = dispatch_queue_type_t, data = topic \0 payload
+ *   REC_MQTT_OUT  data = subtopic \0 payload
+ *   REC_HTTP      arg = HTTPMethod, data = uri \0 and the arguments as name \0 value \0 pairs
+ * All values are little endian, times are ms since the start of the recording. */
+enum record_type_t {
+    REC_TOUCH = 0,
+    REC_MQTT_IN,
+    REC_MQTT_OUT,
+    REC_HTTP,
+};
+
+typedef struct
+{
+    uint32_t time;
+    uint8_t type;
+    uint8_t arg;
+    uint16_t len;
+} record_event_t;
+
+enum record_state_t {
+    RECORD_IDLE = 0,
+    RECORD_RECORDING,
+    RECORD_REPLAYING,
+};
+
+static File recordFile;
+static uint8_t recordState = RECORD_IDLE;
+static uint32_t recordStartTime; // millis() at the start of the recording or replay
+static uint8_t * recordBuffer = NULL;
+static size_t recordLen       = 0;
+static uint32_t recordEvents  = 0;
+static uint32_t recordSkipped = 0; // events too large to record
+
+/* Replay statistics */
+static record_event_t replayNext; // next event to replay, its data is in recordBuffer
+static uint32_t replayFrames;
+static uint32_t replayFrameTime; // sum of the render times, in ms
+static uint32_t replayFrameMax;
+static uint32_t replayPixels;
+static uint32_t replayOutExpected; // states published during the recording
+static uint32_t replayOut;         // states the replay would have published
+static uint32_t replayHttp;        // requests replayed
+static uint32_t replayHttpSkipped; // requests not replayed because of their side effects
+static uint32_t replayHeapMin;
+static uint32_t replayLvMemMin;
+
+static void recordFlush()
+{
+    if(recordLen > 0) recordFile.write(recordBuffer, recordLen);
+    recordLen = 0;
+}
+
+static void recordWrite(uint8_t type, uint8_t arg, const void * data1, size_t len1, const void * data2, size_t len2)
+{
+    if(recordState != RECORD_RECORDING) return;
+
+    size_t len = len1 + len2;
+    if(len > RECORD_MAX_DATA) {
+        recordSkipped++;
+        return;
+    }
+    if(recordLen + sizeof(record_event_t) + len > RECORD_BUFFER_SIZE) recordFlush();
+
+    record_event_t event;
+    event.time = millis() - recordStartTime;
+    event.type = type;
+    event.arg  = arg;
+    event.len  = len;
+
+    if(sizeof(record_event_t) + len > RECORD_BUFFER_SIZE) {
+        /* Does not fit in the buffer, write it directly */
+        recordFile.write((uint8_t *)&event, sizeof(event));
+        recordFile.write((const uint8_t *)data1, len1);
+        recordFile.write((const uint8_t *)data2, len2);
+    } else {
+        memcpy(recordBuffer + recordLen, &event, sizeof(event));
+        memcpy(recordBuffer + recordLen + sizeof(event), data1, len1);
+        memcpy(recordBuffer + recordLen + sizeof(event) + len1, data2, len2);
+        recordLen += sizeof(event) + len;
+    }
+    recordEvents++;
+}
+
+static bool recordOpen(const char * filename, const char * mode)
+{
+    if(recordState != RECORD_IDLE) recordStop();
+
+    recordBuffer = (uint8_t *)malloc(max(RECORD_BUFFER_SIZE, RECORD_MAX_DATA) + 1);
+    recordFile   = SPIFFS.open(filename, mode);
+
+    if(!recordBuffer || !recordFile) {
+        char buffer[128];
+        snprintf_P(buffer, sizeof(buffer), PSTR("REC: %%sCould not open %s"), filename);
+        errorPrintln(buffer);
+        if(recordFile) recordFile.close();
+        free(recordBuffer);
+        recordBuffer = NULL;
+        return false;
+    }
+
+    recordLen       = 0;
+    recordEvents    = 0;
+    recordSkipped   = 0;
+    recordStartTime = millis();
+    return true;
+}
+
+void recordStart(const char * filename)
+{
+    if(!recordOpen(filename, "w")) return;
+
+    uint16_t header[2] = {(uint16_t)lv_disp_get_hor_res(NULL), (uint16_t)lv_disp_get_ver_res(NULL)};
+    uint8_t version    = RECORD_VERSION;
+    recordFile.write((const uint8_t *)"HREC", 4);
+    recordFile.write(&version, 1);
+    recordFile.write((uint8_t *)header, sizeof(header));
+    recordState = RECORD_RECORDING;
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("REC: Recording to %s"), filename);
+    debugPrintln(buffer);
+}
+
+static bool replayReadNext()
+{
+    if(recordFile.read((uint8_t *)&replayNext, sizeof(replayNext)) != sizeof(replayNext)) return false;
+    if(replayNext.len > RECORD_MAX_DATA) return false;
+    if(recordFile.read(recordBuffer, replayNext.len) != replayNext.len) return false;
+    recordBuffer[replayNext.len] = '\0';
+    return true;
+}
+
+static void replayReport()
+{
+    uint32_t duration = millis() - recordStartTime;
+
+    lv_mem_monitor_t mem_mon;
+    lv_mem_monitor(&mem_mon);
+
+    char buffer[384];
+    snprintf_P(buffer, sizeof(buffer),
+               PSTR("{\"events\":%u,\"duration\":%u,\"frames\":%u,\"frameAvg\":%u,\"frameMax\":%u,\"pixels\":%u,"
+                    "\"touchLatency\":[%u,%u,%u],\"cmdLatency\":[%u,%u,%u],\"statesOut\":%u,\"statesRecorded\":%u,"
+                    "\"http\":%u,\"httpSkipped\":%u,\"heapMin\":%u,\"lvglMemMin\":%u,\"lvglFrag\":%u}"),
+               recordEvents, duration, replayFrames, replayFrames ? replayFrameTime / replayFrames : 0, replayFrameMax,
+               replayPixels, tracePercentile(TRACE_TOUCH_PUBLISH, 50), tracePercentile(TRACE_TOUCH_PUBLISH, 95),
+               tracePercentile(TRACE_TOUCH_PUBLISH, 99), tracePercentile(TRACE_COMMAND_FLUSH, 50),
+               tracePercentile(TRACE_COMMAND_FLUSH, 95), tracePercentile(TRACE_COMMAND_FLUSH, 99), replayOut,
+               replayOutExpected, replayHttp, replayHttpSkipped, replayHeapMin, replayLvMemMin, mem_mon.frag_pct);
+
+    debugPrintln(String(F("REC: Replay finished ")) + buffer);
+    mqttSendState(String(F("replay")).c_str(), buffer);
+}
+
+void replayStart(const char * filename)
+{
+    if(!recordOpen(filename, "r")) return;
+
+    char magic[4];
+    uint8_t version = 0;
+    uint16_t header[2];
+    if(recordFile.read((uint8_t *)magic, 4) != 4 || memcmp(magic, "HREC", 4) != 0 ||
+       recordFile.read(&version, 1) != 1 || version != RECORD_VERSION ||
+       recordFile.read((uint8_t *)header, sizeof(header)) != sizeof(header)) {
+        errorPrintln(F("REC: %sInvalid recording"));
+        recordStop();
+        return;
+    }
+    if(header[0] != lv_disp_get_hor_res(NULL) || header[1] != lv_disp_get_ver_res(NULL)) {
+        warningPrintln(F("REC: %sRecorded with a different screen size"));
+    }
+
+    replayFrames      = 0;
+    replayFrameTime   = 0;
+    replayFrameMax    = 0;
+    replayPixels      = 0;
+    replayOutExpected = 0;
+    replayOut         = 0;
+    replayHttp        = 0;
+    replayHttpSkipped = 0;
+    replayHeapMin     = ESP.getFreeHeap();
+    replayLvMemMin    = UINT32_MAX;
+    traceReset();
+
+    if(!replayReadNext()) {
+        errorPrintln(F("REC: %sEmpty recording"));
+        recordStop();
+        return;
+    }
+    recordState = RECORD_REPLAYING;
+
+    char buffer[128];
+    snprintf_P(buffer, sizeof(buffer), PSTR("REC: Replaying %s"), filename);
+    debugPrintln(buffer);
+}
+
+void recordStop()
+{
+    if(recordState == RECORD_RECORDING) {
+        recordFlush();
+
+        char buffer[128];
+        snprintf_P(buffer, sizeof(buffer), PSTR("REC: Recorded %u events in %u bytes, %u skipped"), recordEvents,
+                   recordFile.size(), recordSkipped);
+        debugPrintln(buffer);
+    }
+
+    /* The report is published after the replay, it is not one of the replayed states */
+    bool replayed = recordState == RECORD_REPLAYING;
+    if(recordFile) recordFile.close();
+    free(recordBuffer);
+    recordBuffer = NULL;
+    recordState  = RECORD_IDLE;
+
+    if(replayed) replayReport();
+}
+
+bool recordIsReplaying()
+{
+    return recordState == RECORD_REPLAYING;
+}
+
+bool recordIsRecording()
+{
+    return recordState == RECORD_RECORDING;
+}
+
+/**
+ * Feed all events that are due into the same entry points as the live touch and mqtt input.
+ * Runs on the gui task, so the commands are applied right away instead of going through the queue,
+ * which only has the network task as producer.
+ */
+void recordLoop()
+{
+    if(recordState != RECORD_REPLAYING) return;
+
+    uint32_t heap = ESP.getFreeHeap();
+    if(heap < replayHeapMin) replayHeapMin = heap;
+
+    lv_mem_monitor_t mem_mon;
+    lv_mem_monitor(&mem_mon);
+    if(mem_mon.free_size < replayLvMemMin) replayLvMemMin = mem_mon.free_size;
+
+    uint32_t now = millis() - recordStartTime;
+    while(replayNext.time <= now) {
+        switch(replayNext.type) {
+            case REC_TOUCH: {
+                int16_t * point = (int16_t *)recordBuffer;
+                touchInject(point[0], point[1], replayNext.arg);
+                break;
+            }
+            case REC_MQTT_IN: {
+                /* topic \0 payload */
+                String topic((char *)recordBuffer);
+                dispatchApply(replayNext.arg, topic, (char *)recordBuffer + topic.length() + 1);
+                break;
+            }
+            case REC_MQTT_OUT:
+                replayOutExpected++;
+                break;
+            case REC_HTTP:
+#if HASP_USE_HTTP > 0
+                if(httpReplay(replayNext.arg, (char *)recordBuffer, replayNext.len)) {
+                    replayHttp++;
+                    break;
+                }
+#endif
+                replayHttpSkipped++;
+                break;
+        }
+        recordEvents++;
+        if(recordState != RECORD_REPLAYING) return; // stopped by a replayed command
+
+        if(!replayReadNext()) {
+            recordStop();
+            return;
+        }
+    }
+}
+
+void recordTouch(int16_t x, int16_t y, bool pressed)
+{
+    int16_t point[2] = {x, y};
+    recordWrite(REC_TOUCH, pressed, point, sizeof(point), NULL, 0);
+}
+
+/* Called when the command is applied, received is the micros() timestamp of its arrival */
+void recordMqttIn(uint8_t type, const String & topic, const String & payload, uint32_t received)
+{
+    if(recordState != RECORD_RECORDING) return;
+
+    /* Store the arrival time, not the time it was applied */
+    uint32_t time  = recordStartTime;
+    uint32_t delay = (micros() - received) / 1000;
+    if(delay > millis() - recordStartTime) delay = millis() - recordStartTime; // arrived before the recording
+    recordStartTime += delay;
+    recordWrite(REC_MQTT_IN, type, topic.c_str(), topic.length() + 1, payload.c_str(), payload.length());
+    recordStartTime = time;
+}
+
+void recordMqttOut(const char * subtopic, const char * payload)
+{
+    if(recordState == RECORD_REPLAYING) replayOut++;
+    recordWrite(REC_MQTT_OUT, 0, subtopic, strlen(subtopic) + 1, payload, strlen(payload));
+}
+
+void recordHttp(uint8_t method, const char * data, size_t len)
+{
+    recordWrite(REC_HTTP, method, data, len, NULL, 0);
+}
+
+void recordFrame(uint32_t time, uint32_t px)
+{
+    if(recordState != RECORD_REPLAYING) return;
+
+    replayFrames++;
+    replayFrameTime += time;
+    replayPixels += px;
+    if(time > replayFrameMax) replayFrameMax = time;
+}
@@ -0,0 +1,19 @@
+#ifndef HASP_RECORD_H
+#define HASP_RECORD_H
+
+#include <Arduino.h>
+
+void recordLoop(void);
+void recordStart(const char * filename);
+void recordStop(void);
+void replayStart(const char * filename);
+bool recordIsReplaying(void);
+bool recordIsRecording(void);
+
+void recordTouch(int16_t x, int16_t y, bool pressed);
+void recordMqttIn(uint8_t type, const String & topic, const String & payload, uint32_t received);
+void recordMqttOut(const char * subtopic, const char * payload);
+void recordHttp(uint8_t method, const char * data, size_t len);
+void recordFrame(uint32_t time, uint32_t px);
+
+#endif
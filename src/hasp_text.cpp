@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lvgl.h"
+
+#include "hasp_conf.h"
+#include "hasp_text.h"
+
+#if defined(ARDUINO)
+#include "Arduino.h"
+#else
+#include <chrono>
+/* The native tests run the layouts without the Arduino core */
+static uint32_t micros(void)
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+#endif
+
+/**
+ * Text layouts: the line breaks, line widths and size of a text in a font, found by hashing the text.
+ * LVGL breaks a label text into lines and measures them glyph by glyph on every relayout of the label, which
+ * costs a font lookup per character and a file read for glyphs outside the ASCII cache of a zi font.
+ * Identical texts, e.g. the same unit or caption on objects of a template, share one layout.
+ *
+ * The relayouts of lv_label_refr_text, and the sizes the other objects and lv_draw_label ask for, go through
+ * lv_txt_get_size. The build wraps it with -Wl,--wrap=lv_txt_get_size, so those calls read the cache.
+ */
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define TEXT_CACHE_ENTRIES 32
+#define TEXT_CACHE_BUDGET 8192u // bytes of lines and texts
+#else
+#define TEXT_CACHE_ENTRIES 8
+#define TEXT_CACHE_BUDGET 1024u
+#endif
+
+static text_layout_t textEntries[TEXT_CACHE_ENTRIES];
+static text_layout_t textScratch; // layout that is not cached, valid until the next call
+static text_line_t * textLines;   // lines of the text being measured
+static uint16_t textLinesSize;
+static text_stats_t textStats;
+static uint32_t textTick = 0;
+static bool textEnabled  = true;
+
+/* FNV-1a */
+static uint32_t textHash(const char * txt, uint16_t * len)
+{
+    uint32_t hash = 2166136261u;
+    uint16_t i    = 0;
+    while(txt[i] != '\0' && i < UINT16_MAX) {
+        hash = (hash ^ (uint8_t)txt[i]) * 16777619u;
+        i++;
+    }
+    *len = i;
+    return hash;
+}
+
+static void textFree(text_layout_t * entry)
+{
+    if(entry != &textScratch) textStats.used -= entry->bytes;
+    free(entry->lines);
+    memset(entry, 0, sizeof(text_layout_t));
+}
+
+/* Get a free entry with room for bytes, evicting the least recently used layouts */
+static text_layout_t * textAlloc(uint16_t bytes)
+{
+    if(!textEnabled || bytes > TEXT_CACHE_BUDGET / 2) {
+        textFree(&textScratch);
+        return &textScratch;
+    }
+
+    text_layout_t * entry = NULL;
+    for(uint8_t i = 0; i < TEXT_CACHE_ENTRIES && !entry; i++) {
+        if(!textEntries[i].lines) entry = &textEntries[i];
+    }
+
+    while(!entry || textStats.used + bytes > TEXT_CACHE_BUDGET) {
+        text_layout_t * oldest = NULL;
+        for(uint8_t i = 0; i < TEXT_CACHE_ENTRIES; i++) {
+            if(textEntries[i].lines && (!oldest || textEntries[i].last_used < oldest->last_used))
+                oldest = &textEntries[i];
+        }
+        if(!oldest) break;
+
+        textFree(oldest);
+        textStats.evictions++;
+        if(!entry) entry = oldest;
+    }
+    if(!entry) {
+        textFree(&textScratch);
+        return &textScratch;
+    }
+
+    textStats.used += bytes;
+    return entry;
+}
+
+/* Break a text into lines and measure them in one pass, the lines are kept in textLines */
+static int32_t textMeasure(const char * txt, const lv_font_t * font, lv_coord_t letter_space, lv_coord_t max_w,
+                           lv_txt_flag_t flag, lv_coord_t * width)
+{
+    uint16_t line_count = 0;
+    *width              = 0;
+    for(uint32_t pos = 0; txt[pos] != '\0'; line_count++) {
+        if(line_count == textLinesSize) {
+            uint16_t size = textLinesSize ? textLinesSize * 2 : 8;
+            if(size <= textLinesSize) return -1;
+            text_line_t * lines = (text_line_t *)realloc(textLines, size * sizeof(text_line_t));
+            if(!lines) return -1;
+            textLines     = lines;
+            textLinesSize = size;
+        }
+
+        uint16_t line_len = lv_txt_get_next_line(&txt[pos], font, letter_space, max_w, flag);
+        if(line_len == 0) return -1;
+
+        textLines[line_count].start = pos;
+        textLines[line_count].width = lv_txt_get_width(&txt[pos], line_len, font, letter_space, flag);
+        if(textLines[line_count].width > *width) *width = textLines[line_count].width;
+        pos += line_len;
+    }
+    return line_count;
+}
+
+/**
+ * Get the layout of a text as lv_txt_get_size and lv_draw_label break it for a width of max_w.
+ * The layout is only valid until the next call, it can be evicted by the next text.
+ */
+const text_layout_t * textGetLayout(const char * txt, const lv_font_t * font, lv_coord_t letter_space,
+                                    lv_coord_t line_space, lv_coord_t max_w, lv_txt_flag_t flag)
+{
+    /* Only the recolor flag changes the lines, the alignment just moves them, so lv_label_refr_text and the
+     * drawing of a wrapped label share one layout. Expanded and fitted texts only break at the line breaks */
+    if(flag & (LV_TXT_FLAG_EXPAND | LV_TXT_FLAG_FIT)) {
+        max_w = LV_COORD_MAX;
+        flag  = (flag & LV_TXT_FLAG_RECOLOR) | LV_TXT_FLAG_EXPAND;
+    } else {
+        flag = flag & LV_TXT_FLAG_RECOLOR;
+    }
+
+    uint16_t len;
+    uint32_t hash = textHash(txt, &len);
+
+    textTick++;
+    if(textEnabled) {
+        for(uint8_t i = 0; i < TEXT_CACHE_ENTRIES; i++) {
+            text_layout_t * entry = &textEntries[i];
+            if(entry->lines && entry->hash == hash && entry->len == len && entry->font == font &&
+               entry->max_w == max_w && entry->letter_space == letter_space && entry->line_space == line_space &&
+               entry->flag == flag && memcmp(&entry->lines[entry->line_count], txt, len) == 0) {
+                entry->last_used = textTick;
+                textStats.hits++;
+                return entry;
+            }
+        }
+    }
+
+    uint32_t startMicros = micros();
+    lv_coord_t width;
+    int32_t line_count = textMeasure(txt, font, letter_space, max_w, flag, &width);
+    if(line_count < 0) return NULL;
+
+    /* The layout is allocated in one block with the text */
+    uint32_t bytes = line_count * sizeof(text_line_t) + len;
+    if(bytes > UINT16_MAX) return NULL;
+
+    text_layout_t * entry = textAlloc(bytes);
+    entry->lines          = (text_line_t *)malloc(bytes > 0 ? bytes : 1);
+    if(!entry->lines) {
+        if(entry != &textScratch) textStats.used -= bytes;
+        return NULL;
+    }
+    memcpy(entry->lines, textLines, line_count * sizeof(text_line_t));
+    memcpy(&entry->lines[line_count], txt, len);
+
+    /* The size as lv_txt_get_size adds it up, one line taller when the text ends with a line break */
+    uint8_t letter_height = lv_font_get_line_height(font);
+    entry->size.x         = width;
+    entry->size.y         = line_count * (letter_height + line_space);
+    if(len > 0 && (txt[len - 1] == '\n' || txt[len - 1] == '\r')) entry->size.y += letter_height + line_space;
+    if(entry->size.y == 0)
+        entry->size.y = letter_height;
+    else
+        entry->size.y -= line_space;
+
+    entry->font         = font;
+    entry->hash         = hash;
+    entry->len          = len;
+    entry->max_w        = max_w;
+    entry->letter_space = letter_space;
+    entry->line_space   = line_space;
+    entry->flag         = flag;
+    entry->line_count   = line_count;
+    entry->bytes        = bytes;
+    entry->last_used    = textTick;
+
+    textStats.misses++;
+    textStats.layout_time += micros() - startMicros;
+    return entry;
+}
+
+/* Weak, so the build also links without the --wrap flag, LVGL then keeps calling its own lv_txt_get_size */
+extern "C" void __real_lv_txt_get_size(lv_point_t * size_res, const char * text, const lv_font_t * font,
+                                       lv_coord_t letter_space, lv_coord_t line_space, lv_coord_t max_width,
+                                       lv_txt_flag_t flag) __attribute__((weak));
+
+/* lv_txt_get_size from the cached layouts, e.g. for lv_label_refr_text */
+extern "C" void __wrap_lv_txt_get_size(lv_point_t * size_res, const char * text, const lv_font_t * font,
+                                       lv_coord_t letter_space, lv_coord_t line_space, lv_coord_t max_width,
+                                       lv_txt_flag_t flag)
+{
+    size_res->x = 0;
+    size_res->y = 0;
+    if(text == NULL || font == NULL) return;
+
+    const text_layout_t * layout = textGetLayout(text, font, letter_space, line_space, max_width, flag);
+    if(layout)
+        *size_res = layout->size;
+    else if(__real_lv_txt_get_size)
+        __real_lv_txt_get_size(size_res, text, font, letter_space, line_space, max_width, flag);
+}
+
+/* Set the text of a label, setting the text it already shows does not relayout the label */
+void textSetLabel(lv_obj_t * label, const char * txt)
+{
+    const char * current = lv_label_get_text(label);
+
+    /* In dot mode the label text is shortened, so it can not be compared */
+    if(current && lv_label_get_long_mode(label) != LV_LABEL_LONG_DOT && strcmp(current, txt) == 0) {
+        textStats.skipped++;
+        return;
+    }
+    lv_label_set_text(label, txt);
+}
+
+/* Turn the cache off to time the layouts, the cached layouts are kept */
+void textSetEnabled(bool enabled)
+{
+    textEnabled = enabled;
+}
+
+/* Drop the layouts of a font that is unloaded, another font could get its address */
+void textFlushFont(const lv_font_t * font)
+{
+    for(uint8_t i = 0; i < TEXT_CACHE_ENTRIES; i++) {
+        if(textEntries[i].lines && (!font || textEntries[i].font == font)) textFree(&textEntries[i]);
+    }
+    textFree(&textScratch);
+    free(textLines);
+    textLines     = NULL;
+    textLinesSize = 0;
+}
+
+void textGetStats(text_stats_t * stats)
+{
+    *stats        = textStats;
+    stats->budget = TEXT_CACHE_BUDGET;
+}
@@ -0,0 +1,46 @@
+#ifndef HASP_TEXT_H
+#define HASP_TEXT_H
+
+#include "lvgl.h"
+
+typedef struct
+{
+    uint16_t start;   // offset of the line in the text
+    lv_coord_t width; // without the trailing letter space
+} text_line_t;
+
+typedef struct
+{
+    const lv_font_t * font;
+    uint32_t hash;
+    uint16_t len;
+    lv_coord_t max_w;
+    lv_coord_t letter_space;
+    lv_coord_t line_space;
+    lv_txt_flag_t flag;
+    uint16_t line_count;
+    lv_point_t size;
+    uint32_t last_used;
+    uint16_t bytes;      // allocated for lines and text
+    text_line_t * lines; // line_count lines, followed by a copy of the text, NULL if the entry is free
+} text_layout_t;
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t layout_time; // us spent breaking and measuring texts that were not cached
+    uint32_t skipped;     // label texts set to the text they already had
+    uint32_t used;        // bytes of cached layouts
+    uint32_t budget;
+} text_stats_t;
+
+const text_layout_t * textGetLayout(const char * txt, const lv_font_t * font, lv_coord_t letter_space,
+                                    lv_coord_t line_space, lv_coord_t max_w, lv_txt_flag_t flag);
+void textSetLabel(lv_obj_t * label, const char * txt);
+void textSetEnabled(bool enabled);
+void textFlushFont(const lv_font_t * font);
+void textGetStats(text_stats_t * stats);
+
+#endif
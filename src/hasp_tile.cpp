@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lvgl.h"
+
+#include "hasp_conf.h"
+#include "hasp_tile.h"
+#include "hasp_text.h"
+
+/**
+ * Glyph tiles: the glyphs of a label blended once against the background color and kept as RGB565 pixels.
+ * Labels on a single color background, like clocks and sensor values, then copy the tiles into the draw
+ * buffer instead of blending every pixel again on each redraw. The result is the same as lv_draw_letter,
+ * any glyph that does not sit on a single color is still drawn by LVGL. Plain LVGL code, so the native
+ * tests can compare the tiles with lv_draw_letter pixel by pixel.
+ */
+
+#if HASP_USE_GLYPH_TILES > 0
+
+#if defined(ARDUINO_ARCH_ESP32)
+#define TILE_CACHE_ENTRIES 64
+#define TILE_CACHE_BUDGET 16384u // bytes of tile pixels
+#else
+#define TILE_CACHE_ENTRIES 16
+#define TILE_CACHE_BUDGET 4096u
+#endif
+
+typedef struct
+{
+    const lv_font_t * font;
+    uint32_t unicode;
+    lv_color_t fg;
+    lv_color_t bg;
+    uint16_t size; // bytes of pixels
+    uint32_t last_used;
+    lv_color_t * pixels; // box_w * box_h, NULL if the entry is free
+} tile_entry_t;
+
+static tile_entry_t tileEntries[TILE_CACHE_ENTRIES];
+static tile_stats_t tileStats;
+static uint32_t tileTick                 = 0;
+static bool tileEnabled                  = true;
+static lv_design_cb_t tileAncestorDesign = NULL;
+
+static const uint8_t tileOpa1[2]  = {0, 255};
+static const uint8_t tileOpa2[4]  = {0, 85, 170, 255};
+static const uint8_t tileOpa4[16] = {0, 17, 34, 51, 68, 85, 102, 119, 136, 153, 170, 187, 204, 221, 238, 255};
+
+static void tileFree(tile_entry_t * entry)
+{
+    tileStats.used -= entry->size;
+    free(entry->pixels);
+    memset(entry, 0, sizeof(tile_entry_t));
+}
+
+/* Get a free entry with room for size bytes, evicting the least recently used tiles */
+static tile_entry_t * tileAlloc(uint16_t size)
+{
+    tile_entry_t * entry = NULL;
+    for(uint8_t i = 0; i < TILE_CACHE_ENTRIES && !entry; i++) {
+        if(!tileEntries[i].pixels) entry = &tileEntries[i];
+    }
+
+    while(!entry || tileStats.used + size > TILE_CACHE_BUDGET) {
+        tile_entry_t * oldest = NULL;
+        for(uint8_t i = 0; i < TILE_CACHE_ENTRIES; i++) {
+            if(tileEntries[i].pixels && (!oldest || tileEntries[i].last_used < oldest->last_used))
+                oldest = &tileEntries[i];
+        }
+        if(!oldest) return NULL;
+
+        tileFree(oldest);
+        tileStats.evictions++;
+        if(!entry) entry = oldest;
+    }
+
+    entry->pixels = (lv_color_t *)malloc(size);
+    if(!entry->pixels) return NULL;
+    entry->size = size;
+    tileStats.used += size;
+    return entry;
+}
+
+/* Find the tile of a glyph, or blend it the way lv_draw_letter does with full opacity */
+static const lv_color_t * tileGet(const lv_font_t * font, uint32_t letter, const lv_font_glyph_dsc_t * g,
+                                  lv_color_t fg, lv_color_t bg)
+{
+    tileTick++;
+    for(uint8_t i = 0; i < TILE_CACHE_ENTRIES; i++) {
+        tile_entry_t * entry = &tileEntries[i];
+        if(entry->pixels && entry->font == font && entry->unicode == letter && entry->fg.full == fg.full &&
+           entry->bg.full == bg.full) {
+            entry->last_used = tileTick;
+            tileStats.hits++;
+            return entry->pixels;
+        }
+    }
+
+    const uint8_t * table;
+    switch(g->bpp) {
+        case 1: table = tileOpa1; break;
+        case 2: table = tileOpa2; break;
+        case 4: table = tileOpa4; break;
+        case 8: table = NULL; break;
+        default: return NULL;
+    }
+
+    /* Large glyphs would push out all the others */
+    uint32_t pixels = g->box_w * g->box_h;
+    if(pixels * sizeof(lv_color_t) > TILE_CACHE_BUDGET / 4) return NULL;
+
+    const uint8_t * bitmap = lv_font_get_glyph_bitmap(font, letter);
+    if(!bitmap) return NULL;
+
+    tile_entry_t * entry = tileAlloc(pixels * sizeof(lv_color_t));
+    if(!entry) return NULL;
+    tileStats.misses++;
+
+    uint8_t bpp  = g->bpp;
+    uint8_t mask = (1 << bpp) - 1;
+    uint32_t bit = 0;
+    for(uint32_t i = 0; i < pixels; i++, bit += bpp) {
+        uint8_t px   = (bitmap[bit >> 3] >> (8 - bpp - (bit & 7))) & mask;
+        lv_opa_t opa = table ? table[px] : px;
+
+        /* LVGL leaves pixels that already have the text color untouched */
+        if(opa > LV_OPA_MAX || (fg.full == bg.full && opa > LV_OPA_MIN))
+            entry->pixels[i] = fg;
+        else if(opa > LV_OPA_MIN)
+            entry->pixels[i] = lv_color_mix(fg, bg, opa);
+        else
+            entry->pixels[i] = bg;
+    }
+
+    entry->font      = font;
+    entry->unicode   = letter;
+    entry->fg        = fg;
+    entry->bg        = bg;
+    entry->last_used = tileTick;
+    return entry->pixels;
+}
+
+/* Same placement and clipping as lv_draw_letter */
+static void tileDrawLetter(const lv_point_t * pos, const lv_area_t * mask, const lv_font_t * font, uint32_t letter,
+                           lv_color_t color, const lv_disp_buf_t * vdb)
+{
+    lv_font_glyph_dsc_t g;
+    if(!lv_font_get_glyph_dsc(font, &g, letter, '\0')) return;
+
+    lv_coord_t pos_x = pos->x + g.ofs_x;
+    lv_coord_t pos_y = pos->y + (font->line_height - font->base_line) - g.box_h - g.ofs_y;
+    if(pos_x + g.box_w < mask->x1 || pos_x > mask->x2 || pos_y + g.box_h < mask->y1 || pos_y > mask->y2) return;
+
+    lv_coord_t col_start = pos_x >= mask->x1 ? 0 : mask->x1 - pos_x;
+    lv_coord_t col_end   = pos_x + g.box_w <= mask->x2 ? g.box_w : mask->x2 - pos_x + 1;
+    lv_coord_t row_start = pos_y >= mask->y1 ? 0 : mask->y1 - pos_y;
+    lv_coord_t row_end   = pos_y + g.box_h <= mask->y2 ? g.box_h : mask->y2 - pos_y + 1;
+    if(col_start >= col_end || row_start >= row_end) return;
+
+    lv_coord_t stride = lv_area_get_width(&vdb->area);
+    lv_color_t * dst  = vdb->buf_act;
+    dst += (pos_y - vdb->area.y1) * stride + pos_x - vdb->area.x1;
+
+    /* The tile is only valid on a single color, e.g. not where the previous glyph overlaps */
+    lv_color_t bg = dst[row_start * stride + col_start];
+    for(lv_coord_t row = row_start; row < row_end; row++) {
+        for(lv_coord_t col = col_start; col < col_end; col++) {
+            if(dst[row * stride + col].full != bg.full) {
+                tileStats.fallbacks++;
+                lv_draw_letter(pos, mask, font, letter, color, LV_OPA_COVER);
+                return;
+            }
+        }
+    }
+
+    const lv_color_t * tile = tileGet(font, letter, &g, color, bg);
+    if(!tile) {
+        lv_draw_letter(pos, mask, font, letter, color, LV_OPA_COVER);
+        return;
+    }
+
+    for(lv_coord_t row = row_start; row < row_end; row++) {
+        memcpy(&dst[row * stride + col_start], &tile[row * g.box_w + col_start],
+               (col_end - col_start) * sizeof(lv_color_t));
+    }
+}
+
+/* The lines and letters of lv_draw_label, without recoloring and selections */
+static void tileDrawText(const lv_area_t * coords, const lv_area_t * mask, const lv_style_t * style,
+                         const char * txt, const text_layout_t * layout, lv_txt_flag_t flag,
+                         const lv_point_t * offset, const lv_disp_buf_t * vdb)
+{
+    const lv_font_t * font  = style->text.font;
+    lv_coord_t letter_space = style->text.letter_space;
+    lv_coord_t line_height  = lv_font_get_line_height(font) + style->text.line_space;
+
+    lv_point_t pos;
+    pos.y = coords->y1 + offset->y;
+
+    /* Skip the lines above the mask */
+    uint16_t line = 0;
+    while(line < layout->line_count && pos.y + line_height < mask->y1) {
+        pos.y += line_height;
+        line++;
+    }
+
+    for(; line < layout->line_count && pos.y <= mask->y2; line++) {
+        uint32_t i        = layout->lines[line].start;
+        uint32_t line_end = line + 1 < layout->line_count ? layout->lines[line + 1].start : layout->len;
+
+        pos.x = coords->x1;
+        if(flag & LV_TXT_FLAG_CENTER)
+            pos.x += (lv_area_get_width(coords) - layout->lines[line].width) / 2;
+        else if(flag & LV_TXT_FLAG_RIGHT)
+            pos.x += lv_area_get_width(coords) - layout->lines[line].width;
+        pos.x += offset->x;
+
+        while(i < line_end) {
+            uint32_t letter      = lv_txt_encoded_next(txt, &i);
+            uint32_t letter_next = lv_txt_encoded_next(&txt[i], NULL);
+            lv_coord_t letter_w  = lv_font_get_glyph_width(font, letter, letter_next);
+
+            tileDrawLetter(&pos, mask, font, letter, style->text.color, vdb);
+            if(letter_w > 0) pos.x += letter_w + letter_space;
+        }
+
+        pos.y += line_height;
+    }
+}
+
+/* Label design function, labels that can not use tiles are drawn by the original design function */
+static bool tileDesign(lv_obj_t * label, const lv_area_t * mask, lv_design_mode_t mode)
+{
+    if(mode != LV_DESIGN_DRAW_MAIN || !tileEnabled) return tileAncestorDesign(label, mask, mode);
+
+    lv_label_ext_t * ext     = (lv_label_ext_t *)lv_obj_get_ext_attr(label);
+    const lv_style_t * style = lv_obj_get_style(label);
+    lv_opa_t opa_scale       = lv_obj_get_opa_scale(label);
+    lv_opa_t opa             = opa_scale == LV_OPA_COVER ? style->text.opa : (style->text.opa * opa_scale) >> 8;
+    lv_disp_t * disp         = lv_refr_get_disp_refreshing();
+
+    /* Tiles are blended at full opacity, lv_draw_letter scales every pixel by any other opacity */
+    if(!disp || disp->driver.set_px_cb || opa != LV_OPA_COVER || !ext->text || ext->text[0] == '\0' ||
+       ext->recolor || ext->long_mode == LV_LABEL_LONG_SROLL || ext->long_mode == LV_LABEL_LONG_SROLL_CIRC ||
+       style->text.font->subpx != LV_FONT_SUBPX_NONE || lv_label_get_text_sel_start(label) != LV_LABEL_TEXT_SEL_OFF ||
+       lv_label_get_text_sel_end(label) != LV_LABEL_TEXT_SEL_OFF)
+        return tileAncestorDesign(label, mask, mode);
+#if LV_USE_GROUP
+    lv_group_t * group = lv_obj_get_group(label);
+    if(group && lv_group_get_focused(group) == label) return tileAncestorDesign(label, mask, mode);
+#endif
+
+    lv_area_t coords;
+    lv_obj_get_coords(label, &coords);
+
+    lv_txt_flag_t flag = LV_TXT_FLAG_NONE;
+    if(ext->expand) flag |= LV_TXT_FLAG_EXPAND;
+    if(ext->align == LV_LABEL_ALIGN_CENTER) flag |= LV_TXT_FLAG_CENTER;
+    if(ext->align == LV_LABEL_ALIGN_RIGHT) flag |= LV_TXT_FLAG_RIGHT;
+
+    /* Wrapped labels find the layout lv_label_refr_text measured through lv_txt_get_size */
+    const text_layout_t * layout = textGetLayout(ext->text, style->text.font, style->text.letter_space,
+                                                 style->text.line_space, lv_area_get_width(&coords), flag);
+    if(!layout) return tileAncestorDesign(label, mask, mode);
+
+    if(ext->body_draw) {
+        lv_area_t bg = coords;
+        bg.x1 -= style->body.padding.left;
+        bg.x2 += style->body.padding.right;
+        bg.y1 -= style->body.padding.top;
+        bg.y2 += style->body.padding.bottom;
+        lv_draw_rect(&bg, mask, style, opa_scale);
+    }
+
+    tileDrawText(&coords, mask, style, ext->text, layout, flag, &ext->offset, lv_disp_get_buf(disp));
+    return true;
+}
+
+/* Let a label use glyph tiles when it is drawn on a single color background */
+void tileAttach(lv_obj_t * label)
+{
+    if(!label) return;
+    if(!tileAncestorDesign) {
+        tileAncestorDesign = lv_obj_get_design_cb(label);
+        tileStats.budget   = TILE_CACHE_BUDGET;
+    }
+    lv_obj_set_design_cb(label, tileDesign);
+}
+
+/* Turn the tiles off to compare with the LVGL rendering, the cache is kept */
+void tileSetEnabled(bool enabled)
+{
+    tileEnabled = enabled;
+}
+
+/* Drop the tiles of a font that is unloaded, another font could get its address */
+void tileFlushFont(const lv_font_t * font)
+{
+    for(uint8_t i = 0; i < TILE_CACHE_ENTRIES; i++) {
+        if(tileEntries[i].pixels && (!font || tileEntries[i].font == font)) tileFree(&tileEntries[i]);
+    }
+}
+
+void tileGetStats(tile_stats_t * stats)
+{
+    *stats = tileStats;
+}
+
+#else
+
+void tileAttach(lv_obj_t * label)
+{}
+void tileSetEnabled(bool enabled)
+{}
+void tileFlushFont(const lv_font_t * font)
+{}
+void tileGetStats(tile_stats_t * stats)
+{
+    memset(stats, 0, sizeof(tile_stats_t));
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HASP_TILE_H
+#define HASP_TILE_H
+
+#include "lvgl.h"
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t fallbacks; // glyphs blended by LVGL because the background under them was not a single color
+    uint32_t used;      // bytes of cached tiles
+    uint32_t budget;
+} tile_stats_t;
+
+void tileAttach(lv_obj_t * label);
+void tileSetEnabled(bool enabled);
+void tileFlushFont(const lv_font_t * font);
+void tileGetStats(tile_stats_t * stats);
+
+#endif
@@ -0,0 +1,196 @@
+#include "Arduino.h"
+#include "TFT_eSPI.h"
+#include "lvgl.h"
+
+#include "hasp_log.h"
+#include "hasp_gui.h"
+#include "hasp_touch.h"
+#include "hasp_touch_filter.h"
+#include "hasp_record.h"
+
+#define TOUCH_BUFFER_SIZE 16  // number of buffered samples, must be a power of 2
+#define TOUCH_SAMPLE_PERIOD 5 // ms, sampling period while the screen is pressed
+#define TOUCH_IDLE_PERIOD 25  // ms, polling period while released, without irq line
+#define TOUCH_THRESHOLD 600   // minimum raw pressure of a valid touch
+
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    bool pressed;
+    uint32_t time; // micros() when the sample was taken
+} touch_sample_t;
+
+static TFT_eSPI * touchTft;
+static int8_t touchIrqPin            = -1;
+static volatile bool touchIrqPending = false;
+static uint32_t touchLastSample      = 0;
+static bool touchPressed             = false;
+
+/* Ring buffer, filled by touchLoop and drained by the lvgl read callback */
+static touch_sample_t touchBuffer[TOUCH_BUFFER_SIZE];
+static uint8_t touchHead = 0;
+static uint8_t touchTail = 0;
+static touch_sample_t touchLast; // last sample handed to lvgl
+static uint32_t touchLastTime = 0; // time of the sample handed to lvgl in the current read, 0 if it was repeated
+
+static touch_filter_t touchFilter;
+
+static uint32_t touchSamples  = 0;
+static uint32_t touchDropped  = 0;
+static uint16_t touchBusCount = 0; // touch transactions on the spi bus in the current second
+static uint16_t touchBusRate  = 0; // touch transactions on the spi bus in the last second
+
+static void IRAM_ATTR touchIsr()
+{
+    touchIrqPending = true;
+}
+
+static void touchPush(int16_t x, int16_t y, bool pressed)
+{
+    uint8_t next = (touchHead + 1) & (TOUCH_BUFFER_SIZE - 1);
+    if(next == touchTail) {
+        /* Buffer full, drop the oldest sample */
+        touchTail = (touchTail + 1) & (TOUCH_BUFFER_SIZE - 1);
+        touchDropped++;
+    }
+
+    touchBuffer[touchHead].x       = x;
+    touchBuffer[touchHead].y       = y;
+    touchBuffer[touchHead].pressed = pressed;
+    touchBuffer[touchHead].time    = micros();
+    touchHead                      = next;
+}
+
+/* Take one sample without blocking, the filter removes the jitter */
+static void touchSample()
+{
+    uint16_t x, y;
+    bool pressed;
+
+    /* Each getTouchRaw call is one transaction, it switches the shared bus to SPI_TOUCH_FREQUENCY and back.
+     * While pressed, the irq line tells if the pen is still down, which saves the pressure read. */
+    if(touchIrqPin >= 0 && touchPressed) {
+        pressed = digitalRead(touchIrqPin) == LOW;
+    } else {
+        pressed = touchTft->getTouchRawZ() > TOUCH_THRESHOLD;
+        touchBusCount++;
+    }
+
+    if(pressed) {
+        touchTft->getTouchRaw(&x, &y);
+        touchTft->convertRawXY(&x, &y);
+        touchBusCount++;
+        pressed = x < touchTft->width() && y < touchTft->height();
+    }
+
+    if(!pressed) {
+        if(touchPressed) touchPush(touchFilterX(&touchFilter), touchFilterY(&touchFilter), false);
+        touchPressed = false;
+        return;
+    }
+
+    if(!touchPressed)
+        touchFilterStart(&touchFilter, x, y);
+    else
+        touchFilterAdd(&touchFilter, x, y);
+
+    touchPressed = true;
+    touchSamples++;
+    touchPush(touchFilterX(&touchFilter), touchFilterY(&touchFilter), true);
+}
+
+/* Queue a sample as if it was read from the controller, used by the replayer */
+void touchInject(int16_t x, int16_t y, bool pressed)
+{
+    touchPush(x, y, pressed);
+}
+
+void touchLoop()
+{
+    if(recordIsReplaying()) return; // the recorded samples replace the controller
+
+    uint32_t period = touchPressed ? TOUCH_SAMPLE_PERIOD : TOUCH_IDLE_PERIOD;
+
+    if(touchIrqPin >= 0 && !touchPressed) {
+        /* Only wake up the controller when the irq line signalled a touch */
+        if(!touchIrqPending) return;
+    } else if(millis() - touchLastSample < period) {
+        return;
+    }
+
+    /* Let a pending display refresh use the bus first, sample in the gap after its flush.
+     * While rendering is suspended the invalid areas are not flushed, so there is nothing to wait for. */
+    lv_disp_t * disp = lv_disp_get_default();
+    if(touchDeferSample(millis() - touchLastSample, period, disp->inv_p > 0 && !guiIsRenderingSuspended())) return;
+
+    touchIrqPending = false;
+    touchLastSample = millis();
+    touchSample();
+}
+
+bool touchRead(lv_indev_drv_t * indev_driver, lv_indev_data_t * data)
+{
+    if(touchTail != touchHead) {
+        touchLast     = touchBuffer[touchTail];
+        touchLastTime = touchLast.time;
+        touchTail     = (touchTail + 1) & (TOUCH_BUFFER_SIZE - 1);
+        recordTouch(touchLast.x, touchLast.y, touchLast.pressed);
+    } else {
+        touchLastTime = 0;
+    }
+
+    data->point.x = touchLast.x;
+    data->point.y = touchLast.y;
+    data->state   = touchLast.pressed ? LV_INDEV_STATE_PR : LV_INDEV_STATE_REL;
+
+    return touchTail != touchHead; /*Return `true` while there are more buffered samples*/
+}
+
+bool touchIsPressed()
+{
+    return touchPressed;
+}
+
+uint32_t touchGetSamples()
+{
+    return touchSamples;
+}
+
+uint32_t touchGetDropped()
+{
+    return touchDropped;
+}
+
+uint32_t touchGetLastReadTime()
+{
+    return touchLastTime;
+}
+
+uint16_t touchGetBusRate()
+{
+    return touchBusRate;
+}
+
+void touchEverySecond()
+{
+    touchBusRate  = touchBusCount;
+    touchBusCount = 0;
+}
+
+void touchSetup(TFT_eSPI & screen, int8_t irqPin)
+{
+    touchTft    = &screen;
+    touchIrqPin = irqPin;
+
+    if(touchIrqPin >= 0) {
+        pinMode(touchIrqPin, INPUT_PULLUP);
+        attachInterrupt(digitalPinToInterrupt(touchIrqPin), touchIsr, FALLING);
+
+        char buffer[64];
+        snprintf_P(buffer, sizeof(buffer), PSTR("TOUCH: Using irq pin %d"), touchIrqPin);
+        debugPrintln(buffer);
+    } else {
+        debugPrintln(F("TOUCH: Polling the touch controller"));
+    }
+}
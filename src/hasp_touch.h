@@ -0,0 +1,19 @@
+#ifndef HASP_TOUCH_H
+#define HASP_TOUCH_H
+
+#include "TFT_eSPI.h"
+#include "lvgl.h"
+
+void touchSetup(TFT_eSPI & screen, int8_t irqPin);
+void touchLoop(void);
+void touchEverySecond(void);
+bool touchRead(lv_indev_drv_t * indev_driver, lv_indev_data_t * data);
+void touchInject(int16_t x, int16_t y, bool pressed);
+
+bool touchIsPressed(void);
+uint32_t touchGetSamples(void);
+uint32_t touchGetDropped(void);
+uint16_t touchGetBusRate(void);
+uint32_t touchGetLastReadTime(void);
+
+#endif
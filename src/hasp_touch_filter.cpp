@@ -0,0 +1,57 @@
+#include "hasp_touch_filter.h"
+
+/* Plain code without the touch controller, so the native tests can feed it recorded traces */
+
+static int16_t touchMedian(const int16_t * v)
+{
+    if(v[0] > v[1]) {
+        if(v[1] > v[2]) return v[1];
+        return v[0] > v[2] ? v[2] : v[0];
+    }
+    if(v[0] > v[2]) return v[0];
+    return v[1] > v[2] ? v[2] : v[1];
+}
+
+/* New press, start the filters at this point */
+void touchFilterStart(touch_filter_t * filter, int16_t x, int16_t y)
+{
+    for(uint8_t i = 0; i < 3; i++) {
+        filter->hist_x[i] = x;
+        filter->hist_y[i] = y;
+    }
+    filter->index = 0;
+    filter->x     = x << 4;
+    filter->y     = y << 4;
+}
+
+/* A median-3 removes single sample spikes, the iir filter smooths the remaining jitter */
+void touchFilterAdd(touch_filter_t * filter, int16_t x, int16_t y)
+{
+    filter->hist_x[filter->index] = x;
+    filter->hist_y[filter->index] = y;
+    filter->index                 = (filter->index + 1) % 3;
+
+    filter->x += ((touchMedian(filter->hist_x) << 4) - filter->x) >> TOUCH_IIR_SHIFT;
+    filter->y += ((touchMedian(filter->hist_y) << 4) - filter->y) >> TOUCH_IIR_SHIFT;
+}
+
+int16_t touchFilterX(const touch_filter_t * filter)
+{
+    return filter->x >> 4;
+}
+
+int16_t touchFilterY(const touch_filter_t * filter)
+{
+    return filter->y >> 4;
+}
+
+/**
+ * Check if a due sample should wait for a pending display refresh, so the refresh uses the bus first
+ * and the sample is taken in the gap after its flush. It never waits longer than TOUCH_MAX_DEFER.
+ * @param elapsed ms since the last sample
+ * @param refresh_pending the display has invalid areas it will flush, false while rendering is suspended
+ */
+bool touchDeferSample(uint32_t elapsed, uint32_t period, bool refresh_pending)
+{
+    return refresh_pending && elapsed < period + TOUCH_MAX_DEFER;
+}
@@ -0,0 +1,25 @@
+#ifndef HASP_TOUCH_FILTER_H
+#define HASP_TOUCH_FILTER_H
+
+#include <stdint.h>
+
+#define TOUCH_IIR_SHIFT 1  // iir filter weight of the new sample is 1 / 2^shift
+#define TOUCH_MAX_DEFER 20 // ms a sample may be postponed in favor of a pending display refresh
+
+typedef struct
+{
+    int16_t hist_x[3]; // last raw samples for the median
+    int16_t hist_y[3];
+    uint8_t index;
+    int32_t x; // iir output, in 1/16 pixel
+    int32_t y;
+} touch_filter_t;
+
+void touchFilterStart(touch_filter_t * filter, int16_t x, int16_t y);
+void touchFilterAdd(touch_filter_t * filter, int16_t x, int16_t y);
+int16_t touchFilterX(const touch_filter_t * filter);
+int16_t touchFilterY(const touch_filter_t * filter);
+
+bool touchDeferSample(uint32_t elapsed, uint32_t period, bool refresh_pending);
+
+#endif
@@ -0,0 +1,89 @@
+#include "Arduino.h"
+#include "lvgl.h"
+
+#include "hasp_trace.h"
+
+#define TRACE_MAX_PENDING 8 // applied commands waiting for the next flush
+
+/* Upper bound of each histogram bucket in ms, the last bucket collects everything slower */
+static const uint16_t traceBounds[] PROGMEM = {1,  2,  3,  4,  5,  6,   8,   10,  12,  15,  20,   25,
+                                              30, 40, 50, 65, 80, 100, 130, 160, 200, 300, 500, 0xFFFF};
+#define TRACE_BUCKETS (sizeof(traceBounds) / sizeof(traceBounds[0]))
+
+/* Counts per bucket since the last status update.
+ * The touch path is added from the network task, a sample lost in a concurrent reset does not matter. */
+static uint16_t traceHist[TRACE_PATH_COUNT][TRACE_BUCKETS];
+static uint32_t traceCount[TRACE_PATH_COUNT];
+
+static uint32_t tracePending[TRACE_MAX_PENDING]; // receive times of applied commands, in us
+static uint8_t tracePendingCount = 0;
+
+void traceAdd(uint8_t path, uint32_t us)
+{
+    if(path >= TRACE_PATH_COUNT) return;
+
+    uint32_t ms = (us + 999) / 1000;
+    uint8_t i   = 0;
+    while(i < TRACE_BUCKETS - 1 && ms > pgm_read_word(&traceBounds[i])) i++;
+
+    if(traceHist[path][i] < 0xFFFF) traceHist[path][i]++;
+    traceCount[path]++;
+}
+
+/* Called after a queued command is applied, the change is visible once the pending areas are flushed */
+void traceCommandApplied(uint32_t received)
+{
+    lv_disp_t * disp = lv_disp_get_default();
+    if(!disp || disp->inv_p == 0) return; // nothing to redraw
+
+    if(tracePendingCount < TRACE_MAX_PENDING) tracePending[tracePendingCount++] = received;
+}
+
+/* Called from the display monitor callback when a refresh is finished */
+void traceFrameDone()
+{
+    if(tracePendingCount == 0) return;
+
+    uint32_t now = micros();
+    for(uint8_t i = 0; i < tracePendingCount; i++) traceAdd(TRACE_COMMAND_FLUSH, now - tracePending[i]);
+    tracePendingCount = 0;
+}
+
+/* Upper bound of the bucket holding the given percentile, in ms. 0 when there are no samples */
+uint16_t tracePercentile(uint8_t path, uint8_t pct)
+{
+    if(path >= TRACE_PATH_COUNT || traceCount[path] == 0) return 0;
+
+    uint32_t total = 0;
+    for(uint8_t i = 0; i < TRACE_BUCKETS; i++) total += traceHist[path][i];
+
+    uint32_t rank = (total * pct + 99) / 100;
+    uint32_t sum  = 0;
+    for(uint8_t i = 0; i < TRACE_BUCKETS; i++) {
+        sum += traceHist[path][i];
+        if(sum >= rank) return pgm_read_word(&traceBounds[i]);
+    }
+    return pgm_read_word(&traceBounds[TRACE_BUCKETS - 1]);
+}
+
+uint32_t traceGetCount(uint8_t path)
+{
+    return path < TRACE_PATH_COUNT ? traceCount[path] : 0;
+}
+
+void traceGetJson(char * buffer, size_t len)
+{
+    snprintf_P(buffer, len,
+               PSTR("{\"touch\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"count\":%u},"
+                    "\"command\":{\"p50\":%u,\"p95\":%u,\"p99\":%u,\"count\":%u}}"),
+               tracePercentile(TRACE_TOUCH_PUBLISH, 50), tracePercentile(TRACE_TOUCH_PUBLISH, 95),
+               tracePercentile(TRACE_TOUCH_PUBLISH, 99), (unsigned)traceCount[TRACE_TOUCH_PUBLISH],
+               tracePercentile(TRACE_COMMAND_FLUSH, 50), tracePercentile(TRACE_COMMAND_FLUSH, 95),
+               tracePercentile(TRACE_COMMAND_FLUSH, 99), (unsigned)traceCount[TRACE_COMMAND_FLUSH]);
+}
+
+void traceReset()
+{
+    memset(traceHist, 0, sizeof(traceHist));
+    memset(traceCount, 0, sizeof(traceCount));
+}
@@ -0,0 +1,21 @@
+#ifndef HASP_TRACE_H
+#define HASP_TRACE_H
+
+#include <stdint.h>
+
+enum trace_path_t {
+    TRACE_TOUCH_PUBLISH = 0, // touch sample taken -> resulting state published
+    TRACE_COMMAND_FLUSH,     // mqtt command received -> resulting change flushed to the screen
+    TRACE_PATH_COUNT,
+};
+
+void traceAdd(uint8_t path, uint32_t us);
+void traceCommandApplied(uint32_t received);
+void traceFrameDone(void);
+
+uint16_t tracePercentile(uint8_t path, uint8_t pct);
+uint32_t traceGetCount(uint8_t path);
+void traceGetJson(char * buffer, size_t len);
+void traceReset(void);
+
+#endif
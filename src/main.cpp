@@ -9,6 +9,8 @@
 #include "hasp_config.h"
 #include "hasp_tft.h"
 #include "hasp_gui.h"
+#include "hasp_dispatch.h"
+#include "hasp_record.h"
 #include "hasp_ota.h"
 //#include "hasp_ota.h"
 #include "hasp.h"
@@ -51,6 +53,20 @@
 bool isConnected;
 uint8_t mainLoopCounter = 0;
 
+#if HASP_USE_WIFI && HASP_USE_TASKS
+/* Network task, all lvgl calls stay on the loop task and commands cross over through queues */
+void mainNetworkTask(void * parameter)
+{
+    while(true) {
+        bool connected = wifiLoop();
+#if HASP_USE_MQTT
+        mqttLoop(connected);
+#endif
+        delay(5);
+    }
+}
+#endif
+
 void setup()
 {
 #if defined(ARDUINO_ARCH_ESP8266)
@@ -109,6 +125,11 @@ void setup()
 #endif
 
     otaSetup(settings[F("ota")]);
+
+#if HASP_USE_TASKS
+    /* The arduino loop runs on core 1, wifi and mqtt get core 0 */
+    xTaskCreatePinnedToCore(mainNetworkTask, "network", 8192, NULL, 1, NULL, 0);
+#endif
 #endif
 }
 
@@ -127,6 +148,8 @@ void loop()
 
     /* Graphics Loops */
     // tftLoop();
+    recordLoop();   // feed the replayed touches and commands that are due
+    dispatchLoop(); // apply the queued commands right before the refresh
     guiLoop();
 
     /* Application Loops */
@@ -134,11 +157,13 @@ void loop()
 
     /* Network Services Loops */
 #if HASP_USE_WIFI
+#if !HASP_USE_TASKS
     isConnected = wifiLoop();
 
 #if HASP_USE_MQTT
     mqttLoop(isConnected);
 #endif
+#endif
 
 #if HASP_USE_HTTP
     httpLoop();
@@ -165,6 +190,7 @@ void loop()
     // Every Second Loop
     if(millis() - mainLastLoopTime >= 1000) {
         mainLastLoopTime += 1000;
+        guiEverySecond();
         httpEverySecond();
         otaEverySecond();
         mainLoopCounter++;
@@ -0,0 +1,188 @@
+#include <chrono>
+#include <unity.h>
+
+#include "lvgl.h"
+#include "hasp_anim.cpp"
+
+#define TEST_PAGES 4
+
+static lv_disp_buf_t disp_buf;
+static lv_color_t buf[LV_HOR_RES_MAX * 10];
+static lv_obj_t * pages[TEST_PAGES];
+
+static void test_flush(lv_disp_drv_t * disp, const lv_area_t * area, lv_color_t * color_p)
+{
+    lv_disp_flush_ready(disp);
+}
+
+static void test_exec(void * var, lv_anim_value_t value)
+{}
+
+static lv_anim_t test_anim(uint16_t time, bool playback, bool repeat)
+{
+    lv_anim_t a;
+    memset(&a, 0, sizeof(a));
+    a.start    = 0;
+    a.end      = 100;
+    a.time     = time;
+    a.playback = playback;
+    a.repeat   = repeat;
+    return a;
+}
+
+/* Average us per lv_task_handler call while the ticks advance */
+static uint32_t test_handler_time(uint16_t rounds)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(uint16_t i = 0; i < rounds; i++) {
+        lv_tick_inc(5);
+        lv_task_handler();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() / rounds;
+}
+
+/* Spinning preloads on the hidden pages, spread evenly */
+static void test_add_preloads(uint16_t count)
+{
+    for(uint16_t i = 0; i < count; i++) lv_preload_create(pages[1 + i % (TEST_PAGES - 1)], NULL);
+}
+
+static void test_clean_pages(void)
+{
+    for(uint8_t i = 0; i < TEST_PAGES; i++) lv_obj_clean(pages[i]);
+    animDropScreen(NULL);
+}
+
+void test_fast_forward_one_shot(void)
+{
+    lv_anim_t a = test_anim(100, false, false);
+    animFastForward(&a, 40);
+    TEST_ASSERT_EQUAL(40, a.act_time);
+    animFastForward(&a, 1000);
+    TEST_ASSERT_EQUAL(100, a.act_time);
+}
+
+void test_fast_forward_repeat_keeps_phase(void)
+{
+    lv_anim_t a     = test_anim(100, false, true);
+    a.repeat_pause  = 50;
+    animFastForward(&a, 10 * 150 + 30);
+    TEST_ASSERT_EQUAL(30, a.act_time);
+    animFastForward(&a, 100);
+    TEST_ASSERT_EQUAL(-20, a.act_time); // 30 + 100 is 70 ms after the end, 50 ms pause
+}
+
+void test_fast_forward_playback(void)
+{
+    lv_anim_t a      = test_anim(100, true, false);
+    a.playback_pause = 20;
+    animFastForward(&a, 150);
+    TEST_ASSERT_EQUAL(1, a.playback_now);
+    TEST_ASSERT_EQUAL(30, a.act_time);
+    TEST_ASSERT_EQUAL(100, a.start);
+    TEST_ASSERT_EQUAL(0, a.end);
+    animFastForward(&a, 1000);
+    TEST_ASSERT_EQUAL(1, a.playback_now);
+    TEST_ASSERT_EQUAL(100, a.act_time);
+
+    lv_anim_t b      = test_anim(100, true, true);
+    b.playback_pause = 20;
+    b.repeat_pause   = 30;
+    animFastForward(&b, 3 * 250 + 150); // three full periods, then into the playback
+    TEST_ASSERT_EQUAL(1, b.playback_now);
+    TEST_ASSERT_EQUAL(30, b.act_time);
+}
+
+void test_pause_and_resume(void)
+{
+    lv_anim_t a = test_anim(100, false, true);
+    a.var       = lv_obj_create(pages[1], NULL);
+    a.exec_cb   = test_exec;
+    lv_anim_create(&a);
+    lv_anim_t b = a;
+    b.var       = lv_obj_create(pages[0], NULL);
+    lv_anim_create(&b);
+    TEST_ASSERT_EQUAL(2, lv_anim_count_running());
+
+    animPauseHidden(pages, TEST_PAGES, pages[0]);
+    TEST_ASSERT_EQUAL(1, lv_anim_count_running());
+    TEST_ASSERT_EQUAL(1, animGetParkedCount());
+
+    lv_tick_inc(130);
+    animResumeScreen(pages[1]);
+    TEST_ASSERT_EQUAL(2, lv_anim_count_running());
+    TEST_ASSERT_EQUAL(0, animGetParkedCount());
+
+    lv_anim_t * anim = (lv_anim_t *)lv_ll_get_head(&LV_GC_ROOT(_lv_anim_ll));
+    TEST_ASSERT_EQUAL_PTR(a.var, anim->var);
+    TEST_ASSERT_EQUAL(30, anim->act_time);
+
+    test_clean_pages();
+}
+
+void test_resume_drops_replaced(void)
+{
+    lv_anim_t a = test_anim(100, false, true);
+    a.var       = lv_obj_create(pages[1], NULL);
+    a.exec_cb   = test_exec;
+    lv_anim_create(&a);
+    animPauseHidden(pages, TEST_PAGES, pages[0]);
+
+    /* A newer animation of the same property started while the page was hidden */
+    lv_anim_create(&a);
+    animResumeScreen(pages[1]);
+    TEST_ASSERT_EQUAL(1, lv_anim_count_running());
+    TEST_ASSERT_EQUAL(0, animGetParkedCount());
+
+    test_clean_pages();
+}
+
+/* The cost of the task handler depends on the visible page only */
+void test_hidden_animations_cost_nothing(void)
+{
+    lv_preload_create(pages[0], NULL);
+
+    test_add_preloads(6);
+    animPauseHidden(pages, TEST_PAGES, pages[0]);
+    TEST_ASSERT_EQUAL(1, lv_anim_count_running());
+    uint32_t few = test_handler_time(2000);
+
+    test_add_preloads(120);
+    animPauseHidden(pages, TEST_PAGES, pages[0]);
+    TEST_ASSERT_EQUAL(1, lv_anim_count_running());
+    TEST_ASSERT_EQUAL(126, animGetParkedCount());
+    uint32_t many = test_handler_time(2000);
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%u us with 6, %u us with 126 hidden animations", few, many);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(few * 2 + 20, many);
+
+    test_clean_pages();
+}
+
+int main(int argc, char ** argv)
+{
+    lv_init();
+    lv_disp_buf_init(&disp_buf, buf, NULL, LV_HOR_RES_MAX * 10);
+
+    lv_disp_drv_t disp_drv;
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.flush_cb = test_flush;
+    disp_drv.buffer   = &disp_buf;
+    lv_disp_drv_register(&disp_drv);
+
+    animSetup();
+    for(uint8_t i = 0; i < TEST_PAGES; i++) pages[i] = lv_obj_create(NULL, NULL);
+    lv_scr_load(pages[0]);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_fast_forward_one_shot);
+    RUN_TEST(test_fast_forward_repeat_keeps_phase);
+    RUN_TEST(test_fast_forward_playback);
+    RUN_TEST(test_pause_and_resume);
+    RUN_TEST(test_resume_drops_replaced);
+    RUN_TEST(test_hidden_animations_cost_nothing);
+    return UNITY_END();
+}
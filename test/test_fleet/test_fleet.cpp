@@ -0,0 +1,421 @@
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+#include "hasp_mqtt_backoff.cpp"
+
+/**
+ * A fleet of plates against one broker and Home Assistant, in virtual time and in one process.
+ * Every plate has its own identity, object values, script of touches and the reconnect policy of
+ * mqttLoop. The broker stand-in keeps the sessions, subscriptions and retained messages, and accepts a
+ * limited number of connections per second like a small broker busy with the session setup.
+ */
+
+#define FLEET_PLATES 40
+#define FLEET_PAGES 4
+#define FLEET_OBJECTS 12
+#define FLEET_TICK 10             // ms between two mqttLoop calls of a plate
+#define FLEET_DURATION 240000     // ms simulated per run
+#define FLEET_BOOT_SPREAD 2000    // ms over which the plates are powered on
+#define BROKER_CONNECT_RATE 10    // connections the broker accepts per second, more are refused
+#define BROKER_DOWN_AT 60000      // ms, the broker restarts
+#define BROKER_DOWN_FOR 10000     // ms
+#define HA_GROUP_PERIOD 5000      // ms between the group commands of Home Assistant
+#define LOCKSTEP_RETRY 1000       // ms, the old loop retried after every failed blocking connect
+#define FLEET_SECONDS (FLEET_DURATION / 1000)
+
+enum fleet_policy_t { POLICY_LOCKSTEP, POLICY_BACKOFF };
+
+typedef struct
+{
+    char node[16];
+    char group[16];
+    uint8_t mac[6];
+    mqtt_backoff_t backoff;
+    uint32_t last_attempt; // lockstep policy
+    uint32_t script;       // random state of the scripted touches
+    uint32_t next_touch;   // ms
+    uint32_t boot;         // ms
+    bool connected;
+    bool first_connect;
+    uint8_t page;
+    uint16_t values[FLEET_PAGES][FLEET_OBJECTS]; // object tree
+    uint32_t msg_in;
+    uint32_t msg_out;
+    uint32_t connects;
+    uint32_t failures;
+    uint32_t group_commands;
+} plate_t;
+
+typedef struct
+{
+    std::string client_id;
+    std::vector<std::string> subscriptions;
+} session_t;
+
+typedef struct
+{
+    bool up;
+    std::map<uint8_t, session_t> sessions; // by plate
+    std::map<std::string, std::string> retained;
+    uint32_t window;         // second of the accepted connections
+    uint32_t window_accepts; // connections accepted in that second
+    uint32_t in[FLEET_SECONDS];
+    uint32_t out[FLEET_SECONDS];
+    uint32_t attempts[FLEET_SECONDS];
+} broker_t;
+
+static plate_t plates[FLEET_PLATES];
+static broker_t * broker;
+static uint32_t now;
+
+static uint32_t fleet_random(uint32_t * state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool topic_matches(const std::string & filter, const std::string & topic)
+{
+    if(!filter.empty() && filter[filter.size() - 1] == '#') return topic.compare(0, filter.size() - 1, filter, 0,
+                                                                                 filter.size() - 1) == 0;
+    return filter == topic;
+}
+
+static void plate_receive(uint8_t id, const std::string & topic, const std::string & payload);
+
+/* PUBLISH from a client or Home Assistant, delivered to every matching subscription */
+static void broker_publish(const std::string & topic, const std::string & payload, bool retain)
+{
+    broker->in[now / 1000]++;
+    if(retain) broker->retained[topic] = payload;
+    for(std::map<uint8_t, session_t>::iterator it = broker->sessions.begin(); it != broker->sessions.end(); ++it) {
+        for(size_t i = 0; i < it->second.subscriptions.size(); i++) {
+            if(topic_matches(it->second.subscriptions[i], topic)) {
+                broker->out[now / 1000]++;
+                plate_receive(it->first, topic, payload);
+                break;
+            }
+        }
+    }
+}
+
+static void broker_subscribe(uint8_t id, const std::string & filter)
+{
+    broker->in[now / 1000]++;
+    broker->sessions[id].subscriptions.push_back(filter);
+    for(std::map<std::string, std::string>::iterator it = broker->retained.begin(); it != broker->retained.end();
+        ++it) {
+        if(topic_matches(filter, it->first)) {
+            broker->out[now / 1000]++;
+            plate_receive(id, it->first, it->second);
+        }
+    }
+}
+
+/* CONNECT, refused while the broker is down or busy with the connections of this second */
+static bool broker_connect(uint8_t id)
+{
+    broker->attempts[now / 1000]++;
+    if(!broker->up) return false;
+    if(broker->window != now / 1000) {
+        broker->window         = now / 1000;
+        broker->window_accepts = 0;
+    }
+    if(broker->window_accepts >= BROKER_CONNECT_RATE) return false;
+    broker->window_accepts++;
+    broker->in[now / 1000]++;
+    broker->sessions[id].client_id = std::string(plates[id].node) + "-5CCF7F";
+    return true;
+}
+
+/* The broker restarts: every session is gone, the retained messages are persisted */
+static void broker_set_up(bool up)
+{
+    broker->up = up;
+    if(!up) broker->sessions.clear();
+}
+
+static void plate_receive(uint8_t id, const std::string & topic, const std::string & payload)
+{
+    plate_t * plate = &plates[id];
+    unsigned page, obj;
+    plate->msg_in++;
+    if(sscanf(topic.c_str() + topic.find("command/") + 8, "p[%u].b[%u]", &page, &obj) == 2 && page < FLEET_PAGES &&
+       obj < FLEET_OBJECTS)
+        plate->values[page][obj] = atoi(payload.c_str());
+    if(topic.compare(0, 5 + strlen(plate->group), std::string("hasp/") + plate->group) == 0) plate->group_commands++;
+}
+
+static void plate_publish(uint8_t id, const std::string & subtopic, const std::string & payload)
+{
+    plates[id].msg_out++;
+    broker_publish(std::string("hasp/") + plates[id].node + "/" + subtopic, payload, subtopic == "status");
+}
+
+/* mqttReconnect: connect, subscribe to the command topics and publish the status */
+static void plate_reconnect(uint8_t id)
+{
+    plate_t * plate = &plates[id];
+    if(!broker_connect(id)) {
+        plate->failures++;
+        return;
+    }
+    plate->connected = true;
+    plate->connects++;
+
+    std::string node  = std::string("hasp/") + plate->node + "/";
+    std::string group = std::string("hasp/") + plate->group + "/";
+    broker_subscribe(id, group + "command/#");
+    broker_subscribe(id, node + "command/#");
+    broker_subscribe(id, node + "light/#");
+    broker_subscribe(id, node + "brightness/#");
+    broker_subscribe(id, node + "status");
+    plate_publish(id, "status", plate->first_connect ? "OFF" : "ON");
+    plate->first_connect = false;
+}
+
+/* One pass of the loop of a plate: mqttLoop with the reconnect policy, then the scripted touches */
+static void plate_loop(uint8_t id, fleet_policy_t policy)
+{
+    plate_t * plate = &plates[id];
+    if(now < plate->boot) return;
+    if(plate->connected && !broker->sessions.count(id)) plate->connected = false; // connection reset
+
+    if(!plate->connected) {
+        if(policy == POLICY_BACKOFF) {
+            if(mqttBackoffDue(&plate->backoff, now)) {
+                plate_reconnect(id);
+                if(!plate->connected) mqttBackoffFailed(&plate->backoff);
+            }
+        } else if(now - plate->last_attempt >= LOCKSTEP_RETRY) {
+            plate->last_attempt = now;
+            plate_reconnect(id);
+        }
+        return;
+    }
+    mqttBackoffConnected(&plate->backoff, now);
+
+    if(now >= plate->next_touch) {
+        char subtopic[32], payload[8];
+        uint8_t obj = fleet_random(&plate->script) % FLEET_OBJECTS;
+        if(obj == 0) {
+            plate->page = fleet_random(&plate->script) % FLEET_PAGES;
+            snprintf(payload, sizeof(payload), "%u", plate->page);
+            plate_publish(id, "state/page", payload);
+        } else {
+            plate->values[plate->page][obj] = fleet_random(&plate->script) % 256;
+            snprintf(subtopic, sizeof(subtopic), "state/p[%u].b[%u]", plate->page, obj);
+            snprintf(payload, sizeof(payload), "%u", plate->values[plate->page][obj]);
+            plate_publish(id, subtopic, payload);
+        }
+        plate->next_touch = now + 2000 + fleet_random(&plate->script) % 6000;
+    }
+}
+
+/* Home Assistant: a group command every few seconds, e.g. the time on every plate */
+static void home_assistant_loop(void)
+{
+    if(!broker->up || now % HA_GROUP_PERIOD != 0) return;
+    char payload[8];
+    snprintf(payload, sizeof(payload), "%u", now / 1000 % 256);
+    broker_publish("hasp/plates/command/p[0].b[1]", payload, false);
+}
+
+static void fleet_reset(void)
+{
+    for(uint8_t i = 0; i < FLEET_PLATES; i++) {
+        plate_t * plate = &plates[i];
+        memset(plate, 0, sizeof(plate_t));
+        snprintf(plate->node, sizeof(plate->node), "plate%02u", i);
+        snprintf(plate->group, sizeof(plate->group), "plates");
+        uint8_t mac[6] = {0x5C, 0xCF, 0x7F, 0x10, (uint8_t)(i >> 8), (uint8_t)i};
+        memcpy(plate->mac, mac, sizeof(mac));
+        mqttBackoffSeed(&plate->backoff, plate->mac);
+        plate->script        = 0x9E3779B9u ^ (i * 2654435761u);
+        plate->boot          = fleet_random(&plate->script) % FLEET_BOOT_SPREAD;
+        plate->last_attempt  = plate->boot - LOCKSTEP_RETRY;
+        plate->first_connect = true;
+        plate->next_touch    = plate->boot + 3000;
+    }
+}
+
+typedef struct
+{
+    uint32_t peak_down;     // connection attempts in the worst second while the broker is down
+    uint32_t peak_attempts; // connection attempts in the worst second after the broker is back
+    uint32_t failures;      // refused attempts after the restart
+    uint32_t recovery;      // ms from the broker being back to the last plate connected
+    uint32_t peak_in;       // broker messages in, worst second after the restart
+    double steady_in;       // broker messages in per second before the restart
+    double steady_out;
+} fleet_result_t;
+
+static fleet_result_t fleet_run(fleet_policy_t policy, bool restart)
+{
+    static broker_t instance;
+    instance.up = true;
+    instance.sessions.clear();
+    instance.retained.clear();
+    instance.window = instance.window_accepts = 0;
+    memset(instance.in, 0, sizeof(instance.in));
+    memset(instance.out, 0, sizeof(instance.out));
+    memset(instance.attempts, 0, sizeof(instance.attempts));
+    broker = &instance;
+    fleet_reset();
+
+    fleet_result_t result;
+    memset(&result, 0, sizeof(result));
+    uint32_t back         = BROKER_DOWN_AT + BROKER_DOWN_FOR;
+    uint32_t failures     = 0;
+    bool recovered        = !restart;
+    for(now = 0; now < FLEET_DURATION; now += FLEET_TICK) {
+        if(restart && now == BROKER_DOWN_AT) {
+            broker_set_up(false);
+            for(uint8_t i = 0; i < FLEET_PLATES; i++) failures += plates[i].failures;
+        }
+        if(restart && now == back) broker_set_up(true);
+
+        home_assistant_loop();
+        for(uint8_t i = 0; i < FLEET_PLATES; i++) plate_loop(i, policy);
+
+        if(!recovered && now >= back && broker->sessions.size() == FLEET_PLATES) {
+            recovered       = true;
+            result.recovery = now - back;
+        }
+    }
+    if(!recovered) result.recovery = UINT32_MAX;
+
+    for(uint8_t i = 0; i < FLEET_PLATES; i++) result.failures += plates[i].failures;
+    result.failures -= failures;
+    for(uint32_t s = BROKER_DOWN_AT / 1000; s < FLEET_SECONDS; s++) {
+        if(s < back / 1000) {
+            if(broker->attempts[s] > result.peak_down) result.peak_down = broker->attempts[s];
+            continue;
+        }
+        if(broker->attempts[s] > result.peak_attempts) result.peak_attempts = broker->attempts[s];
+        if(broker->in[s] > result.peak_in) result.peak_in = broker->in[s];
+    }
+    for(uint32_t s = 10; s < BROKER_DOWN_AT / 1000; s++) {
+        result.steady_in += broker->in[s];
+        result.steady_out += broker->out[s];
+    }
+    result.steady_in /= BROKER_DOWN_AT / 1000 - 10;
+    result.steady_out /= BROKER_DOWN_AT / 1000 - 10;
+    return result;
+}
+
+/* Delays stay within the equal jitter bounds and every plate gets its own sequence */
+void test_backoff_policy(void)
+{
+    mqtt_backoff_t a, b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    uint8_t mac[6] = {0x5C, 0xCF, 0x7F, 0x10, 0x00, 0x01};
+    mqttBackoffSeed(&a, mac);
+    mac[5] = 0x02;
+    mqttBackoffSeed(&b, mac);
+
+    uint32_t same = 0;
+    for(uint8_t attempt = 0; attempt < 12; attempt++) {
+        uint32_t full = MQTT_RECONNECT_MIN << (attempt > 6 ? 6 : attempt);
+        if(full > MQTT_RECONNECT_MAX) full = MQTT_RECONNECT_MAX;
+        uint32_t da = mqttBackoffFailed(&a);
+        uint32_t db = mqttBackoffFailed(&b);
+        TEST_ASSERT_GREATER_OR_EQUAL(full / 2, da);
+        TEST_ASSERT_LESS_THAN(full, da);
+        if(da == db) same++;
+    }
+    TEST_ASSERT_LESS_THAN(2, same);
+
+    /* Attempts are due after the delay, counted from the start of the last one */
+    a.last_attempt = 1000;
+    a.delay        = 500;
+    TEST_ASSERT_FALSE(mqttBackoffDue(&a, 1499));
+    TEST_ASSERT_TRUE(mqttBackoffDue(&a, 1500));
+    TEST_ASSERT_FALSE(mqttBackoffDue(&a, 1501));
+
+    /* A connection resets the backoff, the first attempt after a loss is within the spread window */
+    mqttBackoffConnected(&a, 5000);
+    TEST_ASSERT_EQUAL(0, a.failed);
+    TEST_ASSERT_LESS_THAN(MQTT_RECONNECT_SPREAD, a.delay);
+}
+
+/* Message rates of the fleet without a restart, every plate applies the group commands */
+void test_fleet_steady_state(void)
+{
+    fleet_result_t result = fleet_run(POLICY_BACKOFF, false);
+    uint32_t commands     = 0;
+    for(uint8_t i = 0; i < FLEET_PLATES; i++) {
+        TEST_ASSERT_TRUE(plates[i].connected);
+        TEST_ASSERT_EQUAL(1, plates[i].connects);
+        TEST_ASSERT_EQUAL((FLEET_DURATION - HA_GROUP_PERIOD) / 1000 % 256, plates[i].values[0][1]);
+        commands += plates[i].group_commands;
+    }
+    TEST_ASSERT_GREATER_OR_EQUAL(FLEET_PLATES * (FLEET_DURATION - FLEET_BOOT_SPREAD - 5000) / HA_GROUP_PERIOD,
+                                 commands);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u plates: %.1f msg/s into the broker, %.1f msg/s out, %u msg out of plate00",
+             FLEET_PLATES, result.steady_in, result.steady_out, plates[0].msg_out);
+    TEST_MESSAGE(msg);
+}
+
+/* After a broker restart, the old lockstep retries against the per plate backoff */
+void test_fleet_reconnect_storm(void)
+{
+    fleet_result_t lockstep = fleet_run(POLICY_LOCKSTEP, true);
+    fleet_result_t backoff  = fleet_run(POLICY_BACKOFF, true);
+    for(uint8_t i = 0; i < FLEET_PLATES; i++) TEST_ASSERT_TRUE(plates[i].connected);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "lockstep: %2u/%2u attempts/s peak down/up, %3u refused, %5u ms to reconnect, %u msg/s",
+             lockstep.peak_down, lockstep.peak_attempts, lockstep.failures, lockstep.recovery, lockstep.peak_in);
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "backoff:  %2u/%2u attempts/s peak down/up, %3u refused, %5u ms to reconnect, %u msg/s",
+             backoff.peak_down, backoff.peak_attempts, backoff.failures, backoff.recovery, backoff.peak_in);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL(FLEET_PLATES, lockstep.peak_attempts); // every plate at once
+    TEST_ASSERT_LESS_THAN(lockstep.peak_down, backoff.peak_down);
+    TEST_ASSERT_LESS_OR_EQUAL(BROKER_CONNECT_RATE, backoff.peak_attempts);
+    TEST_ASSERT_LESS_THAN(lockstep.failures / 2, backoff.failures);
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_RECONNECT_MAX, backoff.recovery);
+}
+
+/* Memory per plate: its state in the simulation and its session on the broker */
+void test_fleet_memory(void)
+{
+    fleet_run(POLICY_BACKOFF, false);
+    size_t session = 0;
+    for(std::map<uint8_t, session_t>::iterator it = broker->sessions.begin(); it != broker->sessions.end(); ++it) {
+        session += sizeof(session_t) + it->second.client_id.capacity();
+        for(size_t i = 0; i < it->second.subscriptions.size(); i++)
+            session += sizeof(std::string) + it->second.subscriptions[i].capacity();
+    }
+    size_t retained = 0;
+    for(std::map<std::string, std::string>::iterator it = broker->retained.begin(); it != broker->retained.end(); ++it)
+        retained += it->first.size() + it->second.size();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "per plate: %zu bytes of plate state, %zu bytes of broker session, %zu retained",
+             sizeof(plate_t), session / FLEET_PLATES, retained / FLEET_PLATES);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(FLEET_PLATES, broker->retained.size()); // one status per plate
+}
+
+int main(int argc, char ** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_policy);
+    RUN_TEST(test_fleet_steady_state);
+    RUN_TEST(test_fleet_reconnect_storm);
+    RUN_TEST(test_fleet_memory);
+    return UNITY_END();
+}
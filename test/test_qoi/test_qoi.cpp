@@ -0,0 +1,211 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <unity.h>
+
+#include "hasp_qoi.cpp"
+
+static std::vector<uint8_t> stream;
+
+static void test_write(const uint8_t * data, uint16_t len)
+{
+    TEST_ASSERT_LESS_OR_EQUAL(sizeof(((qoi_encoder_t *)0)->out), len);
+    stream.insert(stream.end(), data, data + len);
+}
+
+static uint32_t rgb565_to_rgb(uint16_t c)
+{
+    uint8_t r = c >> 11, g = (c >> 5) & 0x3F, b = c & 0x1F;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return (r << 16) | (g << 8) | b;
+}
+
+static uint16_t rgb565(uint8_t r, uint8_t g, uint8_t b)
+{
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+/* Reference decoder written from the QOI specification, returns 0xRRGGBB pixels */
+static bool qoi_decode(const std::vector<uint8_t> & data, uint32_t * w, uint32_t * h, std::vector<uint32_t> & px)
+{
+    if(data.size() < 22 || memcmp(data.data(), "qoif", 4)) return false;
+    *w = data[4] << 24 | data[5] << 16 | data[6] << 8 | data[7];
+    *h = data[8] << 24 | data[9] << 16 | data[10] << 8 | data[11];
+    if(data[12] != 3 || data[13] != 0) return false;
+
+    uint8_t index[64][4] = {{0}};
+    uint8_t r = 0, g = 0, b = 0, a = 255;
+    size_t p  = 14;
+    px.clear();
+    while(px.size() < (size_t)*w * *h) {
+        if(p >= data.size() - 8) return false;
+        uint8_t op  = data[p++];
+        uint8_t run = 1;
+        if(op == 0xFE) {
+            r = data[p++];
+            g = data[p++];
+            b = data[p++];
+        } else if(op == 0xFF) {
+            r = data[p++];
+            g = data[p++];
+            b = data[p++];
+            a = data[p++];
+        } else if((op & 0xC0) == 0x00) {
+            r = index[op][0];
+            g = index[op][1];
+            b = index[op][2];
+            a = index[op][3];
+        } else if((op & 0xC0) == 0x40) {
+            r += ((op >> 4) & 3) - 2;
+            g += ((op >> 2) & 3) - 2;
+            b += (op & 3) - 2;
+        } else if((op & 0xC0) == 0x80) {
+            uint8_t b2 = data[p++];
+            int8_t dg  = (op & 0x3F) - 32;
+            r += dg - 8 + (b2 >> 4);
+            g += dg;
+            b += dg - 8 + (b2 & 0x0F);
+        } else {
+            run = (op & 0x3F) + 1;
+        }
+        uint8_t hash    = (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+        index[hash][0]  = r;
+        index[hash][1]  = g;
+        index[hash][2]  = b;
+        index[hash][3]  = a;
+        while(run--) px.push_back(r << 16 | g << 8 | b);
+    }
+
+    static const uint8_t end[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    return p + 8 == data.size() && memcmp(&data[p], end, 8) == 0;
+}
+
+/* Encode an image the way the flush callback does, in bands of band rows */
+static void encode(const std::vector<uint16_t> & img, uint32_t w, uint32_t h, uint32_t band)
+{
+    static qoi_encoder_t qoi;
+    stream.clear();
+    qoiStart(&qoi, test_write, w, h);
+    for(uint32_t y = 0; y < h; y += band) {
+        uint32_t rows = y + band > h ? h - y : band;
+        qoiEncodeRgb565(&qoi, &img[y * w], rows * w);
+    }
+    qoiFinish(&qoi);
+    TEST_ASSERT_EQUAL(stream.size(), qoi.size);
+}
+
+static void check_roundtrip(const std::vector<uint16_t> & img, uint32_t w, uint32_t h)
+{
+    uint32_t dw, dh;
+    std::vector<uint32_t> px;
+    TEST_ASSERT_TRUE(qoi_decode(stream, &dw, &dh, px));
+    TEST_ASSERT_EQUAL(w, dw);
+    TEST_ASSERT_EQUAL(h, dh);
+    for(size_t i = 0; i < img.size(); i++) TEST_ASSERT_EQUAL_HEX32(rgb565_to_rgb(img[i]), px[i]);
+}
+
+/* A dashboard page: dark background, buttons with a border and antialiased text, a gradient slider */
+static std::vector<uint16_t> dashboard(uint32_t w, uint32_t h, uint32_t seed)
+{
+    std::vector<uint16_t> img(w * h, rgb565(0x20, 0x24, 0x2C));
+    srand(seed);
+    for(uint32_t by = 10; by + 60 < h - 50; by += 70) {
+        for(uint32_t bx = 10; bx + 100 <= w; bx += 110) {
+            for(uint32_t y = by; y < by + 60; y++) {
+                for(uint32_t x = bx; x < bx + 100; x++) {
+                    bool border       = y == by || y == by + 59 || x == bx || x == bx + 99;
+                    img[y * w + x]    = border ? rgb565(0x60, 0x90, 0xC0) : rgb565(0x30, 0x50, 0x70);
+                }
+            }
+            /* A line of text: glyph cells of ink with antialiased edges */
+            for(uint32_t x = bx + 10; x < bx + 90; x++) {
+                for(uint32_t y = by + 24; y < by + 36; y++) {
+                    uint8_t ink = rand() % 4 == 0 ? 0xFF : rand() % 3 == 0 ? 0x80 : 0x00;
+                    if(ink) img[y * w + x] = rgb565(ink, ink, ink);
+                }
+            }
+        }
+    }
+    for(uint32_t y = h - 30; y < h - 20; y++) {
+        for(uint32_t x = 10; x < w - 10; x++) img[y * w + x] = rgb565(x * 255 / w, 0x80, 0xFF - x * 255 / w);
+    }
+    return img;
+}
+
+void test_roundtrip_all_ops(void)
+{
+    /* Runs longer than 62, index hits, small and luma diffs and full rgb values */
+    uint32_t w = 97, h = 13;
+    std::vector<uint16_t> img(w * h);
+    srand(7);
+    for(size_t i = 0; i < img.size(); i++) {
+        if(i < 150)
+            img[i] = 0;
+        else if(i % 5 == 0)
+            img[i] = img[i - 3];
+        else if(i % 7 == 0)
+            img[i] = img[i - 1] + 0x0821;
+        else
+            img[i] = rand();
+    }
+    encode(img, w, h, 1);
+    check_roundtrip(img, w, h);
+}
+
+void test_bands_match_single_pass(void)
+{
+    std::vector<uint16_t> img = dashboard(240, 320, 1);
+    encode(img, 240, 320, 320);
+    std::vector<uint8_t> single = stream;
+    encode(img, 240, 320, 7);
+    TEST_ASSERT_EQUAL(single.size(), stream.size());
+    TEST_ASSERT_EQUAL_MEMORY(single.data(), stream.data(), single.size());
+}
+
+/* A run pending when the output buffer is nearly full must still fit with the end marker */
+void test_finish_on_full_buffer(void)
+{
+    for(uint32_t n = 480; n < 520; n++) {
+        std::vector<uint16_t> img(n + 10);
+        for(uint32_t i = 0; i < n; i++) img[i] = i & 1 ? 0xFFFF : 0x1234; // 4 bytes per pixel at first
+        for(uint32_t i = n; i < img.size(); i++) img[i] = 0x0000;
+        encode(img, img.size(), 1, 1);
+        check_roundtrip(img, img.size(), 1);
+    }
+}
+
+/* Bytes and time per screenshot of dashboard pages, against the 16-bit bitmap */
+void test_benchmark_dashboard(void)
+{
+    static const uint32_t res[][2] = {{128, 160}, {240, 320}, {480, 320}};
+    for(uint8_t i = 0; i < 3; i++) {
+        uint32_t w = res[i][0], h = res[i][1];
+        std::vector<uint16_t> img = dashboard(w, h, i);
+
+        auto start = std::chrono::steady_clock::now();
+        for(uint8_t n = 0; n < 20; n++) encode(img, w, h, 10);
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double ms    = std::chrono::duration<double, std::milli>(elapsed).count() / 20;
+
+        check_roundtrip(img, w, h);
+        uint32_t bmp = 122 + w * h * 2;
+        char msg[128];
+        snprintf(msg, sizeof(msg), "%ux%u: %zu bytes qoi, %u bytes bmp (%.1f%%), %.2f ms on the host", w, h,
+                 stream.size(), bmp, 100.0 * stream.size() / bmp, ms);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_LESS_THAN(bmp / 4, stream.size());
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_roundtrip_all_ops);
+    RUN_TEST(test_bands_match_single_pass);
+    RUN_TEST(test_finish_on_full_buffer);
+    RUN_TEST(test_benchmark_dashboard);
+    return UNITY_END();
+}
@@ -0,0 +1,215 @@
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unity.h>
+
+#include "hasp_queue.h"
+
+#define STRESS_ITEMS 200000
+
+/* Sequence numbers from one producer thread arrive in order, none lost or repeated */
+void test_queue_order_under_stress(void)
+{
+    static HaspQueue<uint32_t, 16> queue;
+    uint32_t full = 0;
+
+    std::thread producer([&]() {
+        for(uint32_t i = 0; i < STRESS_ITEMS; i++) {
+            uint32_t * item;
+            while((item = queue.back()) == NULL) {
+                full++;
+                std::this_thread::yield();
+            }
+            *item = i;
+            queue.push();
+        }
+    });
+
+    uint32_t expected = 0;
+    while(expected < STRESS_ITEMS) {
+        uint32_t * item = queue.front();
+        if(!item) {
+            std::this_thread::yield();
+            continue;
+        }
+        if(*item != expected) TEST_ASSERT_EQUAL_UINT32(expected, *item);
+        expected++;
+        queue.pop();
+    }
+    producer.join();
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%u items, producer found the queue full %u times", STRESS_ITEMS, full);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_NULL(queue.front());
+    TEST_ASSERT_EQUAL(0, queue.size());
+}
+
+void test_queue_full_and_peek(void)
+{
+    HaspQueue<uint32_t, 4> queue;
+    for(uint32_t i = 0; i < 4; i++) {
+        uint32_t * item = queue.back();
+        TEST_ASSERT_NOT_NULL(item);
+        *item = i;
+        queue.push();
+    }
+    TEST_ASSERT_NULL(queue.back());
+    TEST_ASSERT_EQUAL(4, queue.size());
+
+    for(uint8_t i = 0; i < 4; i++) TEST_ASSERT_EQUAL_UINT32(i, *queue.front(i));
+    TEST_ASSERT_NULL(queue.front(4));
+
+    queue.pop();
+    TEST_ASSERT_NOT_NULL(queue.back());
+    TEST_ASSERT_EQUAL_UINT32(1, *queue.front());
+}
+
+/* The head and tail counters are 8 bits, they wrap many times during a long run */
+void test_queue_counter_wrap(void)
+{
+    HaspQueue<uint32_t, 128> queue;
+    for(uint32_t round = 0; round < 1000; round++) {
+        for(uint32_t i = 0; i < 100; i++) {
+            *queue.back() = round * 100 + i;
+            queue.push();
+        }
+        TEST_ASSERT_EQUAL(100, queue.size());
+        for(uint32_t i = 0; i < 100; i++) {
+            TEST_ASSERT_EQUAL_UINT32(round * 100 + i, *queue.front());
+            queue.pop();
+        }
+    }
+}
+
+/* Slots with heap payloads, like the queued mqtt states: the consumer sees the complete strings */
+void test_queue_string_payloads(void)
+{
+    typedef struct
+    {
+        std::string subtopic;
+        std::string payload;
+    } item_t;
+    static HaspQueue<item_t, 16> queue;
+
+    std::thread producer([&]() {
+        char buffer[64];
+        for(uint32_t i = 0; i < STRESS_ITEMS / 10; i++) {
+            item_t * item;
+            while((item = queue.back()) == NULL) std::this_thread::yield();
+            snprintf(buffer, sizeof(buffer), "p[%u].b[%u].val", i % 12, i % 255);
+            item->subtopic = buffer;
+            item->payload  = std::string(i % 200, 'a' + i % 26);
+            queue.push();
+        }
+    });
+
+    char buffer[64];
+    for(uint32_t i = 0; i < STRESS_ITEMS / 10; i++) {
+        item_t * item;
+        while((item = queue.front()) == NULL) std::this_thread::yield();
+        snprintf(buffer, sizeof(buffer), "p[%u].b[%u].val", i % 12, i % 255);
+        if(item->subtopic != buffer || item->payload != std::string(i % 200, 'a' + i % 26)) {
+            TEST_FAIL_MESSAGE("payload torn or out of order");
+        }
+        item->subtopic = "";
+        item->payload  = "";
+        queue.pop();
+    }
+    producer.join();
+}
+
+/**
+ * The pattern of the mqtt control queue: a gui thread and an event thread queue config and stop
+ * requests under a mutex, and only the network thread touches the client. The client is not
+ * thread-safe, a second thread inside it would be caught by the busy flag.
+ */
+typedef struct
+{
+    uint8_t type;
+    uint8_t source;
+    uint32_t seq;
+} control_t;
+
+typedef struct
+{
+    std::atomic<bool> busy{false};
+    std::thread::id owner;
+    uint32_t applied[2]  = {0, 0};
+    bool overlapped      = false;
+    bool foreign_thread  = false;
+    bool out_of_order    = false;
+} client_t;
+
+static void client_apply(client_t * client, const control_t * item)
+{
+    if(client->busy.exchange(true)) client->overlapped = true;
+    if(std::this_thread::get_id() != client->owner) client->foreign_thread = true;
+    if(item->seq != client->applied[item->source]) client->out_of_order = true;
+    client->applied[item->source] = item->seq + 1;
+    client->busy = false;
+}
+
+void test_control_applied_on_network_thread(void)
+{
+    static HaspQueue<control_t, 4> queue;
+    static client_t client;
+    std::mutex producer_mutex;
+    std::atomic<bool> done{false};
+    const uint32_t requests = STRESS_ITEMS / 10;
+
+    auto enqueue = [&](uint8_t source, uint32_t seq) {
+        while(true) {
+            {
+                std::lock_guard<std::mutex> lock(producer_mutex);
+                control_t * item = queue.back();
+                if(item) {
+                    item->type   = seq % 2;
+                    item->source = source;
+                    item->seq    = seq;
+                    queue.push();
+                    return;
+                }
+            }
+            std::this_thread::yield(); // queue full, let the network thread drain it
+        }
+    };
+
+    std::thread network([&]() {
+        client.owner = std::this_thread::get_id();
+        while(!done || queue.front()) {
+            control_t * item;
+            while((item = queue.front()) != NULL) {
+                client_apply(&client, item);
+                queue.pop();
+            }
+            std::this_thread::yield(); // mqttClient.loop() and the reconnects
+        }
+    });
+    std::thread event([&]() {
+        for(uint32_t i = 0; i < requests; i++) enqueue(1, i);
+    });
+    for(uint32_t i = 0; i < requests; i++) enqueue(0, i);
+
+    event.join();
+    done = true;
+    network.join();
+
+    TEST_ASSERT_FALSE(client.overlapped);
+    TEST_ASSERT_FALSE(client.foreign_thread);
+    TEST_ASSERT_FALSE(client.out_of_order);
+    TEST_ASSERT_EQUAL_UINT32(requests, client.applied[0]);
+    TEST_ASSERT_EQUAL_UINT32(requests, client.applied[1]);
+}
+
+int main(int argc, char ** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_order_under_stress);
+    RUN_TEST(test_queue_full_and_peek);
+    RUN_TEST(test_queue_counter_wrap);
+    RUN_TEST(test_queue_string_payloads);
+    RUN_TEST(test_control_applied_on_network_thread);
+    return UNITY_END();
+}
@@ -0,0 +1,2 @@
+/* The default font of the native lv_conf.h */
+#include "../../src/unscii_8_icon.c"
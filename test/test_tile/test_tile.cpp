@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+
+#include "lvgl.h"
+
+#define HASP_USE_GLYPH_TILES 1
+#include "hasp_text.cpp"
+#include "hasp_tile.cpp"
+
+#define TEST_TEXT "Living room 21.5 C\nHumidity 48 %, wind NNE 12 km/h\n{[(|)]} @#$&*+=?!"
+
+static lv_disp_buf_t disp_buf;
+static lv_color_t buf[LV_HOR_RES_MAX * 10]; // bands of 10 rows, glyphs are split between two flushes
+static lv_color_t framebuffer[LV_HOR_RES_MAX * LV_VER_RES_MAX];
+static lv_color_t expected[LV_HOR_RES_MAX * LV_VER_RES_MAX];
+
+static lv_font_t fonts[4];
+static const uint8_t font_bpp[4] = {1, 2, 4, 8};
+static uint8_t glyph_bitmap[16 * 16];
+static lv_style_t screen_style;
+static lv_style_t label_styles[8]; // one per label of a scene
+static uint8_t label_count;
+
+static void test_flush(lv_disp_drv_t * disp, const lv_area_t * area, lv_color_t * color_p)
+{
+    lv_coord_t w = lv_area_get_width(area);
+    for(lv_coord_t y = area->y1; y <= area->y2; y++) {
+        memcpy(&framebuffer[y * LV_HOR_RES_MAX + area->x1], color_p, w * sizeof(lv_color_t));
+        color_p += w;
+    }
+    lv_disp_flush_ready(disp);
+}
+
+/**
+ * A font made up on the fly: every pixel value of the bpp shows up, and some glyphs reach left of their
+ * advance, so they overlap the previous glyph.
+ */
+static bool test_glyph_dsc(const lv_font_t * font, lv_font_glyph_dsc_t * dsc, uint32_t letter, uint32_t next)
+{
+    if(letter < 0x20 || letter > 0x7E) return false;
+    memset(dsc, 0, sizeof(lv_font_glyph_dsc_t));
+    dsc->adv_w = 7;
+    dsc->bpp   = *(const uint8_t *)font->dsc;
+    if(letter == ' ') return true;
+    dsc->box_w = 5 + letter % 4;
+    dsc->box_h = 8 + letter % 3;
+    dsc->ofs_x = letter % 7 == 0 ? -2 : 0;
+    dsc->ofs_y = -(int8_t)(letter % 3);
+    return true;
+}
+
+static const uint8_t * test_glyph_bitmap(const lv_font_t * font, uint32_t letter)
+{
+    lv_font_glyph_dsc_t g;
+    if(!test_glyph_dsc(font, &g, letter, 0)) return NULL;
+
+    memset(glyph_bitmap, 0, sizeof(glyph_bitmap));
+    uint32_t bit = 0;
+    for(uint32_t i = 0; i < (uint32_t)g.box_w * g.box_h; i++, bit += g.bpp) {
+        uint8_t px = i % 3 == 0 ? 0 : (letter * 31 + i * 17) & ((1 << g.bpp) - 1);
+        glyph_bitmap[bit >> 3] |= px << (8 - g.bpp - (bit & 7));
+    }
+    return glyph_bitmap;
+}
+
+static void test_screen(lv_color_t main, lv_color_t grad)
+{
+    lv_obj_clean(lv_scr_act());
+    screen_style.body.main_color = main;
+    screen_style.body.grad_color = grad;
+    lv_obj_set_style(lv_scr_act(), &screen_style);
+    label_count = 0;
+    textFlushFont(NULL);
+    tileFlushFont(NULL);
+}
+
+static lv_obj_t * test_label(lv_obj_t * parent, uint8_t font, lv_color_t color, lv_label_long_mode_t mode,
+                             lv_label_align_t align, lv_coord_t x, lv_coord_t y)
+{
+    lv_style_t * style = &label_styles[label_count++];
+    lv_style_copy(style, &lv_style_plain);
+    style->text.font  = &fonts[font];
+    style->text.color = color;
+
+    lv_obj_t * label = lv_label_create(parent, NULL);
+    lv_label_set_style(label, LV_LABEL_STYLE_MAIN, style);
+    lv_label_set_long_mode(label, mode);
+    lv_label_set_align(label, align);
+    if(mode != LV_LABEL_LONG_EXPAND) lv_obj_set_width(label, 150);
+    lv_label_set_text(label, TEST_TEXT);
+    lv_obj_set_pos(label, x, y);
+    tileAttach(label);
+    return label;
+}
+
+static void test_render(lv_color_t * out)
+{
+    lv_obj_invalidate(lv_scr_act());
+    lv_refr_now(NULL);
+    if(out) memcpy(out, framebuffer, sizeof(framebuffer));
+}
+
+/* Draw the screen with lv_draw_letter, then twice with tiles for the misses and the hits, pixel by pixel */
+static void test_compare(const char * scene)
+{
+    tileSetEnabled(false);
+    test_render(expected);
+    tileSetEnabled(true);
+
+    for(uint8_t pass = 0; pass < 2; pass++) {
+        test_render(NULL);
+        for(uint32_t i = 0; i < LV_HOR_RES_MAX * LV_VER_RES_MAX; i++) {
+            if(framebuffer[i].full == expected[i].full) continue;
+            char msg[128];
+            snprintf(msg, sizeof(msg), "%s, pass %u: pixel %u,%u is %04X, lv_draw_letter drew %04X", scene, pass,
+                     i % LV_HOR_RES_MAX, i / LV_HOR_RES_MAX, framebuffer[i].full, expected[i].full);
+            TEST_FAIL_MESSAGE(msg);
+        }
+    }
+}
+
+void test_tiles_match_every_bpp(void)
+{
+    char scene[32];
+    for(uint8_t font = 0; font < 4; font++) {
+        test_screen(LV_COLOR_MAKE(0x10, 0x30, 0x60), LV_COLOR_MAKE(0x10, 0x30, 0x60));
+        test_label(lv_scr_act(), font, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 4, 3);
+        test_label(lv_scr_act(), font, LV_COLOR_MAKE(0xF0, 0xA0, 0x20), LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_CENTER,
+                   60, 75);
+        test_label(lv_scr_act(), font, LV_COLOR_MAKE(0x60, 0xE0, 0x90), LV_LABEL_LONG_EXPAND, LV_LABEL_ALIGN_RIGHT, 2,
+                   150);
+        test_label(lv_scr_act(), font, LV_COLOR_MAKE(0x10, 0x30, 0x60), LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 80,
+                   220); // text in the background color
+
+        tile_stats_t before, after;
+        tileGetStats(&before);
+        snprintf(scene, sizeof(scene), "%u bpp", font_bpp[font]);
+        test_compare(scene);
+        tileGetStats(&after);
+        TEST_ASSERT_GREATER_THAN(before.misses, after.misses);
+        TEST_ASSERT_GREATER_THAN(before.hits, after.hits);
+    }
+}
+
+/* Labels off the edges of the screen and of a parent object, the mask cuts through the glyphs */
+void test_tiles_match_clipped(void)
+{
+    test_screen(LV_COLOR_BLACK, LV_COLOR_BLACK);
+    lv_obj_t * box = lv_obj_create(lv_scr_act(), NULL);
+    lv_obj_set_style(box, &screen_style);
+    lv_obj_set_pos(box, 30, 40);
+    lv_obj_set_size(box, 61, 33);
+
+    test_label(box, 2, LV_COLOR_YELLOW, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, -7, -5);
+    test_label(lv_scr_act(), 2, LV_COLOR_CYAN, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, -9, 120);
+    test_label(lv_scr_act(), 3, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_RIGHT, LV_HOR_RES_MAX - 100,
+               LV_VER_RES_MAX - 20);
+    test_compare("clipped");
+}
+
+/* Glyphs on a gradient or on the previous glyph are blended by LVGL, the result is the same */
+void test_tiles_fall_back(void)
+{
+    test_screen(LV_COLOR_MAKE(0x20, 0x20, 0x20), LV_COLOR_MAKE(0xC0, 0x40, 0x40));
+    test_label(lv_scr_act(), 2, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 10, 10);
+
+    tile_stats_t before, after;
+    tileGetStats(&before);
+    test_compare("gradient");
+    tileGetStats(&after);
+    TEST_ASSERT_GREATER_THAN(before.fallbacks, after.fallbacks);
+
+    /* Letters that are a multiple of 7 reach 2 px into the previous glyph */
+    test_screen(LV_COLOR_BLACK, LV_COLOR_BLACK);
+    lv_obj_t * label = test_label(lv_scr_act(), 2, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 10, 10);
+    lv_label_set_text(label, "#*18?FMT[bipw~");
+    tileGetStats(&before);
+    test_compare("overlap");
+    tileGetStats(&after);
+    TEST_ASSERT_GREATER_THAN(before.fallbacks, after.fallbacks);
+}
+
+/* A label drawing its body, a label shortened with dots, and a transparent label the tiles leave to LVGL */
+void test_tiles_match_other_labels(void)
+{
+    test_screen(LV_COLOR_NAVY, LV_COLOR_NAVY);
+
+    lv_obj_t * body    = test_label(lv_scr_act(), 2, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 10, 10);
+    lv_style_t * style = &label_styles[label_count - 1];
+    style->body.main_color   = LV_COLOR_MAROON;
+    style->body.grad_color   = LV_COLOR_MAROON;
+    style->body.padding.left = 3;
+    style->body.padding.top  = 3;
+    lv_label_set_body_draw(body, true);
+    lv_obj_refresh_style(body);
+
+    lv_obj_t * faded = test_label(lv_scr_act(), 1, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_LEFT, 10, 100);
+    lv_obj_set_opa_scale_enable(faded, true);
+    lv_obj_set_opa_scale(faded, LV_OPA_60);
+
+    lv_obj_t * dot = test_label(lv_scr_act(), 3, LV_COLOR_WHITE, LV_LABEL_LONG_DOT, LV_LABEL_ALIGN_LEFT, 10, 180);
+    lv_obj_set_height(dot, 30);
+    test_compare("body, opacity and dots");
+}
+
+/* The sizes of the layouts are the sizes lv_txt_get_size adds up line by line */
+void test_layout_sizes(void)
+{
+    static const char * texts[] = {"", "21.5", "Living room\n", "\n\n", TEST_TEXT,
+                                   "A line that wraps more than once at the width of a narrow label"};
+    static const lv_coord_t widths[]   = {20, 61, 150, LV_COORD_MAX};
+    static const lv_txt_flag_t flags[] = {LV_TXT_FLAG_NONE, LV_TXT_FLAG_EXPAND, LV_TXT_FLAG_FIT,
+                                          LV_TXT_FLAG_CENTER | LV_TXT_FLAG_RECOLOR};
+    const lv_font_t * font_list[]      = {&fonts[2], LV_FONT_DEFAULT};
+
+    textFlushFont(NULL);
+    for(uint8_t f = 0; f < 2; f++) {
+        for(uint8_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+            for(uint8_t w = 0; w < 4; w++) {
+                for(uint8_t i = 0; i < 4; i++) {
+                    lv_point_t expected_size, size;
+                    __real_lv_txt_get_size(&expected_size, texts[t], font_list[f], 1, 3, widths[w], flags[i]);
+                    lv_txt_get_size(&size, texts[t], font_list[f], 1, 3, widths[w], flags[i]);
+                    if(size.x == expected_size.x && size.y == expected_size.y) continue;
+
+                    char msg[128];
+                    snprintf(msg, sizeof(msg), "text %u, width %d, flags %u: %dx%d instead of %dx%d", t, widths[w],
+                             flags[i], size.x, size.y, expected_size.x, expected_size.y);
+                    TEST_FAIL_MESSAGE(msg);
+                }
+            }
+        }
+    }
+}
+
+/* The relayout of a label and its drawing with tiles share one layout */
+void test_layout_shared_by_relayout_and_draw(void)
+{
+    test_screen(LV_COLOR_BLACK, LV_COLOR_BLACK);
+    lv_obj_t * label = test_label(lv_scr_act(), 2, LV_COLOR_WHITE, LV_LABEL_LONG_BREAK, LV_LABEL_ALIGN_CENTER, 0, 0);
+
+    text_stats_t before, after;
+    textGetStats(&before);
+    lv_label_set_text(label, TEST_TEXT);
+    test_render(NULL);
+    textGetStats(&after);
+    TEST_ASSERT_EQUAL(0, after.misses - before.misses);
+    TEST_ASSERT_GREATER_OR_EQUAL(2, after.hits - before.hits);
+}
+
+int main(int argc, char ** argv)
+{
+    lv_init();
+    lv_disp_buf_init(&disp_buf, buf, NULL, LV_HOR_RES_MAX * 10);
+
+    lv_disp_drv_t disp_drv;
+    lv_disp_drv_init(&disp_drv);
+    disp_drv.flush_cb = test_flush;
+    disp_drv.buffer   = &disp_buf;
+    lv_disp_drv_register(&disp_drv);
+
+    lv_style_copy(&screen_style, &lv_style_plain);
+    for(uint8_t i = 0; i < 4; i++) {
+        memset(&fonts[i], 0, sizeof(lv_font_t));
+        fonts[i].get_glyph_dsc    = test_glyph_dsc;
+        fonts[i].get_glyph_bitmap = test_glyph_bitmap;
+        fonts[i].line_height      = 12;
+        fonts[i].base_line        = 2;
+        fonts[i].dsc              = (void *)&font_bpp[i];
+    }
+
+    UNITY_BEGIN();
+    RUN_TEST(test_tiles_match_every_bpp);
+    RUN_TEST(test_tiles_match_clipped);
+    RUN_TEST(test_tiles_fall_back);
+    RUN_TEST(test_tiles_match_other_labels);
+    RUN_TEST(test_layout_sizes);
+    RUN_TEST(test_layout_shared_by_relayout_and_draw);
+    return UNITY_END();
+}
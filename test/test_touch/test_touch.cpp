@@ -0,0 +1,211 @@
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+
+#include "hasp_touch_filter.cpp"
+
+#define TRACE_LEN 200
+
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+} trace_point_t;
+
+/* Deterministic noise, so every run sees the same trace */
+static uint32_t seed;
+static int16_t trace_noise(int16_t amplitude)
+{
+    seed = seed * 1103515245u + 12345u;
+    return (int16_t)((seed >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+/**
+ * A pen held still at (100,100), shaped like a resistive panel trace: a few pixels of noise,
+ * and every 17th sample a spike from a bouncing contact.
+ */
+static void trace_still(trace_point_t * trace, uint16_t len)
+{
+    seed = 1;
+    for(uint16_t i = 0; i < len; i++) {
+        trace[i].x = 100 + trace_noise(3);
+        trace[i].y = 100 + trace_noise(3);
+        if(i % 17 == 16) {
+            trace[i].x += 60;
+            trace[i].y -= 45;
+        }
+    }
+}
+
+static double trace_deviation(const int16_t * v, uint16_t len, int16_t truth, int16_t * peak)
+{
+    double sum = 0;
+    *peak      = 0;
+    for(uint16_t i = 0; i < len; i++) {
+        int16_t d = abs(v[i] - truth);
+        if(d > *peak) *peak = d;
+        sum += (double)d * d;
+    }
+    return sqrt(sum / len);
+}
+
+void test_filter_rejects_spikes_and_jitter(void)
+{
+    trace_point_t trace[TRACE_LEN];
+    int16_t raw[TRACE_LEN];
+    int16_t out[TRACE_LEN];
+    touch_filter_t filter;
+
+    trace_still(trace, TRACE_LEN);
+    touchFilterStart(&filter, trace[0].x, trace[0].y);
+    for(uint16_t i = 0; i < TRACE_LEN; i++) {
+        if(i > 0) touchFilterAdd(&filter, trace[i].x, trace[i].y);
+        raw[i] = trace[i].x;
+        out[i] = touchFilterX(&filter);
+    }
+
+    int16_t raw_peak, out_peak;
+    double raw_rms = trace_deviation(raw, TRACE_LEN, 100, &raw_peak);
+    double out_rms = trace_deviation(out, TRACE_LEN, 100, &out_peak);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "jitter rms %.2f -> %.2f px, peak %d -> %d px", raw_rms, out_rms, raw_peak, out_peak);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_GREATER_OR_EQUAL(60, raw_peak);
+    TEST_ASSERT_LESS_OR_EQUAL(4, out_peak); // no spike gets through the median
+    TEST_ASSERT_TRUE(out_rms < raw_rms / 4);
+}
+
+/* Samples until the output is within 2 px of a 50 px step of the pen */
+void test_filter_step_latency(void)
+{
+    touch_filter_t filter;
+    touchFilterStart(&filter, 100, 100);
+    for(uint8_t i = 0; i < 10; i++) touchFilterAdd(&filter, 100, 100);
+
+    uint8_t samples = 0;
+    while(abs(touchFilterX(&filter) - 150) > 2 && samples < 20) {
+        touchFilterAdd(&filter, 150, 100);
+        samples++;
+    }
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "step settles after %u samples", samples);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL(6, samples); // 30 ms at the 5 ms sample period
+    TEST_ASSERT_EQUAL(100, touchFilterY(&filter));
+}
+
+void test_filter_starts_at_the_press(void)
+{
+    touch_filter_t filter;
+    touchFilterStart(&filter, 200, 40);
+    touchFilterAdd(&filter, 10, 300); // single outlier right after the press
+    TEST_ASSERT_EQUAL(200, touchFilterX(&filter));
+    TEST_ASSERT_EQUAL(40, touchFilterY(&filter));
+}
+
+/**
+ * Mock of the shared spi bus: the main loop samples the touch controller, then the lvgl refresh task
+ * flushes the invalid areas when its period is due. The bus does one thing at a time, so a touch
+ * transaction taken while a refresh is pending can push back its flush.
+ */
+typedef struct
+{
+    uint32_t transactions; // touch transactions on the bus
+    uint32_t contended;    // touch transactions while a refresh was pending
+    uint32_t frames;       // flushed frames
+    uint32_t latency;      // ms from the invalidations to their flushes, summed over all frames
+    uint32_t sample_gap;   // longest ms between two touch samples
+} bus_stats_t;
+
+#define BUS_FRAME_PERIOD 33 // ms between invalidations, e.g. a running animation
+#define BUS_REFR_PERIOD 15  // ms, period of the lvgl refresh task
+#define BUS_FLUSH_TIME 12   // ms to flush a frame
+#define BUS_TOUCH_TIME 1    // ms of a touch transaction, including the bus reconfiguration
+#define BUS_SAMPLE_PERIOD 5 // ms, sampling period while pressed
+
+static bus_stats_t bus_run(bool defer, bool suspended, uint32_t duration)
+{
+    bus_stats_t stats  = {0, 0, 0, 0, 0};
+    uint32_t now       = 0;
+    uint32_t last      = 0;
+    uint32_t next_inv  = 7;
+    uint32_t next_refr = 0;
+    uint32_t inv_time  = 0;
+    bool pending       = false;
+
+    while(now < duration) {
+        if(now >= next_inv) {
+            if(!pending) inv_time = now;
+            pending = true;
+            next_inv += BUS_FRAME_PERIOD;
+        }
+
+        /* touchLoop, a sample is a pressure and a position transaction */
+        if(now - last >= BUS_SAMPLE_PERIOD &&
+           !(defer && touchDeferSample(now - last, BUS_SAMPLE_PERIOD, pending && !suspended))) {
+            if(now - last > stats.sample_gap) stats.sample_gap = now - last;
+            last = now;
+            stats.transactions += 2;
+            if(pending) stats.contended += 2;
+            now += 2 * BUS_TOUCH_TIME;
+        }
+
+        /* lv_task_handler */
+        if(now >= next_refr && !suspended) {
+            next_refr = now + BUS_REFR_PERIOD;
+            if(pending) {
+                stats.latency += now - inv_time;
+                stats.frames++;
+                pending = false;
+                now += BUS_FLUSH_TIME;
+                continue;
+            }
+        }
+        now++;
+    }
+    return stats;
+}
+
+void test_bus_samples_in_the_gaps(void)
+{
+    bus_stats_t shared   = bus_run(false, false, 10000);
+    bus_stats_t deferred = bus_run(true, false, 10000);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "interleaved: %u frames, %u ms latency, %u of %u transactions contended, %u ms gap",
+             shared.frames, shared.latency, shared.contended, shared.transactions, shared.sample_gap);
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "deferred:    %u frames, %u ms latency, %u of %u transactions contended, %u ms gap",
+             deferred.frames, deferred.latency, deferred.contended, deferred.transactions, deferred.sample_gap);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_GREATER_THAN(0, shared.contended);
+    TEST_ASSERT_LESS_THAN(shared.contended / 4, deferred.contended);
+    TEST_ASSERT_EQUAL(shared.frames, deferred.frames);
+    TEST_ASSERT_LESS_OR_EQUAL(BUS_SAMPLE_PERIOD + TOUCH_MAX_DEFER + BUS_FLUSH_TIME, deferred.sample_gap);
+}
+
+/* While rendering is suspended the pending areas are never flushed, sampling must not wait for them */
+void test_bus_no_deferral_while_suspended(void)
+{
+    bus_stats_t stats = bus_run(true, true, 10000);
+    TEST_ASSERT_EQUAL(0, stats.frames);
+    TEST_ASSERT_EQUAL(BUS_SAMPLE_PERIOD, stats.sample_gap);
+    TEST_ASSERT_FALSE(touchDeferSample(BUS_SAMPLE_PERIOD, BUS_SAMPLE_PERIOD, false));
+    TEST_ASSERT_TRUE(touchDeferSample(BUS_SAMPLE_PERIOD, BUS_SAMPLE_PERIOD, true));
+    TEST_ASSERT_FALSE(touchDeferSample(BUS_SAMPLE_PERIOD + TOUCH_MAX_DEFER, BUS_SAMPLE_PERIOD, true));
+}
+
+int main(int argc, char ** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_filter_rejects_spikes_and_jitter);
+    RUN_TEST(test_filter_step_latency);
+    RUN_TEST(test_filter_starts_at_the_press);
+    RUN_TEST(test_bus_samples_in_the_gaps);
+    RUN_TEST(test_bus_no_deferral_while_suspended);
+    return UNITY_END();
+}
@@ -0,0 +1,749 @@
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+
+#include "../../lib/lv_lib_zifont/lv_zifont_codec.cpp"
+
+#define ZIPACK_NO_MAIN
+#include "../../tools/zipack.cpp"
+
+/* A font file in memory, reads stop at limit to mimic a truncated file */
+typedef struct
+{
+    std::vector<uint8_t> data;
+    size_t limit;
+} test_file_t;
+
+static size_t test_read(void * ctx, uint32_t pos, void * dst, size_t len)
+{
+    test_file_t * file = (test_file_t *)ctx;
+    size_t size        = std::min(file->data.size(), file->limit);
+    if(pos >= size) return 0;
+    if(len > size - pos) len = size - pos;
+    memcpy(dst, &file->data[pos], len);
+    return len;
+}
+
+/* A charmap at file position offset with one entry per codepoint, 0 for an unused entry */
+static test_file_t test_charmap(const std::vector<uint16_t> & codepoints, uint32_t offset)
+{
+    test_file_t file;
+    file.data.assign(offset, 0xAA);
+    for(size_t i = 0; i < codepoints.size(); i++) {
+        lv_zifont_char_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.character = codepoints[i];
+        entry.width     = 8;
+        const uint8_t * bytes = (const uint8_t *)&entry;
+        file.data.insert(file.data.end(), bytes, bytes + sizeof(entry));
+    }
+    file.limit = file.data.size();
+    return file;
+}
+
+/* What a scan of the charmap finds, the index without building the ranges */
+static int32_t test_linear(const std::vector<uint16_t> & codepoints, uint32_t unicode)
+{
+    for(size_t i = 0; i < codepoints.size(); i++) {
+        if(codepoints[i] >= 0x20 && codepoints[i] == unicode) return i;
+    }
+    return -1;
+}
+
+static uint32_t seed;
+static uint32_t test_random(void)
+{
+    seed = seed * 1103515245u + 12345u;
+    return seed >> 8;
+}
+
+/* Latin-1, Polish letters of Latin Extended-A, Greek with its hole, Cyrillic and icons, with unused entries */
+static std::vector<uint16_t> test_mixed_charmap(void)
+{
+    std::vector<uint16_t> cp;
+    for(uint16_t c = 0x20; c < 0x7F; c++) cp.push_back(c);
+    cp.push_back(0);
+    for(uint16_t c = 0xA0; c <= 0xFF; c++) cp.push_back(c);
+    static const uint16_t polish[] = {0x104, 0x105, 0x106, 0x107, 0x118, 0x119, 0x141, 0x142, 0x143,
+                                      0x144, 0x15A, 0x15B, 0x179, 0x17A, 0x17B, 0x17C};
+    for(uint8_t i = 0; i < sizeof(polish) / sizeof(polish[0]); i++) cp.push_back(polish[i]);
+    for(uint16_t c = 0x391; c <= 0x3C9; c++) {
+        if(c != 0x3A2) cp.push_back(c);
+    }
+    cp.push_back(0x1F);
+    for(uint16_t c = 0x410; c <= 0x44F; c++) cp.push_back(c);
+    for(uint16_t c = 0xF000; c < 0xF0A0; c += 3) cp.push_back(c);
+    cp.push_back(0xFFFF);
+    return cp;
+}
+
+/* 3000 sorted CJK ideographs without duplicates, like a font subset for a Chinese dashboard */
+static std::vector<uint16_t> test_cjk_charmap(void)
+{
+    std::vector<uint16_t> cp;
+    for(uint16_t c = 0x20; c < 0x7F; c++) cp.push_back(c);
+    seed = 5;
+    while(cp.size() < 3000 + 0x5F) {
+        uint16_t c = 0x4E00 + test_random() % (0x9FA5 - 0x4E00);
+        if(std::find(cp.begin(), cp.end(), c) == cp.end()) cp.push_back(c);
+    }
+    std::sort(cp.begin() + 0x5F, cp.end());
+    return cp;
+}
+
+static void check_all_codepoints(const std::vector<uint16_t> & cp, const lv_zifont_range_t * ranges, uint16_t count)
+{
+    for(uint32_t unicode = 0; unicode <= 0x10010; unicode++) {
+        int32_t expected = test_linear(cp, unicode);
+        int32_t found    = lv_zifont_find_range(ranges, count, unicode);
+        if(found != expected) {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "U+%04X", unicode);
+            TEST_ASSERT_EQUAL_INT32_MESSAGE(expected, found, msg);
+        }
+    }
+}
+
+void test_ranges_merge_consecutive(void)
+{
+    std::vector<uint16_t> cp;
+    for(uint16_t c = 0x20; c <= 0xFF; c++) {
+        if(c < 0x7F || c >= 0xA0) cp.push_back(c);
+    }
+    test_file_t file            = test_charmap(cp, 0);
+    lv_zifont_range_t * ranges  = NULL;
+    uint16_t count              = 0;
+
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, cp.size(), &ranges, &count));
+    TEST_ASSERT_EQUAL(2, count);
+    TEST_ASSERT_EQUAL_HEX16(0x20, ranges[0].first);
+    TEST_ASSERT_EQUAL(0x5F, ranges[0].count);
+    TEST_ASSERT_EQUAL(0, ranges[0].index);
+    TEST_ASSERT_EQUAL_HEX16(0xA0, ranges[1].first);
+    TEST_ASSERT_EQUAL(0x60, ranges[1].count);
+    TEST_ASSERT_EQUAL(0x5F, ranges[1].index);
+    TEST_ASSERT_EQUAL(-1, lv_zifont_find_range(ranges, count, 0x7F));
+    TEST_ASSERT_EQUAL(-1, lv_zifont_find_range(ranges, count, 0x1F));
+    TEST_ASSERT_EQUAL(0x5F + 0x5F, lv_zifont_find_range(ranges, count, 0xFF));
+    free(ranges);
+}
+
+/* Every codepoint of the plane, and past it, gives the charmap entry a scan of the charmap finds */
+void test_ranges_match_linear_scan(void)
+{
+    std::vector<uint16_t> cp   = test_mixed_charmap();
+    test_file_t file           = test_charmap(cp, 57);
+    lv_zifont_range_t * ranges = NULL;
+    uint16_t count             = 0;
+
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 57, cp.size(), &ranges, &count));
+    check_all_codepoints(cp, ranges, count);
+
+    cp   = test_cjk_charmap();
+    file = test_charmap(cp, 0);
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, cp.size(), &ranges, &count));
+    check_all_codepoints(cp, ranges, count);
+    free(ranges);
+}
+
+/* A hand edited font with the charmap out of order */
+void test_ranges_unsorted_charmap(void)
+{
+    std::vector<uint16_t> cp = test_mixed_charmap();
+    seed                     = 11;
+    for(size_t i = cp.size() - 1; i > 0; i--) std::swap(cp[i], cp[test_random() % (i + 1)]);
+    test_file_t file           = test_charmap(cp, 0);
+    lv_zifont_range_t * ranges = NULL;
+    uint16_t count             = 0;
+
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, cp.size(), &ranges, &count));
+    for(uint16_t i = 1; i < count; i++) TEST_ASSERT_TRUE(ranges[i - 1].first < ranges[i].first);
+    check_all_codepoints(cp, ranges, count);
+    free(ranges);
+}
+
+/* Ranges continue across the batches the charmap is read in, a second build replaces the first */
+void test_ranges_batch_boundaries(void)
+{
+    static const uint32_t sizes[] = {1, LV_ZIFONT_RANGE_BATCH - 1, LV_ZIFONT_RANGE_BATCH, LV_ZIFONT_RANGE_BATCH + 1,
+                                     2 * LV_ZIFONT_RANGE_BATCH, 2 * LV_ZIFONT_RANGE_BATCH + 1};
+    lv_zifont_range_t * ranges = NULL;
+    uint16_t count             = 0;
+
+    for(uint8_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        std::vector<uint16_t> cp;
+        for(uint32_t i = 0; i < sizes[s]; i++) cp.push_back(0x400 + i);
+        test_file_t file = test_charmap(cp, 3);
+
+        TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 3, cp.size(), &ranges, &count));
+        TEST_ASSERT_EQUAL(1, count);
+        TEST_ASSERT_EQUAL(sizes[s], ranges[0].count);
+        TEST_ASSERT_EQUAL(sizes[s] - 1, lv_zifont_find_range(ranges, count, 0x400 + sizes[s] - 1));
+        TEST_ASSERT_EQUAL(-1, lv_zifont_find_range(ranges, count, 0x400 + sizes[s]));
+    }
+    free(ranges);
+}
+
+/* A header claiming more entries than the file holds indexes the complete entries only */
+void test_ranges_truncated_file(void)
+{
+    std::vector<uint16_t> cp   = test_mixed_charmap();
+    test_file_t file           = test_charmap(cp, 0);
+    lv_zifont_range_t * ranges = NULL;
+    uint16_t count             = 0;
+    uint32_t complete          = 100;
+    file.limit                 = complete * sizeof(lv_zifont_char_t) + 7;
+
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, cp.size() + 50, &ranges, &count));
+    cp.resize(complete);
+    check_all_codepoints(cp, ranges, count);
+
+    /* Nothing to read at all */
+    file.limit = 0;
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, 10, &ranges, &count));
+    TEST_ASSERT_NULL(ranges);
+    TEST_ASSERT_EQUAL(0, count);
+    TEST_ASSERT_EQUAL(-1, lv_zifont_find_range(ranges, count, 0x41));
+}
+
+/* Lookups per second of the 3000 glyph font, against scanning the charmap for every glyph */
+void test_ranges_benchmark(void)
+{
+    std::vector<uint16_t> cp   = test_cjk_charmap();
+    test_file_t file           = test_charmap(cp, 0);
+    lv_zifont_range_t * ranges = NULL;
+    uint16_t count             = 0;
+    TEST_ASSERT_TRUE(lv_zifont_build_ranges(test_read, &file, 0, cp.size(), &ranges, &count));
+
+    /* A page of text in the font, looked up glyph by glyph */
+    std::vector<uint16_t> text;
+    seed = 3;
+    for(uint32_t i = 0; i < 4096; i++) text.push_back(cp[test_random() % cp.size()]);
+
+    volatile int32_t sink = 0;
+    auto start            = std::chrono::steady_clock::now();
+    for(uint32_t round = 0; round < 100; round++) {
+        for(size_t i = 0; i < text.size(); i++) sink += lv_zifont_find_range(ranges, count, text[i]);
+    }
+    double binary = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    binary /= 100 * text.size();
+
+    start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < text.size(); i++) {
+        const lv_zifont_char_t * entry = (const lv_zifont_char_t *)file.data.data();
+        for(size_t n = 0; n < cp.size(); n++) {
+            if(entry[n].character == text[i]) {
+                sink += n;
+                break;
+            }
+        }
+    }
+    double linear = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    linear /= text.size();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%zu glyphs in %u ranges: %.1f ns per lookup, %.1f ns scanning the charmap in ram",
+             cp.size(), count, binary, linear);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(binary * 4 < linear);
+    free(ranges);
+}
+
+#define GUARD 0xA5 // bytes after the bitmap that neither decoder may touch
+
+/* Decode with lv_zifont_decode_chunk in chunks of the given sizes, and in one go with the colorsAdd reference */
+static void check_decode(const uint8_t * data, uint16_t len, uint32_t pixels, const std::vector<uint16_t> & chunks)
+{
+    uint32_t size = (pixels + 1) / 2;
+    std::vector<uint8_t> fast(size + 4, 0);
+    std::vector<uint8_t> reference(size + 4, 0);
+    std::fill(fast.begin() + size, fast.end(), GUARD);
+    std::fill(reference.begin() + size, reference.end(), GUARD);
+
+    uint32_t pos = 0, done = 0;
+    for(size_t i = 0; done < len; i++) {
+        uint16_t n = i < chunks.size() ? std::min<uint16_t>(chunks[i], len - done) : len - done;
+        lv_zifont_decode_chunk(data + done, n, fast.data(), pixels, &pos);
+        done += n;
+    }
+    uint32_t refpos = 0;
+    lv_zifont_decode_chunk_reference(data, len, reference.data(), pixels, &refpos);
+
+    for(uint32_t i = size; i < size + 4; i++) TEST_ASSERT_EQUAL_HEX8(GUARD, fast[i]);
+    TEST_ASSERT_EQUAL_MEMORY(reference.data(), fast.data(), size + 4);
+    if(refpos < pixels) TEST_ASSERT_EQUAL_UINT32(refpos, pos);
+}
+
+/* Every opcode after an even and an odd number of pixels, followed by two colors to see what it left behind */
+void test_decode_every_opcode(void)
+{
+    std::vector<uint16_t> whole;
+    for(uint16_t op = 0; op < 256; op++) {
+        for(uint8_t parity = 0; parity < 2; parity++) {
+            uint8_t data[] = {(uint8_t)(0xC0 | parity << 3 | 5), (uint8_t)op, 0xFB};
+            const uint8_t * start = parity ? data : data + 1;
+            uint16_t len          = parity ? 3 : 2;
+            check_decode(start, len, 80, whole);
+
+            /* The bitmap ends anywhere inside the opcode */
+            for(uint32_t pixels = 1; pixels < 40; pixels++) check_decode(start, len, pixels, whole);
+        }
+    }
+}
+
+/* Random data split into random chunks, the way glyphs arrive from the read buffer or the mapped flash */
+void test_decode_random_streams(void)
+{
+    seed = 9;
+    for(uint32_t round = 0; round < 20000; round++) {
+        std::vector<uint8_t> data(1 + test_random() % 300);
+        for(size_t i = 0; i < data.size(); i++) data[i] = test_random();
+        uint32_t pixels = 1 + test_random() % 2000;
+
+        std::vector<uint16_t> chunks;
+        for(uint8_t i = 0; i < 6; i++) chunks.push_back(1 + test_random() % 64);
+        check_decode(data.data(), data.size(), pixels, chunks);
+    }
+}
+
+/* A zi encoder for the native tests, pixels are 0, an even gray level or 15 for black */
+static std::vector<uint8_t> test_zi_encode(const std::vector<uint8_t> & pixels)
+{
+    std::vector<uint8_t> out;
+    size_t pos = 0, n = pixels.size();
+    while(pos < n) {
+        size_t skip = 0;
+        while(pos + skip < n && pixels[pos + skip] == 0) skip++;
+        if(pos + skip == n) break;
+        uint8_t p = pixels[pos + skip];
+
+        if(p == LV_ZIFONT_COLOR_BLACK) {
+            size_t run = 0;
+            while(pos + skip + run < n && pixels[pos + skip + run] == LV_ZIFONT_COLOR_BLACK && run < 31) run++;
+            if(skip == 0) {
+                out.push_back(0x20 | run);
+                pos += run;
+            } else if(skip > 31) {
+                out.push_back(0x1F);
+                pos += 31;
+            } else if(run >= 2) {
+                out.push_back(0x60 | skip);
+                pos += skip + 2;
+            } else {
+                out.push_back(0x40 | skip);
+                pos += skip + 1;
+            }
+        } else if(skip == 0 && pos + 1 < n && pixels[pos + 1] != LV_ZIFONT_COLOR_BLACK) {
+            out.push_back(0xC0 | (p >> 1) << 3 | pixels[pos + 1] >> 1);
+            pos += 2;
+        } else if(skip <= 7) {
+            out.push_back(0x80 | skip << 3 | p >> 1);
+            pos += skip + 1;
+        } else {
+            out.push_back(std::min<size_t>(skip, 31));
+            pos += std::min<size_t>(skip, 31);
+        }
+    }
+    return out;
+}
+
+/* An antialiased ring with a solid bar, the levels a zi font uses: 0, even grays and 15 */
+static std::vector<uint8_t> test_glyph(uint8_t w, uint8_t h, uint32_t variant)
+{
+    std::vector<uint8_t> pixels(w * h, 0);
+    float cx = w / 2.0f + (variant % 3) * 0.3f, cy = h / 2.0f, r = std::min(w, h) * 0.4f;
+    for(uint8_t y = 0; y < h; y++) {
+        for(uint8_t x = 0; x < w; x++) {
+            float d      = sqrtf((x + 0.5f - cx) * (x + 0.5f - cx) + (y + 0.5f - cy) * (y + 0.5f - cy));
+            float ink    = 1.5f - fabsf(d - r);
+            uint8_t v    = ink >= 1 ? 15 : ink > 0 ? (uint8_t)(ink * 7) << 1 : 0;
+            if(y == h / 2 + variant % 4 && x > w / 4) v = 15;
+            pixels[y * w + x] = v;
+        }
+    }
+    return pixels;
+}
+
+/* Encoded glyphs decode to their pixels, and both decoders agree */
+void test_decode_glyphs(void)
+{
+    for(uint32_t variant = 0; variant < 12; variant++) {
+        for(uint8_t h = 8; h <= 64; h += 7) {
+            for(uint8_t w = 1; w <= 48; w += 3) {
+                std::vector<uint8_t> pixels = test_glyph(w, h, variant);
+                std::vector<uint8_t> data   = test_zi_encode(pixels);
+                std::vector<uint8_t> bitmap((pixels.size() + 1) / 2, 0);
+                uint32_t pos = 0;
+                lv_zifont_decode_chunk(data.data(), data.size(), bitmap.data(), pixels.size(), &pos);
+                for(size_t i = 0; i < pixels.size(); i++) {
+                    uint8_t v = i & 1 ? bitmap[i / 2] & 0x0F : bitmap[i / 2] >> 4;
+                    if(v != pixels[i]) TEST_ASSERT_EQUAL_HEX8(pixels[i], v);
+                }
+                check_decode(data.data(), data.size(), pixels.size(), std::vector<uint16_t>(1, 17));
+            }
+        }
+    }
+}
+
+static uint32_t rd32(const std::vector<uint8_t> & data, size_t pos)
+{
+    return data[pos] | data[pos + 1] << 8 | data[pos + 2] << 16 | (uint32_t)data[pos + 3] << 24;
+}
+
+/* Every glyph of the zi fonts in the data folder uploaded to the plate, when there are any */
+void test_decode_font_files(void)
+{
+    DIR * dir = opendir("data");
+    uint32_t fonts = 0, glyphs = 0;
+    while(dir) {
+        struct dirent * entry = readdir(dir);
+        if(!entry) break;
+        std::string name = entry->d_name;
+        if(name.size() < 4 || name.compare(name.size() - 3, 3, ".zi") != 0) continue;
+
+        test_file_t file;
+        file.data = readFile(("data/" + name).c_str());
+        if(file.data.size() < 44 || file.data[0] != 4 || file.data[16] != 5) continue;
+
+        uint32_t count   = rd32(file.data, 12);
+        uint32_t charmap = rd32(file.data, 24) + file.data[17];
+        uint8_t height   = file.data[7];
+        fonts++;
+        for(uint32_t i = 0; i < count && charmap + (i + 1) * sizeof(lv_zifont_char_t) <= file.data.size(); i++) {
+            lv_zifont_char_t c;
+            memcpy(&c, &file.data[charmap + i * sizeof(c)], sizeof(c));
+            uint32_t pos = charmap + (c.pos[2] << 16) + (c.pos[1] << 8) + c.pos[0] + 1;
+            if(c.character < 0x20 || pos + c.length > file.data.size()) continue;
+            check_decode(&file.data[pos], c.length, c.width * height, std::vector<uint16_t>(1, 64));
+            glyphs++;
+        }
+    }
+    if(dir) closedir(dir);
+    if(fonts == 0) TEST_IGNORE_MESSAGE("no .zi fonts in data/");
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%u glyphs of %u fonts in data/", glyphs, fonts);
+    TEST_MESSAGE(msg);
+}
+
+/* Decoding time of a 3000 glyph font of 24 px high glyphs, with both decoders */
+void test_decode_benchmark(void)
+{
+    std::vector<std::vector<uint8_t> > font;
+    uint32_t pixels = 0;
+    for(uint32_t i = 0; i < 3000; i++) {
+        uint8_t w = 12 + i % 13;
+        font.push_back(test_zi_encode(test_glyph(w, 24, i)));
+        pixels += w * 24;
+    }
+
+    std::vector<uint8_t> bitmap(24 * 24);
+    double ns[2];
+    for(uint8_t d = 0; d < 2; d++) {
+        auto start = std::chrono::steady_clock::now();
+        for(uint8_t round = 0; round < 10; round++) {
+            for(uint32_t i = 0; i < font.size(); i++) {
+                uint32_t pos = 0;
+                uint8_t w    = 12 + i % 13;
+                memset(bitmap.data(), 0, (w * 24 + 1) / 2);
+                if(d == 0)
+                    lv_zifont_decode_chunk(font[i].data(), font[i].size(), bitmap.data(), w * 24, &pos);
+                else
+                    lv_zifont_decode_chunk_reference(font[i].data(), font[i].size(), bitmap.data(), w * 24, &pos);
+            }
+        }
+        ns[d] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        ns[d] /= 10 * font.size();
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%.0f ns per glyph, %.0f ns with colorsAdd, %.1f Mpixel/s", ns[0], ns[1],
+             pixels / (ns[0] * font.size() / 1000));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(ns[0] < ns[1] * 1.5);
+}
+
+/* The device maps the header and the glyph table in place, zipack writes them field by field */
+void test_pack_layout(void)
+{
+    TEST_ASSERT_EQUAL(20, sizeof(lv_zipack_header_t));
+    TEST_ASSERT_EQUAL(0, offsetof(lv_zipack_header_t, magic));
+    TEST_ASSERT_EQUAL(4, offsetof(lv_zipack_header_t, version));
+    TEST_ASSERT_EQUAL(5, offsetof(lv_zipack_header_t, bpp));
+    TEST_ASSERT_EQUAL(6, offsetof(lv_zipack_header_t, line_height));
+    TEST_ASSERT_EQUAL(7, offsetof(lv_zipack_header_t, base_line));
+    TEST_ASSERT_EQUAL(8, offsetof(lv_zipack_header_t, glyph_count));
+    TEST_ASSERT_EQUAL(12, offsetof(lv_zipack_header_t, glyph_offset));
+    TEST_ASSERT_EQUAL(16, offsetof(lv_zipack_header_t, bitmap_offset));
+
+    TEST_ASSERT_EQUAL(16, sizeof(lv_zipack_glyph_t));
+    TEST_ASSERT_EQUAL(0, offsetof(lv_zipack_glyph_t, unicode));
+    TEST_ASSERT_EQUAL(4, offsetof(lv_zipack_glyph_t, offset));
+    TEST_ASSERT_EQUAL(8, offsetof(lv_zipack_glyph_t, size));
+    TEST_ASSERT_EQUAL(10, offsetof(lv_zipack_glyph_t, adv_w));
+    TEST_ASSERT_EQUAL(11, offsetof(lv_zipack_glyph_t, box_w));
+    TEST_ASSERT_EQUAL(12, offsetof(lv_zipack_glyph_t, box_h));
+    TEST_ASSERT_EQUAL(13, offsetof(lv_zipack_glyph_t, ofs_x));
+    TEST_ASSERT_EQUAL(14, offsetof(lv_zipack_glyph_t, ofs_y));
+    TEST_ASSERT_EQUAL(15, offsetof(lv_zipack_glyph_t, flags));
+
+    TEST_ASSERT_EQUAL(10, sizeof(lv_zifont_char_t));
+    TEST_ASSERT_EQUAL(ZI_CHAR_SIZE, sizeof(lv_zifont_char_t));
+}
+
+/* A font with the glyph shapes of the decoder tests, some empty, sorted like zipack sorts them */
+static Font test_font(uint32_t count)
+{
+    Font font;
+    font.line_height = 24;
+    font.base_line   = 5;
+    for(uint32_t i = 0; i < count; i++) {
+        Glyph glyph;
+        glyph.unicode = i < 0x5F ? 0x20 + i : 0x391 + (i - 0x5F) * 7;
+        glyph.box_w   = i % 5 == 0 ? 0 : 3 + i % 17;
+        glyph.box_h   = i % 5 == 0 ? 0 : 4 + i % 20;
+        glyph.adv_w   = glyph.box_w + 1;
+        glyph.ofs_x   = (int8_t)(i % 3) - 1;
+        glyph.ofs_y   = -(int8_t)(i % 6);
+        glyph.pixels  = test_glyph(glyph.box_w, glyph.box_h, i);
+        font.glyphs.push_back(glyph);
+    }
+    return font;
+}
+
+/* Every glyph packed by zipack is found and expanded by the device code, from the mapped table and from the file */
+void test_pack_roundtrip(void)
+{
+    Font font = test_font(600);
+    for(uint8_t bpp = 1; bpp <= 4; bpp *= 2) {
+        for(uint8_t rle = 0; rle < 2; rle++) {
+            test_file_t file;
+            uint32_t compressed;
+            TEST_ASSERT_TRUE(packFont(font, bpp, rle, file.data, &compressed));
+            file.limit = file.data.size();
+            if(rle) TEST_ASSERT_GREATER_THAN(0, compressed);
+
+            lv_zipack_header_t header;
+            memcpy(&header, file.data.data(), sizeof(header));
+            TEST_ASSERT_EQUAL_HEX32(LV_ZIPACK_MAGIC, header.magic);
+            TEST_ASSERT_EQUAL(LV_ZIPACK_VERSION, header.version);
+            TEST_ASSERT_EQUAL(bpp, header.bpp);
+            TEST_ASSERT_EQUAL(24, header.line_height);
+            TEST_ASSERT_EQUAL(5, header.base_line);
+            TEST_ASSERT_EQUAL(font.glyphs.size(), header.glyph_count);
+            TEST_ASSERT_EQUAL(header.glyph_offset + header.glyph_count * sizeof(lv_zipack_glyph_t),
+                              header.bitmap_offset);
+
+            const lv_zipack_glyph_t * mapped = (const lv_zipack_glyph_t *)&file.data[header.glyph_offset];
+            for(size_t i = 0; i < font.glyphs.size(); i++) {
+                const Glyph & expected = font.glyphs[i];
+                lv_zipack_glyph_t glyph, read;
+                TEST_ASSERT_TRUE(lv_zipack_find(mapped, NULL, NULL, 0, header.glyph_count, expected.unicode, &glyph));
+                TEST_ASSERT_TRUE(lv_zipack_find(NULL, test_read, &file, header.glyph_offset, header.glyph_count,
+                                                expected.unicode, &read));
+                TEST_ASSERT_EQUAL_MEMORY(&glyph, &read, sizeof(glyph));
+                TEST_ASSERT_EQUAL_UINT32(expected.unicode, glyph.unicode);
+                TEST_ASSERT_EQUAL(expected.adv_w, glyph.adv_w);
+                TEST_ASSERT_EQUAL(expected.box_w, glyph.box_w);
+                TEST_ASSERT_EQUAL(expected.box_h, glyph.box_h);
+                TEST_ASSERT_EQUAL(expected.ofs_x, glyph.ofs_x);
+                TEST_ASSERT_EQUAL(expected.ofs_y, glyph.ofs_y);
+
+                /* The bitmap as lv_font_get_bitmap_fmt_zipack hands it to lvgl */
+                std::vector<uint8_t> bits = packBits(expected, bpp);
+                uint32_t size             = (glyph.box_w * glyph.box_h * bpp + 7) / 8;
+                TEST_ASSERT_EQUAL(bits.size(), size);
+                TEST_ASSERT_LESS_OR_EQUAL(file.data.size(), header.bitmap_offset + glyph.offset + glyph.size);
+                std::vector<uint8_t> bitmap(size + 1, GUARD);
+                const uint8_t * src = &file.data[header.bitmap_offset + glyph.offset];
+                if(glyph.flags & LV_ZIPACK_RLE) {
+                    TEST_ASSERT_EQUAL_UINT32(size, lv_zipack_rle_decode(src, glyph.size, bitmap.data(), size));
+                } else {
+                    TEST_ASSERT_EQUAL(size, glyph.size);
+                    memcpy(bitmap.data(), src, size);
+                }
+                if(size) TEST_ASSERT_EQUAL_MEMORY(bits.data(), bitmap.data(), size);
+                TEST_ASSERT_EQUAL_HEX8(GUARD, bitmap[size]);
+            }
+
+            /* Codepoints between, before and after the glyphs */
+            lv_zipack_glyph_t glyph;
+            static const uint32_t missing[] = {0, 0x1F, 0x7F, 0x392, 0x397, 0xFFFF, 0x1F600};
+            for(uint8_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++) {
+                TEST_ASSERT_FALSE(lv_zipack_find(mapped, NULL, NULL, 0, header.glyph_count, missing[i], &glyph));
+                TEST_ASSERT_FALSE(lv_zipack_find(NULL, test_read, &file, header.glyph_offset, header.glyph_count,
+                                                 missing[i], &glyph));
+            }
+
+            /* A truncated glyph table is not found instead of being read past the end */
+            file.limit = header.glyph_offset + header.glyph_count * sizeof(lv_zipack_glyph_t) / 2;
+            TEST_ASSERT_FALSE(lv_zipack_find(NULL, test_read, &file, header.glyph_offset, header.glyph_count,
+                                             font.glyphs.back().unicode, &glyph));
+        }
+    }
+}
+
+/* Runs and literals of every length the control byte can hold, and truncated or oversized input */
+void test_pack_rle(void)
+{
+    seed = 13;
+    for(uint32_t round = 0; round < 2000; round++) {
+        std::vector<uint8_t> in;
+        while(in.size() < round % 700) {
+            uint32_t n = 1 + test_random() % 300;
+            uint8_t v  = test_random();
+            for(uint32_t i = 0; i < n; i++) in.push_back(round % 3 == 0 ? test_random() : v);
+        }
+        std::vector<uint8_t> packed = rleEncode(in);
+        std::vector<uint8_t> out(in.size() + 4, GUARD);
+        TEST_ASSERT_EQUAL_UINT32(in.size(), lv_zipack_rle_decode(packed.data(), packed.size(), out.data(), in.size()));
+        if(!in.empty()) TEST_ASSERT_EQUAL_MEMORY(in.data(), out.data(), in.size());
+        TEST_ASSERT_EQUAL_HEX8(GUARD, out[in.size()]);
+
+        /* A short bitmap buffer or a cut off stream stop in bounds */
+        std::fill(out.begin(), out.end(), GUARD);
+        uint32_t size = in.size() / 2;
+        TEST_ASSERT_EQUAL_UINT32(size, lv_zipack_rle_decode(packed.data(), packed.size(), out.data(), size));
+        TEST_ASSERT_EQUAL_HEX8(GUARD, out[size]);
+        lv_zipack_rle_decode(packed.data(), packed.size() / 2, out.data(), in.size());
+        TEST_ASSERT_EQUAL_HEX8(GUARD, out[in.size()]);
+    }
+}
+
+/* A zi V5 font of encoded glyphs, the charmap follows the header and the font name */
+static std::vector<uint8_t> test_zi_font(const std::vector<std::vector<uint8_t> > & glyphs, const uint8_t * widths,
+                                         uint8_t height, uint16_t first, const char * name)
+{
+    std::vector<uint8_t> data(ZI_HEADER_SIZE, 0);
+    data[0]  = 4; // Password
+    data[7]  = height;
+    data[12] = glyphs.size() & 0xFF;
+    data[13] = glyphs.size() >> 8;
+    data[16] = 5;            // Version
+    data[17] = strlen(name); // Descriptionlength
+    data[24] = ZI_HEADER_SIZE;
+    data.insert(data.end(), name, name + strlen(name));
+
+    std::vector<uint8_t> bitmaps;
+    uint32_t charmap_size = glyphs.size() * sizeof(lv_zifont_char_t);
+    for(size_t i = 0; i < glyphs.size(); i++) {
+        lv_zifont_char_t c;
+        memset(&c, 0, sizeof(c));
+        uint32_t pos = charmap_size + bitmaps.size();
+        c.character  = first + i;
+        c.width      = widths[i];
+        c.pos[0]     = pos & 0xFF;
+        c.pos[1]     = (pos >> 8) & 0xFF;
+        c.pos[2]     = pos >> 16;
+        c.length     = glyphs[i].size();
+        data.insert(data.end(), (const uint8_t *)&c, (const uint8_t *)&c + sizeof(c));
+        bitmaps.push_back(4); // bpp byte
+        bitmaps.insert(bitmaps.end(), glyphs[i].begin(), glyphs[i].end());
+    }
+    data.insert(data.end(), bitmaps.begin(), bitmaps.end());
+    return data;
+}
+
+/* zipack reads the glyphs of a zi font with the device decoder, then packs them */
+void test_pack_from_zi(void)
+{
+    std::vector<std::vector<uint8_t> > pixels, encoded;
+    uint8_t widths[400];
+    for(uint32_t i = 0; i < 400; i++) {
+        widths[i] = 6 + i % 19;
+        pixels.push_back(test_glyph(widths[i], 24, i));
+        encoded.push_back(test_zi_encode(pixels.back()));
+    }
+    std::vector<uint8_t> zi = test_zi_font(encoded, widths, 24, 0x21, "");
+
+    Font font;
+    TEST_ASSERT_TRUE(loadZi(zi, false, font));
+    TEST_ASSERT_EQUAL(400, font.glyphs.size());
+    for(uint32_t i = 0; i < 400; i++) {
+        TEST_ASSERT_EQUAL_UINT32(0x21 + i, font.glyphs[i].unicode);
+        TEST_ASSERT_EQUAL(widths[i], font.glyphs[i].box_w);
+        TEST_ASSERT_EQUAL(24, font.glyphs[i].box_h);
+        TEST_ASSERT_EQUAL_MEMORY(pixels[i].data(), font.glyphs[i].pixels.data(), pixels[i].size());
+    }
+
+    /* An icon font, its charmap found through the length of the font name in the header */
+    std::vector<uint8_t> icons = test_zi_font(encoded, widths, 24, 0xF000, "Font Awesome 5 Free Solid");
+    Font iconFont;
+    TEST_ASSERT_TRUE(loadZi(icons, true, iconFont));
+    TEST_ASSERT_EQUAL(400, iconFont.glyphs.size());
+    TEST_ASSERT_EQUAL_UINT32(0xF000 + 399, iconFont.glyphs[399].unicode);
+    TEST_ASSERT_EQUAL_MEMORY(pixels[399].data(), iconFont.glyphs[399].pixels.data(), pixels[399].size());
+
+    std::vector<uint8_t> out;
+    uint32_t compressed;
+    TEST_ASSERT_TRUE(packFont(font, 4, true, out, &compressed));
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%zu bytes zi, %zu bytes packed: %.0f ns per glyph zi, %.0f ns per glyph packed",
+             zi.size(), out.size(), decodeZiNs(zi, false), decodePackNs(out, font.glyphs.size()));
+    TEST_MESSAGE(msg);
+}
+
+/* The glyphs of a BDF font, as converted from a TTF by otf2bdf */
+void test_pack_from_bdf(void)
+{
+    static const char bdf[] = "STARTFONT 2.1\nFONT_ASCENT 7\nFONT_DESCENT 2\n"
+                              "STARTCHAR A\nENCODING 65\nDWIDTH 6 0\nBBX 5 3 0 1\nBITMAP\n20\n50\nF8\nENDCHAR\n"
+                              "STARTCHAR uni0394\nENCODING 916\nDWIDTH 7 0\nBBX 6 2 -1 0\nBITMAP\n30\nFC\nENDCHAR\n"
+                              "ENDFONT\n";
+    Font font;
+    TEST_ASSERT_TRUE(loadBdf(std::vector<uint8_t>(bdf, bdf + sizeof(bdf) - 1), font));
+    TEST_ASSERT_EQUAL(9, font.line_height);
+    TEST_ASSERT_EQUAL(2, font.base_line);
+    TEST_ASSERT_EQUAL(2, font.glyphs.size());
+
+    std::vector<uint8_t> out;
+    uint32_t compressed;
+    TEST_ASSERT_TRUE(packFont(font, 1, false, out, &compressed));
+    const lv_zipack_header_t * header = (const lv_zipack_header_t *)out.data();
+    const lv_zipack_glyph_t * glyphs  = (const lv_zipack_glyph_t *)&out[header->glyph_offset];
+
+    lv_zipack_glyph_t glyph;
+    TEST_ASSERT_TRUE(lv_zipack_find(glyphs, NULL, NULL, 0, header->glyph_count, 0x394, &glyph));
+    TEST_ASSERT_EQUAL(7, glyph.adv_w);
+    TEST_ASSERT_EQUAL(-1, glyph.ofs_x);
+    static const uint8_t delta[] = {0x33, 0xF0}; // 001100 111111, rows are not padded
+    TEST_ASSERT_EQUAL(2, glyph.size);
+    TEST_ASSERT_EQUAL_MEMORY(delta, &out[header->bitmap_offset + glyph.offset], 2);
+
+    std::vector<std::pair<uint32_t, uint32_t> > subset;
+    TEST_ASSERT_TRUE(parseSubset("0x20-0x7E,0x394", subset));
+    TEST_ASSERT_EQUAL(2, subset.size());
+    TEST_ASSERT_EQUAL_UINT32(0x7E, subset[0].second);
+    TEST_ASSERT_EQUAL_UINT32(0x394, subset[1].first);
+    TEST_ASSERT_FALSE(parseSubset("0x20-", subset));
+}
+
+int main(int argc, char ** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ranges_merge_consecutive);
+    RUN_TEST(test_ranges_match_linear_scan);
+    RUN_TEST(test_ranges_unsorted_charmap);
+    RUN_TEST(test_ranges_batch_boundaries);
+    RUN_TEST(test_ranges_truncated_file);
+    RUN_TEST(test_ranges_benchmark);
+    RUN_TEST(test_decode_every_opcode);
+    RUN_TEST(test_decode_random_streams);
+    RUN_TEST(test_decode_glyphs);
+    RUN_TEST(test_decode_font_files);
+    RUN_TEST(test_decode_benchmark);
+    RUN_TEST(test_pack_layout);
+    RUN_TEST(test_pack_roundtrip);
+    RUN_TEST(test_pack_rle);
+    RUN_TEST(test_pack_from_zi);
+    RUN_TEST(test_pack_from_bdf);
+    return UNITY_END();
+}
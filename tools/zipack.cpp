@@ -0,0 +1,417 @@
+/**
+ * zipack - convert a zi V5 or BDF font into the packed font format of lv_zipack.h
+ *
+ * Build and run on the host:
+ *   g++ -O2 -std=c++11 -o zipack tools/zipack.cpp lib/lv_lib_zifont/lv_zifont_codec.cpp
+ *   ./zipack [-b 4|2|1] [-r] [-i] [-c 0x20-0x7E,0xB0,0x391-0x3C9] input.zi|input.bdf output.zp
+ *
+ *   -b  bits per pixel of the packed bitmaps, default 4
+ *   -r  run length encode the bitmaps that get smaller by it
+ *   -i  the zi font is an icon font, its glyphs are numbered from 0xF000
+ *   -c  only keep these codepoints, default all glyphs of the input
+ *
+ * TTF fonts can be converted to BDF first, e.g. with otf2bdf.
+ * The tool prints the file sizes and the host time to decode every glyph from both formats.
+ * The native tests include this file with ZIPACK_NO_MAIN to check the packed layout against the device code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../lib/lv_lib_zifont/lv_zipack.h"
+#include "../lib/lv_lib_zifont/lv_zifont_codec.h"
+
+#define ZI_HEADER_SIZE 44 // zi_font_header_t on the 32 bit device
+#define ZI_CHAR_SIZE 10   // lv_zifont_char_t
+
+struct Glyph
+{
+    uint32_t unicode;
+    uint8_t adv_w;
+    uint8_t box_w;
+    uint8_t box_h;
+    int8_t ofs_x;
+    int8_t ofs_y;
+    std::vector<uint8_t> pixels; // box_w * box_h values of 0..15
+};
+
+struct Font
+{
+    uint8_t line_height;
+    uint8_t base_line;
+    std::vector<Glyph> glyphs;
+};
+
+static std::vector<uint8_t> readFile(const char * path)
+{
+    std::vector<uint8_t> data;
+    FILE * file = fopen(path, "rb");
+    if(!file) return data;
+
+    uint8_t chunk[4096];
+    size_t len;
+    while((len = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + len);
+    fclose(file);
+    return data;
+}
+
+static uint32_t rd16(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t rd32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void wr(std::vector<uint8_t> & out, uint32_t value, uint8_t bytes)
+{
+    for(uint8_t i = 0; i < bytes; i++) out.push_back((value >> (8 * i)) & 0xFF);
+}
+
+/* The decoder of the device into a 4bpp bitmap, unpacked into one value per pixel */
+static void ziDecode(const uint8_t * data, size_t len, std::vector<uint8_t> & pixels)
+{
+    std::vector<uint8_t> bitmap((pixels.size() + 1) / 2, 0);
+    uint32_t pos = 0;
+    lv_zifont_decode_chunk(data, std::min<size_t>(len, 0xFFFF), bitmap.data(), pixels.size(), &pos);
+    for(size_t i = 0; i < pixels.size(); i++) pixels[i] = i & 1 ? bitmap[i / 2] & 0x0F : bitmap[i / 2] >> 4;
+}
+
+static bool loadZi(const std::vector<uint8_t> & data, bool icons, Font & font)
+{
+    if(data.size() < ZI_HEADER_SIZE || data[0] != 4 || data[16] != 5) {
+        fprintf(stderr, "Not a zi V5 font\n");
+        return false;
+    }
+
+    uint32_t count   = rd32(&data[12]);
+    uint32_t charmap = rd32(&data[24]) + data[17]; // Startdataaddress + Descriptionlength, also of icon fonts
+    font.line_height = data[7];
+    font.base_line   = 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        size_t entry = charmap + i * ZI_CHAR_SIZE;
+        if(entry + ZI_CHAR_SIZE > data.size()) break;
+
+        const uint8_t * c = &data[entry];
+        uint32_t unicode  = icons ? 0xF000 + i : rd16(c);
+        if(unicode < 0x20) continue; // unused entry
+
+        Glyph glyph;
+        glyph.unicode = unicode;
+        glyph.adv_w   = c[2];
+        glyph.box_w   = c[2];
+        glyph.box_h   = font.line_height;
+        glyph.ofs_x   = -c[3];
+        glyph.ofs_y   = 0;
+        glyph.pixels.assign(glyph.box_w * glyph.box_h, 0);
+
+        size_t pos = charmap + c[5] + (c[6] << 8) + (c[7] << 16) + 1; // +1 for skipping the bpp byte
+        size_t len = rd16(&c[8]);
+        if(pos + len > data.size()) len = pos < data.size() ? data.size() - pos : 0;
+        if(unicode != 0x20 && len > 0) ziDecode(&data[pos], len, glyph.pixels);
+        font.glyphs.push_back(glyph);
+    }
+    return true;
+}
+
+static bool loadBdf(const std::vector<uint8_t> & data, Font & font)
+{
+    std::string text(data.begin(), data.end());
+    size_t pos       = 0;
+    int ascent       = 0;
+    int descent      = 0;
+    Glyph glyph      = Glyph();
+    bool inBitmap    = false;
+    bool haveGlyph   = false;
+    uint32_t row     = 0;
+    int32_t encoding = -1;
+
+    while(pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if(end == std::string::npos) end = text.size();
+        std::string line = text.substr(pos, end - pos);
+        pos              = end + 1;
+        if(!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+
+        int a, b, c, d;
+        if(inBitmap) {
+            if(line == "ENDCHAR") {
+                inBitmap = false;
+                if(encoding >= 0x20) font.glyphs.push_back(glyph);
+                continue;
+            }
+            if(row >= glyph.box_h) continue;
+            for(uint8_t x = 0; x < glyph.box_w && x / 4 < line.size(); x++) {
+                uint8_t nibble = strtoul(line.substr(x / 4, 1).c_str(), NULL, 16);
+                if(nibble & (8 >> (x % 4))) glyph.pixels[row * glyph.box_w + x] = 15;
+            }
+            row++;
+        } else if(sscanf(line.c_str(), "FONT_ASCENT %d", &a) == 1) {
+            ascent = a;
+        } else if(sscanf(line.c_str(), "FONT_DESCENT %d", &a) == 1) {
+            descent = a;
+        } else if(line.compare(0, 9, "STARTCHAR") == 0) {
+            glyph     = Glyph();
+            encoding  = -1;
+            haveGlyph = true;
+        } else if(haveGlyph && sscanf(line.c_str(), "ENCODING %d", &a) == 1) {
+            encoding      = a;
+            glyph.unicode = a;
+        } else if(haveGlyph && sscanf(line.c_str(), "DWIDTH %d", &a) == 1) {
+            glyph.adv_w = a;
+        } else if(haveGlyph && sscanf(line.c_str(), "BBX %d %d %d %d", &a, &b, &c, &d) == 4) {
+            glyph.box_w = a;
+            glyph.box_h = b;
+            glyph.ofs_x = c;
+            glyph.ofs_y = d;
+            glyph.pixels.assign(a * b, 0);
+        } else if(haveGlyph && line == "BITMAP") {
+            inBitmap = true;
+            row      = 0;
+        }
+    }
+
+    font.line_height = ascent + descent;
+    font.base_line   = descent;
+    return !font.glyphs.empty();
+}
+
+/* Parse "0x20-0x7E,0xB0" into a list of inclusive ranges */
+static bool parseSubset(const char * arg, std::vector<std::pair<uint32_t, uint32_t> > & subset)
+{
+    const char * p = arg;
+    while(*p) {
+        char * end;
+        uint32_t first = strtoul(p, &end, 0);
+        uint32_t last  = first;
+        if(end == p) return false;
+        if(*end == '-') {
+            p    = end + 1;
+            last = strtoul(p, &end, 0);
+            if(end == p) return false;
+        }
+        subset.push_back(std::make_pair(first, last));
+        p = *end == ',' ? end + 1 : end;
+        if(*end && *end != ',') return false;
+    }
+    return true;
+}
+
+static std::vector<uint8_t> packBits(const Glyph & glyph, uint8_t bpp)
+{
+    std::vector<uint8_t> bits((glyph.pixels.size() * bpp + 7) / 8, 0);
+    for(size_t i = 0; i < glyph.pixels.size(); i++) {
+        uint8_t value = glyph.pixels[i] >> (4 - bpp);
+        size_t bit    = i * bpp;
+        bits[bit / 8] |= value << (8 - bpp - bit % 8);
+    }
+    return bits;
+}
+
+static std::vector<uint8_t> rleEncode(const std::vector<uint8_t> & in)
+{
+    std::vector<uint8_t> out;
+    size_t i = 0;
+    while(i < in.size()) {
+        size_t run = 1;
+        while(i + run < in.size() && in[i + run] == in[i] && run < LV_ZIPACK_RLE_REPEAT_MAX) run++;
+        if(run >= 2) {
+            out.push_back(run + 126);
+            out.push_back(in[i]);
+            i += run;
+            continue;
+        }
+
+        size_t start = i;
+        while(i < in.size() && i - start < LV_ZIPACK_RLE_LITERAL_MAX) {
+            if(i + 1 < in.size() && in[i + 1] == in[i]) break;
+            i++;
+        }
+        out.push_back(i - start - 1);
+        out.insert(out.end(), in.begin() + start, in.begin() + i);
+    }
+    return out;
+}
+
+/* Write the header, the glyph table and the bitmaps of the sorted glyphs, see lv_zipack.h */
+static bool packFont(const Font & font, uint8_t bpp, bool rle, std::vector<uint8_t> & out, uint32_t * compressed)
+{
+    uint32_t count         = font.glyphs.size();
+    uint32_t glyph_offset  = sizeof(lv_zipack_header_t);
+    uint32_t bitmap_offset = glyph_offset + count * sizeof(lv_zipack_glyph_t);
+    std::vector<uint8_t> bitmaps;
+    out.clear();
+    *compressed = 0;
+
+    wr(out, LV_ZIPACK_MAGIC, 4);
+    wr(out, LV_ZIPACK_VERSION, 1);
+    wr(out, bpp, 1);
+    wr(out, font.line_height, 1);
+    wr(out, font.base_line, 1);
+    wr(out, count, 4);
+    wr(out, glyph_offset, 4);
+    wr(out, bitmap_offset, 4);
+
+    for(size_t i = 0; i < font.glyphs.size(); i++) {
+        const Glyph & glyph       = font.glyphs[i];
+        std::vector<uint8_t> bits = packBits(glyph, bpp);
+        uint8_t flags             = 0;
+        if(rle) {
+            std::vector<uint8_t> packed = rleEncode(bits);
+            if(packed.size() < bits.size()) {
+                bits.swap(packed);
+                flags |= LV_ZIPACK_RLE;
+                (*compressed)++;
+            }
+        }
+        if(bits.size() > 0xFFFF) {
+            fprintf(stderr, "Glyph 0x%X is too large\n", glyph.unicode);
+            return false;
+        }
+
+        wr(out, glyph.unicode, 4);
+        wr(out, bitmaps.size(), 4);
+        wr(out, bits.size(), 2);
+        wr(out, glyph.adv_w, 1);
+        wr(out, glyph.box_w, 1);
+        wr(out, glyph.box_h, 1);
+        wr(out, (uint8_t)glyph.ofs_x, 1);
+        wr(out, (uint8_t)glyph.ofs_y, 1);
+        wr(out, flags, 1);
+        bitmaps.insert(bitmaps.end(), bits.begin(), bits.end());
+    }
+    out.insert(out.end(), bitmaps.begin(), bitmaps.end());
+    return true;
+}
+
+static double decodeZiNs(const std::vector<uint8_t> & data, bool icons)
+{
+    const int rounds = 20;
+    size_t glyphs    = 0;
+    auto start       = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; r++) {
+        Font font;
+        loadZi(data, icons, font);
+        glyphs += font.glyphs.size();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return glyphs ? (double)ns / glyphs : 0;
+}
+
+static double decodePackNs(const std::vector<uint8_t> & out, uint32_t count)
+{
+    const int rounds = 20;
+    std::vector<uint8_t> bitmap(256 * 256);
+    uint32_t table         = rd32(&out[12]);
+    uint32_t bitmap_offset = rd32(&out[16]);
+    auto start             = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; r++) {
+        for(uint32_t i = 0; i < count; i++) {
+            const uint8_t * g = &out[table + i * sizeof(lv_zipack_glyph_t)];
+            const uint8_t * p = &out[bitmap_offset + rd32(&g[4])];
+            size_t size       = rd16(&g[8]);
+            if(g[15] & LV_ZIPACK_RLE)
+                lv_zipack_rle_decode(p, size, bitmap.data(), bitmap.size());
+            else
+                memcpy(bitmap.data(), p, std::min(size, bitmap.size()));
+        }
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return count ? (double)ns / (rounds * count) : 0;
+}
+
+#ifndef ZIPACK_NO_MAIN
+int main(int argc, char * argv[])
+{
+    uint8_t bpp = 4;
+    bool rle    = false;
+    bool icons  = false;
+    std::vector<std::pair<uint32_t, uint32_t> > subset;
+
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++) {
+        if(strcmp(argv[arg], "-b") == 0 && arg + 1 < argc) {
+            bpp = atoi(argv[++arg]);
+        } else if(strcmp(argv[arg], "-r") == 0) {
+            rle = true;
+        } else if(strcmp(argv[arg], "-i") == 0) {
+            icons = true;
+        } else if(strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+            if(!parseSubset(argv[++arg], subset)) {
+                fprintf(stderr, "Invalid codepoints %s\n", argv[arg]);
+                return 1;
+            }
+        } else {
+            arg = argc;
+        }
+    }
+    if(arg + 2 != argc || (bpp != 1 && bpp != 2 && bpp != 4)) {
+        fprintf(stderr, "Usage: %s [-b 4|2|1] [-r] [-i] [-c first-last,...] input.zi|input.bdf output.zp\n", argv[0]);
+        return 1;
+    }
+
+    const char * input        = argv[arg];
+    const char * output       = argv[arg + 1];
+    std::vector<uint8_t> data = readFile(input);
+    bool isZi                 = !data.empty() && data[0] == 4;
+    Font font;
+
+    if(data.empty()) {
+        fprintf(stderr, "Could not read %s\n", input);
+        return 1;
+    }
+    if(!(isZi ? loadZi(data, icons, font) : loadBdf(data, font))) {
+        fprintf(stderr, "No glyphs found in %s\n", input);
+        return 1;
+    }
+
+    /* Keep the requested codepoints, sorted for the binary search on the device */
+    if(!subset.empty()) {
+        std::vector<Glyph> keep;
+        for(size_t i = 0; i < font.glyphs.size(); i++) {
+            for(size_t j = 0; j < subset.size(); j++) {
+                if(font.glyphs[i].unicode >= subset[j].first && font.glyphs[i].unicode <= subset[j].second) {
+                    keep.push_back(font.glyphs[i]);
+                    break;
+                }
+            }
+        }
+        font.glyphs.swap(keep);
+    }
+    std::sort(font.glyphs.begin(), font.glyphs.end(),
+              [](const Glyph & a, const Glyph & b) { return a.unicode < b.unicode; });
+    font.glyphs.erase(std::unique(font.glyphs.begin(), font.glyphs.end(),
+                                  [](const Glyph & a, const Glyph & b) { return a.unicode == b.unicode; }),
+                      font.glyphs.end());
+
+    std::vector<uint8_t> out;
+    uint32_t count      = font.glyphs.size();
+    uint32_t compressed = 0;
+    if(!packFont(font, bpp, rle, out, &compressed)) return 1;
+
+    FILE * file = fopen(output, "wb");
+    if(!file || fwrite(out.data(), 1, out.size(), file) != out.size()) {
+        fprintf(stderr, "Could not write %s\n", output);
+        if(file) fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    printf("%s: %u glyphs, %u bpp, %u compressed, line height %u\n", output, count, bpp, compressed,
+           font.line_height);
+    printf("size:   %8zu bytes input, %8zu bytes packed\n", data.size(), out.size());
+    printf("decode: %8.0f ns/glyph %s, %5.0f ns/glyph packed\n", isZi ? decodeZiNs(data, icons) : 0.0,
+           isZi ? "zi" : "(bdf)", decodePackNs(out, count));
+    return 0;
+}
+#endif